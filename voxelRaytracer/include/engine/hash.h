@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+constexpr uint64_t hashSeed = 0xcbf29ce484222325ull;
+
+// fnv-1a, start with hashSeed
+inline uint64_t hashBytes(uint64_t aHash, const void* aData, size_t aSize)
+{
+	const uint8_t* myBytes = static_cast<const uint8_t*>(aData);
+
+	for (size_t i = 0; i < aSize; i++)
+	{
+		aHash ^= myBytes[i];
+		aHash *= 0x100000001b3ull;
+	}
+
+	return aHash;
+}
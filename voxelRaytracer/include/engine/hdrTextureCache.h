@@ -0,0 +1,19 @@
+#pragma once
+#include "engine\texture.h"
+#include "engine\mappedFile.h"
+
+#include <vector>
+
+// hdr textures converted once into rgb9e5 texels with a full mip chain, named by a hash of the hdr file
+// the files are memory mapped and the texels are handed on as they are, so a cached texture is never decoded
+
+// hashes the contents of the hdr with the version of the files, returns 0 when the file can't be read
+uint64_t hashHdrTextureSource(const char* aFileName);
+
+// rgba float pixels to the rgb9e5 texels of every mip level after each other
+// every level is the 2x2 average of the one before, done in float so the rounding of the encoding doesn't add up
+std::vector<uint32_t> encodeHdrTexture(const float* aPixels, int aWidth, int aHeight);
+
+// points the texture at the texels in the mapped file, returns false when there is no valid file for the key
+bool loadCachedHdrTexture(uint64_t aKey, MappedFile& aFile, Texture& aTexture);
+void saveCachedHdrTexture(uint64_t aKey, const Texture& aTexture);
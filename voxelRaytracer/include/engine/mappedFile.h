@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// read only memory map of a whole file, pages are only read from disk when they are touched
+class MappedFile
+{
+public:
+	MappedFile() {};
+	~MappedFile();
+
+	MappedFile(const MappedFile& aFile) = delete;
+	MappedFile& operator=(const MappedFile& aFile) = delete;
+
+	// returns false when the file doesn't exist or is empty
+	bool open(const char* aFileName);
+	void close();
+
+	const uint8_t* getData() const;
+	size_t getSize() const;
+private:
+	const uint8_t* data{ nullptr };
+	size_t size{ 0 };
+
+#ifdef _WIN32
+	void* fileHandle{ nullptr };
+	void* mappingHandle{ nullptr };
+#else
+	int fileDescriptor{ -1 };
+#endif
+};
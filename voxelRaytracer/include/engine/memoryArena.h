@@ -0,0 +1,232 @@
+#pragma once
+#include <stddef.h>
+#include <string.h>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// structures whose memory is counted separately
+enum class MemoryTag
+{
+	VoxelGrid,
+	VoxelModel,
+	Octree,
+
+	Count
+};
+
+// shared allocator for the voxel structures
+// every allocation is aligned to a cache line so bricks never straddle two lines
+// large allocations can be backed by huge pages, which saves tlb misses when traversing big grids
+class MemoryArena
+{
+public:
+	static constexpr size_t alignment = 64;
+
+	// allocations of at least this size try to use huge pages when they are enabled
+	static constexpr size_t hugePageThreshold = 2 * 1024 * 1024;
+
+	static void* allocate(size_t aBytes, MemoryTag aTag);
+	static void free(void* aPointer, size_t aBytes, MemoryTag aTag);
+
+	// windows needs the lock pages in memory privilege for huge pages, allocations fall back to normal pages without it
+	static void setHugePages(bool aEnabled);
+	static bool getHugePages();
+
+	static size_t getAllocatedBytes(MemoryTag aTag);
+	static size_t getPeakBytes(MemoryTag aTag);
+	static const char* getTagName(MemoryTag aTag);
+};
+
+// std allocator on top of the arena, so containers of the voxel structures are counted and aligned
+template<typename T, MemoryTag Tag>
+struct ArenaAllocator
+{
+	using value_type = T;
+
+	template<typename U>
+	struct rebind
+	{
+		using other = ArenaAllocator<U, Tag>;
+	};
+
+	ArenaAllocator() noexcept {};
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U, Tag>&) noexcept {};
+
+	T* allocate(size_t aCount)
+	{
+		return static_cast<T*>(MemoryArena::allocate(aCount * sizeof(T), Tag));
+	}
+
+	void deallocate(T* aPointer, size_t aCount) noexcept
+	{
+		MemoryArena::free(aPointer, aCount * sizeof(T), Tag);
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U, Tag>&) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U, Tag>&) const noexcept { return false; }
+};
+
+template<typename T, MemoryTag Tag>
+using ArenaVector = std::vector<T, ArenaAllocator<T, Tag>>;
+
+// pool of fixed size slabs from the arena, elements never move once their slab is full
+// only the first slab grows like a vector, so small structures don't take a whole slab
+// records whose size divides slabSize never straddle two slabs, so a chunk or brick can be used through one pointer
+template<typename T, MemoryTag Tag>
+class SlabVector
+{
+	static_assert(std::is_trivially_copyable<T>::value, "slabs are copied and freed without running constructors");
+
+public:
+	// a full slab is exactly one huge page
+	static constexpr size_t slabSize = MemoryArena::hugePageThreshold / sizeof(T);
+
+	SlabVector() {};
+	explicit SlabVector(size_t aCount, const T& aValue = T{}) { resize(aCount, aValue); }
+	~SlabVector() { clear(); }
+
+	SlabVector(const SlabVector& aOther) { *this = aOther; }
+	SlabVector(SlabVector&& aOther) noexcept { swap(aOther); }
+
+	SlabVector& operator=(const SlabVector& aOther)
+	{
+		if (this == &aOther) return *this;
+
+		clear();
+		reserveFirstSlab(aOther.count < slabSize ? aOther.count : slabSize);
+		for (size_t mySlab = 0; mySlab < aOther.getSlabCount(); mySlab++)
+		{
+			if (mySlab > 0) slabs.push_back(allocateSlab(slabSize));
+			memcpy(slabs[mySlab], aOther.slabs[mySlab], aOther.getSlabElementCount(mySlab) * sizeof(T));
+		}
+		count = aOther.count;
+		return *this;
+	}
+
+	SlabVector& operator=(SlabVector&& aOther) noexcept
+	{
+		clear();
+		swap(aOther);
+		return *this;
+	}
+
+	T& operator[](size_t aIndex) { return slabs[aIndex / slabSize][aIndex % slabSize]; }
+	const T& operator[](size_t aIndex) const { return slabs[aIndex / slabSize][aIndex % slabSize]; }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	void resize(size_t aCount, const T& aValue = T{})
+	{
+		if (aCount < count)
+		{
+			// give back the slabs that are no longer used, the first slab is kept
+			const size_t mySlabCount = aCount == 0 ? 1 : (aCount + slabSize - 1) / slabSize;
+			while (slabs.size() > mySlabCount)
+			{
+				MemoryArena::free(slabs.back(), slabSize * sizeof(T), Tag);
+				slabs.pop_back();
+			}
+			count = aCount;
+			return;
+		}
+
+		reserveFirstSlab(aCount < slabSize ? aCount : slabSize);
+		while (slabs.size() * slabSize < aCount)
+		{
+			slabs.push_back(allocateSlab(slabSize));
+		}
+
+		// fill the new elements slab by slab
+		while (count < aCount)
+		{
+			const size_t myOffset = count % slabSize;
+			const size_t myFillCount = (aCount - count < slabSize - myOffset) ? aCount - count : slabSize - myOffset;
+			std::uninitialized_fill_n(slabs[count / slabSize] + myOffset, myFillCount, aValue);
+			count += myFillCount;
+		}
+	}
+
+	void assign(size_t aCount, const T& aValue)
+	{
+		clear();
+		resize(aCount, aValue);
+	}
+
+	void push_back(const T& aValue) { resize(count + 1, aValue); }
+
+	// frees every slab
+	void clear()
+	{
+		for (size_t mySlab = 0; mySlab < slabs.size(); mySlab++)
+		{
+			MemoryArena::free(slabs[mySlab], (mySlab == 0 ? firstSlabCapacity : slabSize) * sizeof(T), Tag);
+		}
+		slabs.clear();
+		count = 0;
+		firstSlabCapacity = 0;
+	}
+
+	void swap(SlabVector& aOther) noexcept
+	{
+		slabs.swap(aOther.slabs);
+		std::swap(count, aOther.count);
+		std::swap(firstSlabCapacity, aOther.firstSlabCapacity);
+	}
+
+	// slabs hold their elements back to back, every slab but the last one is full
+	size_t getSlabCount() const { return (count + slabSize - 1) / slabSize; }
+	const T* getSlab(size_t aSlab) const { return slabs[aSlab]; }
+	size_t getSlabElementCount(size_t aSlab) const { return (aSlab + 1) * slabSize <= count ? slabSize : count - aSlab * slabSize; }
+
+	// copies the elements in order to aDestination one slab at a time, used to upload them to one gpu buffer
+	void copyTo(void* aDestination) const
+	{
+		char* myDestination = static_cast<char*>(aDestination);
+		for (size_t mySlab = 0; mySlab < getSlabCount(); mySlab++)
+		{
+			const size_t myBytes = getSlabElementCount(mySlab) * sizeof(T);
+			memcpy(myDestination, slabs[mySlab], myBytes);
+			myDestination += myBytes;
+		}
+	}
+
+private:
+	static T* allocateSlab(size_t aCount)
+	{
+		return static_cast<T*>(MemoryArena::allocate(aCount * sizeof(T), Tag));
+	}
+
+	// the first slab doubles until it is full, the elements it already holds are copied over
+	void reserveFirstSlab(size_t aCount)
+	{
+		if (aCount <= firstSlabCapacity) return;
+
+		size_t myCapacity = firstSlabCapacity == 0 ? 64 : firstSlabCapacity * 2;
+		while (myCapacity < aCount) myCapacity *= 2;
+		if (myCapacity > slabSize) myCapacity = slabSize;
+
+		T* mySlab = allocateSlab(myCapacity);
+		if (!slabs.empty())
+		{
+			memcpy(mySlab, slabs[0], (count < firstSlabCapacity ? count : firstSlabCapacity) * sizeof(T));
+			MemoryArena::free(slabs[0], firstSlabCapacity * sizeof(T), Tag);
+			slabs[0] = mySlab;
+		}
+		else
+		{
+			slabs.push_back(mySlab);
+		}
+		firstSlabCapacity = myCapacity;
+	}
+
+	std::vector<T*> slabs;
+	size_t count = 0;
+	size_t firstSlabCapacity = 0;
+};
@@ -1,12 +1,37 @@
 #pragma once
 #include <stdint.h>
+#include <vector>
 #include "aabb.h"
+#include "texture.h"
 
+struct MeshMaterial
+{
+	// Kd of the mtl
+	glm::vec3 diffuse{ 1.f };
+	// map_Kd of the mtl, 4 bytes per pixel, null when the material has none
+	const Texture* diffuseTexture{ nullptr };
+};
+
+// only points at the vertex data, the arrays and textures belong to whoever made the mesh
+// triangles share their vertices through the indices, so the data of the obj can be used as it is
 struct MeshModel
 {
-	float* positions{ nullptr };
+	// three per vertex
+	const float* positions{ nullptr };
 	uint32_t vertexCount{ 0 };
 
+	// three per triangle
+	const uint32_t* indices{ nullptr };
+	uint32_t triangleCount{ 0 };
+
+	// two per uv, null when the obj has no uvs
+	const float* texcoords{ nullptr };
+	// three per triangle, -1 for corners without a uv, null when texcoords is
+	const int* texcoordIndices{ nullptr };
+
+	// one per triangle, -1 for triangles without a material, null when the obj has no materials
+	const int* triangleMaterials{ nullptr };
+	std::vector<MeshMaterial> materials;
+
 	AABB aabb;
 };
-
@@ -0,0 +1,47 @@
+#pragma once
+#include "engine\voxelModel.h"
+
+struct MeshModel;
+
+// goes up when the same mesh and settings give different voxels, cached models of older versions are voxelized again
+constexpr uint32_t meshVoxelizerVersion = 2;
+
+enum class VoxelizeMode
+{
+	// every voxel a triangle touches, rays can't get through it but the inside stays empty
+	Surface,
+	// the surface and every voxel with its center inside, needs a closed mesh
+	Solid,
+	// the voxels of the solid next to empty space, thinner than the surface while still closed
+	Shell,
+};
+
+struct MeshVoxelizerSettings
+{
+	VoxelizeMode mode{ VoxelizeMode::Surface };
+
+	// the longest side of the mesh is this many voxels, the model is this size along every axis unless fitBounds is set
+	int resolution{ 128 };
+
+	// when above 0 the size of a voxel in the units of the mesh instead of the resolution, the model is sized to the bounds of the mesh
+	float voxelSize{ 0.f };
+
+	// sizes the model to the bounds of the mesh instead of a cube, so flat or long meshes don't take a mostly empty cube
+	bool fitBounds{ false };
+
+	// the value of every filled voxel, with materials the value of the first palette color
+	uint32_t value{ 1 };
+
+	// colors the voxels with the mtl diffuse colors and textures of the mesh, the colors are reduced to at most paletteSize
+	bool useMaterials{ false };
+	int paletteSize{ 64 };
+
+	// 0 uses every hardware thread
+	int threadCount{ 0 };
+};
+
+// the mesh is scaled uniformly and moved so its bounds start at voxel 0, the transform of the model undoes that
+// triangles are binned into bricks first, then every brick is voxelized on its own so the bricks run in parallel
+// the inside of solids comes from the crossings of rows along x, tiles of rows run in parallel
+// with materials aPalette gets the linear colors of the palette, a voxel with value v has color (*aPalette)[v - value]
+VoxelModel voxelizeTriangles(const MeshModel& aMesh, const MeshVoxelizerSettings& aSettings, std::vector<glm::vec3>* aPalette = nullptr);
@@ -0,0 +1,78 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+// a handle keeps its resource alive, the cache never evicts a resource somebody still holds a handle to
+template<typename T>
+using ResourceHandle = std::shared_ptr<T>;
+
+// loaded resources of any type by key, the least recently used ones are dropped when they go over the memory budget
+// only resources without handles outside the cache can be dropped, so the budget can be exceeded while everything is in use
+class ResourceCache
+{
+public:
+	static constexpr size_t defaultBudget = 1024ull * 1024 * 1024;
+
+	ResourceCache(size_t aBudget = defaultBudget) : budget(aBudget) {};
+
+	ResourceCache(const ResourceCache& aCache) = delete;
+	ResourceCache& operator=(const ResourceCache& aCache) = delete;
+
+	// null when the key isn't cached, a hit makes the resource the most recently used one
+	template<typename T>
+	ResourceHandle<T> find(const std::string& aKey)
+	{
+		return std::static_pointer_cast<T>(findResource(aKey));
+	}
+
+	// aBytes is what the resource holds in memory, when the key is already cached the cached resource is kept and returned
+	template<typename T>
+	ResourceHandle<T> insert(const std::string& aKey, const ResourceHandle<T>& aResource, size_t aBytes)
+	{
+		return std::static_pointer_cast<T>(insertResource(aKey, std::const_pointer_cast<typename std::remove_const<T>::type>(aResource), aBytes));
+	}
+
+	// takes the resource out of the cache, null when it isn't cached or a handle to it is still held somewhere else
+	template<typename T>
+	ResourceHandle<T> takeUnused(const std::string& aKey)
+	{
+		return std::static_pointer_cast<T>(takeUnusedResource(aKey));
+	}
+
+	// drops resources until the budget fits, the ones with handles are kept
+	void setBudget(size_t aBytes);
+	size_t getBudget() const;
+
+	size_t getUsedBytes() const;
+	int getResourceCount() const;
+
+	// drops every resource nobody holds a handle to
+	void clearUnused();
+private:
+	struct Entry
+	{
+		std::string key;
+		std::shared_ptr<void> resource;
+		size_t bytes;
+	};
+
+	std::shared_ptr<void> findResource(const std::string& aKey);
+	std::shared_ptr<void> insertResource(const std::string& aKey, std::shared_ptr<void> aResource, size_t aBytes);
+	std::shared_ptr<void> takeUnusedResource(const std::string& aKey);
+
+	// drops the least recently used resources without handles until aBytes fit, the mutex has to be held
+	void evict(size_t aBytes);
+
+	// the front is the most recently used
+	std::list<Entry> entries;
+	std::unordered_map<std::string, std::list<Entry>::iterator> entryLookup;
+
+	size_t usedBytes{ 0 };
+	size_t budget;
+
+	mutable std::mutex mutex;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include "engine\voxelModel.h"
+
+// generated test scenes to measure how the voxel structures scale with size and sparsity
+// like the main scene y points down, so the ground is at the highest y
+// materials follow the voxel atlas of the renderer: 1 white, 2 gray, 3 and 4 lights
+enum class GeneratedScene
+{
+	MengerSponge,
+	RandomFill,
+	NoiseTerrain,
+	CornellBox,
+	City,
+	HollowShells,
+	Count,
+};
+
+struct SceneGeneratorSettings
+{
+	int size{ 128 };
+
+	// what the density means depends on the scene:
+	// random fill: chance of a voxel being filled
+	// noise terrain: part of the height that is ground
+	// cornell box: part of the ceiling that is a light
+	// city: chance of a lot having a building
+	// hollow shells: number of shells, 1 gives 16 of them
+	// the menger sponge doesn't use it
+	float density{ 0.1f };
+
+	uint32_t seed{ 1 };
+};
+
+// the model is size x size x size, the same settings always give the same voxels
+VoxelModel generateScene(GeneratedScene aScene, const SceneGeneratorSettings& aSettings);
+
+const char* getGeneratedSceneName(GeneratedScene aScene);
@@ -0,0 +1,20 @@
+#pragma once
+#include "engine\texture.h"
+
+#include <glm/vec3.hpp>
+
+// the 9 real spherical harmonics up to l = 2 per color channel, in the order l = 0, then l = 1 for y z x, then l = 2 for xy yz zz xz xx-yy
+// the coefficients are already convolved with the cosine lobe and divided by pi, so evaluating them gives
+// the light a white diffuse surface facing that direction reflects without anything in the way
+struct SHIrradiance
+{
+	glm::vec3 coefficients[9];
+};
+
+// same basis and order as evaluateSkyIrradiance in the shaders, aNormal has to be normalized
+glm::vec3 evaluateIrradiance(const SHIrradiance& aIrradiance, const glm::vec3& aNormal);
+
+// projects an rgb9e5 equirect skydome with the mapping of sampleSkydome in the shaders, aDirection.y down is the top row
+// uses the first mip level that is at most aMaxWidth wide, the low frequencies the sh keep don't need more texels
+// the texels are mapped like the shaders map the sky, srgb to linear of the color clamped to 1 and then doubled, so both ways of lighting match
+SHIrradiance projectSkydomeIrradiance(const Texture& aSkydome, int aMaxWidth = 256);
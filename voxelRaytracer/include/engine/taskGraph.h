@@ -0,0 +1,75 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using TaskId = int;
+
+// runs tasks on worker threads as soon as the tasks they depend on are done
+// the completion callback of a task runs on the thread calling runCompletions, so it can touch things that aren't thread safe like the gpu
+class TaskGraph
+{
+public:
+	TaskGraph() {};
+	~TaskGraph();
+
+	TaskGraph(const TaskGraph& aGraph) = delete;
+	TaskGraph& operator=(const TaskGraph& aGraph) = delete;
+
+	// a thread count of 0 or less uses a thread per core
+	void start(int aThreadCount = 0);
+	// finishes the tasks that are running and drops the rest, their callbacks never run
+	void stop();
+
+	// a task waits for the work of its dependencies, not for their callbacks
+	// tasks can be added from any thread, also from the work or callback of another task
+	TaskId addTask(const char* aName, std::function<void()> aWork, const std::vector<TaskId>& aDependencies = {}, std::function<void()> aOnComplete = nullptr);
+
+	// runs the callbacks of the tasks that finished since the last call, in the order they finished
+	void runCompletions();
+
+	// true once the work of the task is done, its callback may not have run yet
+	bool isFinished(TaskId aTask) const;
+	// true when every added task is finished and its callback ran
+	bool isIdle() const;
+
+	// the name of a task that is running or waiting, nullptr when there is none
+	const char* getPendingTaskName() const;
+	int getPendingTaskCount() const;
+
+	// blocks until every task is finished and runs their callbacks, only the thread calling runCompletions can wait
+	void waitIdle();
+private:
+	struct Task
+	{
+		const char* name;
+		std::function<void()> work;
+		std::function<void()> onComplete;
+
+		int waitingDependencyCount{ 0 };
+		std::vector<TaskId> dependents;
+
+		bool isFinished{ false };
+	};
+
+	void workerLoop();
+
+	// tasks are never removed, so their ids stay valid
+	std::vector<std::unique_ptr<Task>> tasks;
+	std::deque<TaskId> readyTasks;
+	std::vector<TaskId> completedTasks;
+
+	// added tasks whose callback hasn't run yet
+	int pendingTaskCount{ 0 };
+
+	std::vector<std::thread> workers;
+	bool shouldStop{ false };
+
+	mutable std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable taskCompleted;
+};
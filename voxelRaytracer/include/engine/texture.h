@@ -1,11 +1,32 @@
 #pragma once
+#include <stdint.h>
+#include <glm/vec3.hpp>
+
+enum class TextureFormat
+{
+	// 4 bytes per pixel
+	RGBA8,
+	// 4 bytes per pixel, 9 bit mantissas for rgb with a shared 5 bit exponent like DXGI_FORMAT_R9G9B9E5_SHAREDEXP
+	RGB9E5,
+};
 
 class Texture
 {
 public:
-	void* textureData{ 0 };
+	const void* textureData{ 0 };
 
 	int textureWidth{ 0 };
 	int textureHeight{ 0 };
 	int bytesPerPixel{ 0 };
-};
\ No newline at end of file
+
+	TextureFormat format{ TextureFormat::RGBA8 };
+	// the smaller levels follow the first one in textureData, each is half the size of the one before rounded down but at least 1
+	int mipCount{ 1 };
+};
+
+// levels down to 1x1
+int getFullMipCount(int aWidth, int aHeight);
+
+// negative values and nans become 0, values above the largest rgb9e5 value are clamped to it
+uint32_t encodeRGB9E5(const glm::vec3& aColor);
+glm::vec3 decodeRGB9E5(uint32_t aValue);
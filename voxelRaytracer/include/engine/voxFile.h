@@ -0,0 +1,10 @@
+#pragma once
+#include "engine\voxelModel.h"
+#include "rendering\voxelAtlas.h"
+
+// magicavoxel .vox files, the voxels are copied over as they are so nothing is voxelized
+// the models of a file are placed like its scene graph places them, and the returned model is sized to fit all of them
+// the palette colors the voxels use are added to the end of the atlas and the voxels point at them
+// magicavoxel is z up, so its z becomes -y here like the y of obj files
+// returns a model of size 0 when the file can't be read
+VoxelModel loadVoxFile(const char* aFileName, VoxelAtlas* aAtlas);
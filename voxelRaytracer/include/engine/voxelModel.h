@@ -1,28 +1,123 @@
 #pragma once
+#include "engine\memoryArena.h"
+#include "rendering\spatialHashMap.h"
+
 #include <stdint.h>
+#include <vector>
+#include <functional>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+struct Voxel
+{
+	int x{ 0 };
+	int y{ 0 };
+	int z{ 0 };
+
+	uint32_t value{ 0 };
+};
 
+// voxels are stored in 8x8x8 bricks, only bricks with a voxel in them use memory
 struct VoxelModel
 {
+	// fills the zeroed voxels of the brick at the given brick position, returns false when it left the brick empty
+	using BrickGenerator = std::function<bool(const glm::ivec3& aBrickPosition, uint32_t* aVoxels)>;
+
+	static constexpr int brickSize = 8;
+	static constexpr int brickVoxelCount = brickSize * brickSize * brickSize;
+	static constexpr int brickMaskWordCount = brickVoxelCount / 64;
+
+	// goes over the filled voxels brick by brick, empty space is skipped with the occupancy masks
+	class Iterator
+	{
+	public:
+		Iterator(const VoxelModel* aModel, int aBrickIndex);
+
+		const Voxel& operator*() const { return voxel; }
+		const Voxel* operator->() const { return &voxel; }
+
+		Iterator& operator++();
+
+		bool operator==(const Iterator& aOther) const { return brickIndex == aOther.brickIndex && bitIndex == aOther.bitIndex; }
+		bool operator!=(const Iterator& aOther) const { return !(*this == aOther); }
+	private:
+		// moves to the first filled voxel at or after the current bit
+		void findNextVoxel();
+
+		const VoxelModel* model{ nullptr };
+		int brickIndex{ 0 };
+		int bitIndex{ 0 };
+
+		Voxel voxel;
+	};
+
 	VoxelModel() {};
 	VoxelModel(int aSizeX, int aSizeY, int aSizeZ);
 
-	~VoxelModel();
+	// models can be large, so they are only moved, the moved from model is left empty
+	// can't be move assigned because the size is const
+	VoxelModel(const VoxelModel& aModel) = delete;
+	VoxelModel& operator=(const VoxelModel& aModel) = delete;
+	VoxelModel(VoxelModel&& aModel) noexcept = default;
 
-	void combineModel(int aX, int aY, int aZ, VoxelModel* aModel);
+	void combineModel(int aX, int aY, int aZ, const VoxelModel* aModel);
+	// takes over the bricks of the model instead of copying them when this model is empty and the offset is a multiple of brickSize
+	void combineModel(int aX, int aY, int aZ, VoxelModel&& aModel);
 
 	uint32_t getVoxel(int aX, int aY, int aZ) const;
 	void setVoxel(int aX, int aY, int aZ, uint32_t aValue);
+	// sets the nonzero voxels of a whole brick at once, the zeros leave the voxels that are already there
+	void combineBrick(const glm::ivec3& aBrickPosition, const uint32_t* aVoxels);
+	// replaces every filled voxel v by aTable[v], the table can't map a filled voxel to 0
+	void remapVoxels(const std::vector<uint32_t>& aTable);
+	// runs the generator for the bricks between aMinBrick and aMaxBrick (inclusive) on several threads and combines the results into the model
+	// voxels outside of the model are dropped, the bricks are added in the same order for every thread count
+	void generateBricks(const glm::ivec3& aMinBrick, const glm::ivec3& aMaxBrick, const BrickGenerator& aGenerator, int aThreadCount = 0);
+	// same as above for a list of bricks, the bricks have to be inside the model
+	void generateBricks(const std::vector<glm::ivec3>& aBrickPositions, const BrickGenerator& aGenerator, int aThreadCount = 0);
+
+	Iterator begin() const;
+	Iterator end() const;
+
+	size_t getVoxelCount() const;
+	size_t getMemoryUsage() const;
+
+	// direct access for builders, bricks are in the order they were created
+	// voxels of a brick are ordered x + y * brickSize + z * brickSize * brickSize
+	int getBrickCount() const;
+	int findBrick(const glm::ivec3& aBrickPosition) const;
+	glm::ivec3 getBrickPosition(int aBrickIndex) const;
+	const uint32_t* getBrickVoxels(int aBrickIndex) const;
+	const uint64_t* getBrickOccupancy(int aBrickIndex) const;
 
 	const int sizeX{ 0 };
 	const int sizeY{ 0 };
 	const int sizeZ{ 0 };
 
-	uint32_t* data{ nullptr };
-	const int dataSize{ 0 };
+	// voxel space to the space the voxels came from, like the units of the mesh a model was voxelized from
+	// identity for models made in voxel space, combining models doesn't change it
+	glm::mat4 transform{ 1.f };
+private:
+	int findOrCreateBrick(const glm::ivec3& aBrickPosition);
+
+	// splits the work in aWorkCount pieces that threads take one at a time, aGetBricks(piece, visit) calls visit for every brick position of a piece
+	template<typename GetBricks>
+	void generateBricks(int aWorkCount, GetBricks aGetBricks, const BrickGenerator& aGenerator, int aThreadCount);
+
+	// brickVoxelCount values and brickMaskWordCount mask words per brick, a brick never straddles two slabs
+	SlabVector<uint32_t, MemoryTag::VoxelModel> brickVoxels;
+	SlabVector<uint64_t, MemoryTag::VoxelModel> brickOccupancy;
+	static_assert(decltype(brickVoxels)::slabSize % brickVoxelCount == 0 && decltype(brickOccupancy)::slabSize % brickMaskWordCount == 0, "a brick would straddle two slabs");
+	std::vector<glm::ivec3> brickPositions;
+
+	// brick position to brick index
+	SpatialHashMap brickTable;
 };
 
 void initRandomVoxels(VoxelModel* aModel, int aVoxelIndex, int aFillAmount = 10);
+// fills every voxel with a chance of aDensity, the same seed always gives the same voxels
+void initRandomVoxels(VoxelModel* aModel, int aVoxelIndex, float aDensity, uint32_t aSeed);
 
 void initFilled(VoxelModel* aModel, int aVoxelIndex);
 
-void placeFilledSphere(VoxelModel* aModel, int aX, int aY, int aZ, float aRadius, uint32_t aValue);
\ No newline at end of file
+void placeFilledSphere(VoxelModel* aModel, int aX, int aY, int aZ, float aRadius, uint32_t aValue);
@@ -0,0 +1,15 @@
+#pragma once
+#include "engine\voxelModel.h"
+#include "engine\meshVoxelizer.h"
+
+// voxelized models on disk, named by a hash of everything that changes their voxels
+// files hold the brick positions and occupancy masks followed by the run length coded values of the filled voxels
+// they are read through a memory map and decoded straight into the bricks of the model
+
+// hashes the contents of the obj with the voxelizer settings and version, returns 0 when the file can't be read
+// only the obj is hashed, so the settings can't use materials
+uint64_t hashVoxelModelSource(const char* aFileName, const MeshVoxelizerSettings& aSettings);
+
+// the size and transform of the model come from the file, returns a model of size 0 when there is no valid file for the key
+VoxelModel loadCachedVoxelModel(uint64_t aKey);
+void saveCachedVoxelModel(uint64_t aKey, const VoxelModel& aModel);
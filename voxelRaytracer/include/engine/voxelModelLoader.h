@@ -1,14 +1,41 @@
 #pragma once
 #include "engine\voxelModel.h"
 #include "engine\texture.h"
+#include "engine\resourceCache.h"
+#include "rendering\voxelAtlas.h"
 
+// the functions can be called from several threads, loads of the same kind wait for each other
+// loaded resources are kept by their normalized path and settings, once they take more than the memory budget
+// the least recently used ones nobody holds a handle to are freed
 class VoxelModelLoader
 {
 public:
-	static VoxelModel* getModel(const char* aFileName, int aResolution, int aFillVoxelIndex = -1);
+	static ResourceHandle<const VoxelModel> getModel(const char* aFileName, int aResolution, int aFillVoxelIndex = -1);
+	// moves the model out of the loader, so only the caller holds its voxels, a later getModel loads it again
+	static VoxelModel takeModel(const char* aFileName, int aResolution, int aFillVoxelIndex = -1);
 
-	static Texture* getTexture(const char* aFileName);
+	// voxels of aVoxelSize in the units of the obj, the model is only as large as the bounds of the mesh so flat or long meshes don't fill a cube
+	// the transform of the model places the voxels where the mesh is, so models of different voxel sizes line up
+	static ResourceHandle<const VoxelModel> getFittedModel(const char* aFileName, float aVoxelSize, int aFillVoxelIndex = -1);
+	static VoxelModel takeFittedModel(const char* aFileName, float aVoxelSize, int aFillVoxelIndex = -1);
 
-	static Texture* getHdrTexture(const char* aFileName);
-};
+	// voxelizes with the colors of the mtl materials and textures, the palette is added to the end of the atlas and the voxels point at it
+	// like takeModel the model isn't kept in the loader, nothing else may use the atlas while it runs
+	static VoxelModel takeColoredModel(const char* aFileName, int aResolution, VoxelAtlas* aAtlas, int aPaletteSize = 64);
+
+	// copies the voxels of a magicavoxel .vox file without voxelizing, the used palette colors are added to the end of the atlas
+	// the file isn't kept in the loader, nothing else may use the atlas while it runs
+	static VoxelModel takeVoxModel(const char* aFileName, VoxelAtlas* aAtlas);
+
+	// 4 bytes per pixel, an empty handle when the file can't be loaded
+	static ResourceHandle<const Texture> getTexture(const char* aFileName);
 
+	// rgb9e5 texels with a full mip chain, the hdr is converted on the first load and read from the disk cache after that
+	// an empty handle when the file can't be loaded, failed loads are tried again on the next call
+	static ResourceHandle<const Texture> getHdrTexture(const char* aFileName);
+
+	// resources are only freed when a new one is loaded or the budget changes, not when their last handle goes away
+	static void setMemoryBudget(size_t aBytes);
+	static size_t getMemoryBudget();
+	static size_t getMemoryUsage();
+};
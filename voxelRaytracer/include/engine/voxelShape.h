@@ -0,0 +1,88 @@
+#pragma once
+#include "engine\aabb.h"
+
+#include <stdint.h>
+#include <vector>
+
+struct VoxelModel;
+
+enum class ShapeType
+{
+	Box,
+	Sphere,
+	Capsule,
+	Cylinder,
+	Torus,
+	Union,
+	Subtraction,
+	Intersection,
+	NoiseDisplacement,
+};
+
+struct ShapeNode
+{
+	ShapeType type{ ShapeType::Sphere };
+
+	// primitives, cylinders and tori are aligned to the y axis
+	glm::vec3 positionA{ 0.f };
+	glm::vec3 positionB{ 0.f };
+	float radius{ 0.f };
+	float radius2{ 0.f };
+	uint32_t material{ 0 };
+
+	// operators
+	int childA{ -1 };
+	int childB{ -1 };
+	float amplitude{ 0.f };
+	float frequency{ 0.f };
+	uint32_t seed{ 0 };
+
+	// filled in when the node is added
+	AABB bounds;
+	// how fast the distance can change per unit, used to cull whole bricks
+	float lipschitz{ 1.f };
+	// material of every primitive below this node, 0 when they differ
+	uint32_t uniformMaterial{ 0 };
+	// if the distance is never below the distance to the bounds, unions can skip the node when its bounds are further away
+	// intersections don't have this because their bounds are smaller than the bounds of either shape
+	bool isBoundedDistance{ true };
+};
+
+// signed distance shapes combined with csg operators, the material of a primitive is the voxel value it writes
+// nodes are added bottom up, the last added node is the root unless setRoot is called
+class VoxelShape
+{
+public:
+	int addBox(const glm::vec3& aCenter, const glm::vec3& aHalfSize, uint32_t aMaterial);
+	int addSphere(const glm::vec3& aCenter, float aRadius, uint32_t aMaterial);
+	int addCapsule(const glm::vec3& aStart, const glm::vec3& aEnd, float aRadius, uint32_t aMaterial);
+	int addCylinder(const glm::vec3& aCenter, float aRadius, float aHalfHeight, uint32_t aMaterial);
+	int addTorus(const glm::vec3& aCenter, float aMajorRadius, float aMinorRadius, uint32_t aMaterial);
+
+	int addUnion(int aShapeA, int aShapeB);
+	// cuts b out of a, the cut surface keeps the material of a
+	int addSubtraction(int aShapeA, int aShapeB);
+	int addIntersection(int aShapeA, int aShapeB);
+	// moves the surface in or out by value noise between -aAmplitude and aAmplitude
+	int addNoiseDisplacement(int aShape, float aAmplitude, float aFrequency, uint32_t aSeed = 0);
+
+	void setRoot(int aShape);
+	void clear();
+
+	// distance to the surface, negative inside, aMaterial gets the material of the surface that is closest
+	float evaluate(const glm::vec3& aPosition, uint32_t* aMaterial = nullptr) const;
+
+	// writes the material into every voxel with its center inside the shape, the other voxels are left as they are
+	// bricks are evaluated in parallel, bricks that are fully outside or inside are found from the distance at their center
+	void voxelize(VoxelModel* aModel, int aThreadCount = 0) const;
+
+	AABB getBounds() const;
+	int getNodeCount() const;
+private:
+	int addNode(const ShapeNode& aNode);
+
+	float evaluateNode(int aNode, const glm::vec3& aPosition, uint32_t& aMaterial) const;
+
+	std::vector<ShapeNode> nodes;
+	int root{ -1 };
+};
@@ -4,6 +4,7 @@
 #include "rendering\voxelGrid.h"
 #include "rendering\voxelAtlas.h"
 #include "engine\texture.h"
+#include "engine\sphericalHarmonics.h"
 #include "gpuProfiler.h"
 
 #include <glm/vec4.hpp>
@@ -22,6 +23,15 @@ struct ImGuiIO;
 #define SHADER_THREAD_COUNT_X 8
 #define SHADER_THREAD_COUNT_Y 4
 
+// how rays that leave the scene after a diffuse bounce get their light, primary and specular rays always see the skydome texture
+enum class SkyLighting
+{
+	// fetches the skydome texture for every ray that escapes
+	Texture,
+	// evaluates the sh irradiance of the skydome for escaping diffuse bounce rays and lights a diffuse last bounce with it instead of tracing it, specular rays keep the texture
+	Irradiance
+};
+
 struct ConstantBuffer
 {
 	glm::vec4 maxThreadIter;
@@ -40,7 +50,14 @@ struct ConstantBuffer
 
 	int octreeSize; // not used
 
-	float padding[36];
+	// a SkyLighting
+	int skyLighting;
+	float padding0[3];
+
+	// SHIrradiance::coefficients, a vec4 each for the hlsl packing
+	glm::vec4 skyIrradiance[9];
+
+	float padding[60];
 };
 
 constexpr size_t modulatedSize1 = sizeof(ConstantBuffer) % 256;
@@ -74,7 +91,9 @@ struct VoxelGridBuffer
 
 	glm::uvec4 topLevelChunkSize;
 
-	float padding[56];
+	glm::ivec4 voxelGridOrigin;
+
+	float padding[52];
 };
 
 constexpr size_t modulatedSize4 = sizeof(VoxelGridBuffer) % 256;
@@ -97,16 +116,23 @@ public:
 	void renderImGui();
 
 	void copyAccumulationBufferToBackbuffer();
+	// fills the back buffer with black, for frames that don't render the scene
+	void clearBackbuffer();
 
 	void updateCameraVariables(Camera& aCamera, bool aFocussed, int aSize);
 	void updateAccumulationVariables(bool aShouldNotAccumulate);
 	
 	void updateNoiseTexture(const Texture& aTexture);
 	void updateSkydomeTexture(const Texture& aTexture);
+	void updateSkyIrradiance(const SHIrradiance& aIrradiance);
+	void setSkyLighting(SkyLighting aSkyLighting);
 	
 	void updateOctreeVariables(const Octree& aOctree);
 	void updateVoxelGridVariables(const VoxelGrid& aGrid);
 
+	// only uploads what changed since the grid's last clearChanges()
+	void updateVoxelGridChanges(const VoxelGrid& aGrid);
+
 	void updateVoxelAtlasVariables(const VoxelAtlas& aAtlas);
 
 	GPUProfiler* getProfiler() const;
@@ -114,6 +140,16 @@ public:
 private:
 	void updateConstantBuffer();
 
+	void updateVoxelGridPalettes(const VoxelGrid& aGrid);
+	void updateVoxelGridBounds(const VoxelGrid& aGrid);
+	void updateVoxelGridTopLevelTable(const VoxelGrid& aGrid);
+	void updateVoxelGridChunks(const VoxelGrid& aGrid, int aLevel, ID3D12Resource* aChunkBuffer, ID3D12Resource* aOccupancyBuffer);
+
+	// recreates the voxel grid buffers the grid doesn't fit in anymore, returns true when any buffer was recreated
+	bool reserveVoxelGridBuffers(const VoxelGrid& aGrid);
+	// creates an upload buffer of aElementCount structured elements and its shader resource view in heap slot aHeapSlot
+	void createVoxelGridBuffer(Microsoft::WRL::ComPtr<ID3D12Resource>& aBuffer, UINT aElementCount, UINT aStride, int aHeapSlot, const wchar_t* aName);
+
 	bool loadPipeline();
 	void loadAssets(const unsigned int aSizeX, const unsigned int aSizeY);
 
@@ -175,6 +211,16 @@ private:
 	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelGridTopLevelBuffer;
 	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelGridLayer1Buffer;
 	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelGridLayer2Buffer;
+	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelGridLayer1OccupancyBuffer;
+	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelGridLayer2OccupancyBuffer;
+	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelGridPaletteOffsetBuffer;
+	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelGridPaletteBuffer;
+
+	// elements the voxel grid buffers hold, the occupancy and palette offset buffers have as many as their level
+	UINT voxelGridTopLevelCapacity{ 0 };
+	UINT voxelGridLayer1Capacity{ 0 };
+	UINT voxelGridLayer2Capacity{ 0 };
+	UINT voxelGridPaletteCapacity{ 0 };
 
 	Microsoft::WRL::ComPtr<ID3D12Resource>      voxelAtlasBuffer;
 
@@ -2,7 +2,9 @@
 #include "graphics.h"
 #include "engine\benchmarkManager.h"
 #include "engine\profiler.h"
+#include "engine\taskGraph.h"
 #include "rendering\gpuProfiler.h"
+#include "rendering\voxelGridBenchmark.h"
 
 #define FRAME_TIME_ARRAY_SIZE 1000
 #define PLOT_WRITES_PER_SECOND 5
@@ -19,6 +21,14 @@ public:
 
 	void setController(Controller* aController);
 	void setGpuProfiler(GPUProfiler* aGpuProfiler);
+	void setBenchmarkScene(VoxelModel* aScene);
+	// waits for a benchmark that is running, call it before the benchmark scene is deleted
+	void stopBenchmarks();
+	// shows a loading window with the name of the asset that is loading, nullptr hides it
+	void setLoadingStatus(const char* aTaskName, int aPendingTaskCount);
+
+	// picked in the settings window, the renderer passes it on to the graphics
+	SkyLighting getSkyLighting() const;
 
 private:
 	void update(const Graphics& aGraphics, float aDeltaTime);
@@ -51,6 +61,29 @@ private:
 
 	bool profilerOpen{ false };
 
+	bool useSkyIrradiance{ false };
+
+	//startup loading
+	const char* loadingTaskName{ nullptr };
+	int loadingTaskCount{ 0 };
+
+	//cpu voxel grid layout benchmark
+	VoxelModel* benchmarkScene{ nullptr };
+	bool layoutBenchmarkOpen{ false };
+	std::vector<VoxelGridBenchmarkResult> layoutBenchmarkResults;
+
+	// the benchmarks run on their own worker so the frame keeps going, the results are moved over in the completion callback
+	TaskGraph benchmarkTasks;
+	std::vector<VoxelGridBenchmarkResult> pendingBenchmarkResults;
+	// the largest size the last scaling run skipped because it wouldn't fit in memory, 0 when it ran every size
+	int scalingSkippedSize{ 0 };
+
+	// generated scenes for the scaling benchmark
+	int generatedScene{ 0 };
+	SceneGeneratorSettings generatedSceneSettings;
+	int scalingMinSize{ 64 };
+	int scalingMaxSize{ 512 };
+
 	Profiler* profiler;
 	GPUProfiler* gpuProfiler;
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "engine\voxelModel.h"
+#include "engine\memoryArena.h"
 
 #include <glm\vec3.hpp>
 #include <vector>
@@ -10,6 +11,7 @@ struct OctreeItem
 {
 	float padding[3];
 
+	// lowest 3 bits are left for the parent octant, the item index is stored above them
 	int data;
 };
 
@@ -37,15 +39,20 @@ public:
 	Octree() {};
 	~Octree() {};
 
-	void init(VoxelModel* aModel);
+	// largest voxel value an octree item can hold
+	static constexpr uint32_t maxItemIndex = (1u << 29) - 1;
+
+	void init(const VoxelModel* aModel);
 	void init(int aSizeX, int aSizeY, int aSizeZ);
 	void insertItem(int aX, int aY, int aZ, OctreeItem aItem);
 
-	const void* getData() const;
+	// copies the nodes back to back to aDestination, the tree is stored in slabs
+	void copyData(void* aDestination) const;
 	size_t getSize() const;
 	int getLayerCount() const;
 private:
-	std::vector<std::array<OctreeElement, 8>> flatTree;
+	// nodes are appended to slabs, so growing the tree doesn't copy the nodes it already holds
+	SlabVector<std::array<OctreeElement, 8>, MemoryTag::Octree> flatTree;
 	
 	int size = 0;
 	int layerCount = 0;
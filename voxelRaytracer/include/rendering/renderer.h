@@ -3,6 +3,11 @@
 #include "rendering\voxelGrid.h"
 #include "rendering\imguiWindowManager.h"
 #include "rendering\voxelAtlas.h"
+#include "engine\taskGraph.h"
+#include "engine\resourceCache.h"
+#include "engine\texture.h"
+#include "engine\sphericalHarmonics.h"
+#include "engine\timer.h"
 
 class Graphics;
 class Window;
@@ -34,6 +39,18 @@ private:
 
 	ImguiWindowManager imguiWindow;
 
+	// loads the assets of the scene after the window is up, nothing is traced until they are all on the gpu
+	TaskGraph loadTasks;
+	Timer loadTimer;
+	bool sceneLoaded{ false };
+
+	// set by the load tasks, held until they are on the gpu
+	ResourceHandle<const Texture> noiseTexture;
+	ResourceHandle<const Texture> skydomeTexture;
+	SHIrradiance skyIrradiance{};
+
+	SkyLighting skyLighting{ SkyLighting::Texture };
+
 	float offset = 0;
 
 	bool windowFocused{ false };
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <glm/vec3.hpp>
+
+// open addressing hash map from signed 3d cell coordinates to an int, linear probing
+// coordinates are limited to 21 bits per axis
+class SpatialHashMap
+{
+public:
+	SpatialHashMap() {};
+	~SpatialHashMap() {};
+
+	SpatialHashMap(const SpatialHashMap& aMap) = default;
+	SpatialHashMap& operator=(const SpatialHashMap& aMap) = default;
+
+	// the moved from map is left empty
+	SpatialHashMap(SpatialHashMap&& aMap) noexcept;
+	SpatialHashMap& operator=(SpatialHashMap&& aMap) noexcept;
+
+	// returns nullptr when the cell isn't in the map
+	const int* find(const glm::ivec3& aPosition) const;
+	int* find(const glm::ivec3& aPosition);
+
+	// adds the cell with aDefault when it isn't in the map yet
+	int& findOrInsert(const glm::ivec3& aPosition, int aDefault);
+
+	void erase(const glm::ivec3& aPosition);
+	void clear();
+
+	// calls aFunction(position, value) for every cell in the map, the value can be changed
+	template<typename Function>
+	void forEach(Function aFunction);
+	template<typename Function>
+	void forEach(Function aFunction) const;
+
+	size_t getCount() const;
+	size_t getMemoryUsage() const;
+private:
+	static uint64_t packKey(const glm::ivec3& aPosition);
+	static glm::ivec3 unpackKey(uint64_t aKey);
+	static size_t hashKey(uint64_t aKey);
+
+	// slot holding the key, or the empty slot where it would go
+	size_t findSlot(uint64_t aKey) const;
+	void grow();
+
+	// bit 63 of a packed key is never set
+	static constexpr uint64_t emptyKey = ~uint64_t(0);
+
+	std::vector<uint64_t> keys;
+	std::vector<int> values;
+	size_t count{ 0 };
+};
+
+template<typename Function>
+void SpatialHashMap::forEach(Function aFunction)
+{
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		if (keys[i] != emptyKey)
+		{
+			aFunction(unpackKey(keys[i]), values[i]);
+		}
+	}
+}
+
+template<typename Function>
+void SpatialHashMap::forEach(Function aFunction) const
+{
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		if (keys[i] != emptyKey)
+		{
+			aFunction(unpackKey(keys[i]), values[i]);
+		}
+	}
+}
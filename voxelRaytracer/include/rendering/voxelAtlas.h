@@ -13,6 +13,9 @@ struct VoxelAtlasItem
 class VoxelAtlas
 {
 public:
+	// size of the gpu buffer, voxel grid palettes can reference any of these
+	static constexpr size_t maxItemCount = 4096;
+
 	VoxelAtlas() {};
 	~VoxelAtlas() {};
 
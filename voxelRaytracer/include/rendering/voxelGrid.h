@@ -1,71 +1,351 @@
 #pragma once
 #include "engine\voxelModel.h"
+#include "engine\memoryArena.h"
+#include "rendering\spatialHashMap.h"
 
 #include <vector>
+#include <array>
+#include <unordered_map>
+#include <float.h>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
-constexpr int layer1Size = 4;
-constexpr int layer2Size = 4;
+// brick sizes of every level below the top level grid, ordered from coarse to fine
+// every level except the last one stores indices into the next level, the last level stores the voxels
+// e.g. VoxelGridLayout<4, 4> is a top level grid of 4x4x4 chunks of 4x4x4 voxel bricks
+template<int... BrickSizes>
+struct VoxelGridLayout
+{
+	static constexpr int levelCount = sizeof...(BrickSizes);
+	static constexpr int brickSizes[levelCount]{ BrickSizes... };
+
+	// amount of voxels along one axis covered by a single cell of the given level, -1 is the top level
+	static constexpr int getCellScale(int aLevel)
+	{
+		int myScale = 1;
+		for (int i = aLevel + 1; i < levelCount; i++)
+		{
+			myScale *= brickSizes[i];
+		}
+		return myScale;
+	}
+
+	// amount of ints used to store one chunk of the given level
+	static constexpr int getChunkIntCount(int aLevel)
+	{
+		const int myCellCount = brickSizes[aLevel] * brickSizes[aLevel] * brickSizes[aLevel];
 
+		// voxels are stored as 8 bit items, 4 per int along the x axis
+		return aLevel == levelCount - 1 ? myCellCount / 4 : myCellCount;
+	}
 
+	// amount of 64 bit words used for the occupancy mask of one chunk of the given level, one bit per cell
+	static constexpr int getMaskWordCount(int aLevel)
+	{
+		return (brickSizes[aLevel] * brickSizes[aLevel] * brickSizes[aLevel] + 63) / 64;
+	}
+
+	static constexpr int topLevelScale = getCellScale(-1);
+};
 
 // grid item
-// 8 bit index to atlas (0 == not filled)
+// 8 bit index into the palette of its layer 1 chunk (0 == not filled)
+// the palette maps it to the atlas index, so a scene can use more than 255 atlas items
 
 // 4x4x4 voxel chunk 64 bytes
+// matches the layout of a brick in VoxelGridLayout<4, 4>, used for the gpu buffers
 struct Layer2Chunk
 {
-	int items[layer1Size * layer1Size];
+	int items[4 * 4];
 };
 
-// consists of 4x4x4 chunks of chunks 
+// consists of 4x4x4 chunks of chunks
 struct Layer1Chunk
 {
 	Layer1Chunk();
 
-	int itemIndices[layer1Size * layer1Size * layer1Size];
+	int itemIndices[4 * 4 * 4];
+};
+
+struct VoxelGridHit
+{
+	float distance{ FLT_MAX };
+	glm::vec3 normal{ 0.f, 0.f, 0.f };
+	int itemIndex{ 0 };
+
+	int loopCount{ 0 };
+};
+
+struct VoxelGridEdit
+{
+	int x{ 0 };
+	int y{ 0 };
+	int z{ 0 };
+
+	// 0 clears the voxel
+	int itemIndex{ 0 };
+};
+
+// parts of the grid changed since the last clearChanges(), so only those have to be uploaded again
+struct VoxelGridChanges
+{
+	// chunks were moved or the grid was rebuilt, everything has to be uploaded
+	bool isFullUpdate{ true };
+	bool hasPaletteChanges{ false };
+
+	// a chunk was added to or removed from the sparse top level, its table has to be uploaded again
+	bool hasTopLevelTableChanges{ false };
+
+	std::vector<int> topLevelCells;
+
+	// indices of the chunks per level whose data or occupancy mask changed
+	std::vector<std::vector<int>> chunks;
 };
 
-class VoxelGrid
+template<typename GridLayout>
+class BasicVoxelGrid
 {
 public:
-	VoxelGrid() {};
-	~VoxelGrid() {};
+	using Layout = GridLayout;
+
+	static constexpr int levelCount = Layout::levelCount;
+	static constexpr int topLevelScale = Layout::topLevelScale;
+
+	static_assert(levelCount >= 2, "voxel grid needs at least one chunk level and one brick level");
+	static_assert(Layout::brickSizes[levelCount - 1] % 4 == 0, "brick size must be a multiple of 4, 4 items are packed per int");
+
+	BasicVoxelGrid() {};
+	~BasicVoxelGrid() {};
 
 	void init(const unsigned int aSizeX, const unsigned int aSizeY, const unsigned int aSizeZ);
-	void init(VoxelModel* aModel);
+	// builds the grid from the model on aThreadCount threads, 0 uses all hardware threads
+	// chunks are stored in top level chunk order, so the layout is the same for every thread count
+	void init(const VoxelModel* aModel, int aThreadCount = 0);
 
 	void clear();
 
-	void insertItem(const unsigned int aX, const unsigned int aY, const unsigned int aZ, int aItemIndex);
+	// sets the voxel, item 0 clears it, chunks and bricks that become empty go back to the free lists
+	// returns false and leaves the voxel as it was when its layer 1 chunk still uses 255 other materials after dropping the unused ones
+	// a sparse grid takes negative coordinates too
+	bool insertItem(const int aX, const int aY, const int aZ, int aItemIndex);
+	void removeItem(const int aX, const int aY, const int aZ);
+
+	// edits to the same voxel are applied in order, returns the amount of edits insertItem rejected
+	int applyEdits(const std::vector<VoxelGridEdit>& aEdits);
+
+	// moves the chunks at the end of every level into the free slots, everything has to be uploaded again afterwards
+	// also drops the palette entries edits left behind that no brick uses anymore
+	void compact();
+
+	// stores the chunks of every level in morton order of their position, so neighbouring chunks are close in memory
+	// also compacts, everything has to be uploaded again afterwards
+	void sortChunksMorton();
+
+	// when enabled init(const VoxelModel*) stores the chunks in morton order, otherwise they are in build order
+	void setMortonOrder(bool aEnabled);
+
+	const VoxelGridChanges& getChanges() const;
+	void clearChanges();
+
+	size_t getFreeChunkCount(int aLevel) const;
+	int getItem(const int aX, const int aY, const int aZ) const;
+
+	// stores identical bricks only once, returns the amount of bricks removed
+	// bricks used by more than one chunk are copied when they are edited
+	size_t deduplicateBricks();
+
+	// when enabled init(const VoxelModel*) deduplicates the bricks and insertItem keeps every brick unique
+	void setBrickDeduplication(bool aEnabled);
+
+	// stores the top level in a hash map instead of a dense array, only filled top level chunks use memory
+	// the grid grows in every direction when voxels are inserted outside of it, must be set before init
+	// the gpu gets the sparse top level as a hash table, see getTopLevelTableData
+	void setSparseTopLevel(bool aEnabled);
+	bool isSparseTopLevel() const;
+
+	// cpu version of the DDA traversal, origin and direction are in voxel space
+	VoxelGridHit traverseRay(const glm::vec3& aOrigin, const glm::vec3& aDirection) const;
 
 	size_t getGridSize() const;
 	const void* getGridData() const;
 
-	const void* getLayer1ChunkData() const;
-	size_t getLayer1ChunkDataSize() const;
+	// open addressing table of the sparse top level for the shader, 4 ints per slot: top level x, y, z and the layer 1 chunk
+	// the chunk is -1 in empty slots, a position starts probing at hashTopLevelPosition & (slot count - 1) and steps one slot at a time
+	void getTopLevelTableData(std::vector<int>& aSlots) const;
+	// power of two, at least twice the amount of filled top level chunks
+	size_t getTopLevelTableSlotCount() const;
 
-	const void* getLayer2ChunkData() const;
+	size_t getLayer1ChunkDataSize() const;
 	size_t getLayer2ChunkDataSize() const;
 
+	// every layer 1 chunk has a palette of up to 255 atlas indices used by the bricks below it
+	// aOffsets holds the first entry of every layer 1 chunk palette in aEntries, entry 0 of a palette is empty
+	void getPaletteData(std::vector<int>& aOffsets, std::vector<int>& aEntries) const;
+	size_t getPaletteEntryCount() const;
+
+	// the levels are stored in slabs, these copy every chunk of a level back to back to aDestination
+	void copyLevelData(int aLevel, void* aDestination) const;
+	// occupancy masks, bit x + y * size + z * size * size is set when that cell holds a chunk or voxel
+	void copyLevelOccupancyData(int aLevel, void* aDestination) const;
+
+	// a chunk never straddles two slabs, so its cells and mask words are contiguous
+	const int* getChunkData(int aLevel, size_t aChunkIndex) const;
+	const uint64_t* getChunkOccupancyData(int aLevel, size_t aChunkIndex) const;
+	size_t getLevelChunkCount(int aLevel) const;
+
+	size_t getMemoryUsage() const;
+
+	// the grid covers getOrigin() up to getOrigin() + size, the origin is only below 0 for a sparse grid that grew there
+	glm::ivec3 getOrigin() const;
 	int getSizeX() const;
 	int getSizeY() const;
 	int getSizeZ() const;
+
+	// top level chunks the grid covers, counted from the one holding the origin
+	int getTopLevelCountX() const;
+	int getTopLevelCountY() const;
+	int getTopLevelCountZ() const;
 private:
+	static constexpr int brickLevel = levelCount - 1;
+	static constexpr int brickIntCount = Layout::getChunkIntCount(brickLevel);
+	static constexpr int brickMaskWordCount = Layout::getMaskWordCount(brickLevel);
+
+	static constexpr int maxPaletteSize = 256;
+
+	// the arena aligns the slabs to cache lines, so a 64 byte brick never straddles two lines
+	// chunks are appended to fixed size slabs, growing a level never copies the chunks it already holds
+	using ChunkData = SlabVector<int, MemoryTag::VoxelGrid>;
+	using MaskData = SlabVector<uint64_t, MemoryTag::VoxelGrid>;
+
+	static constexpr bool chunksFitInSlabs()
+	{
+		for (int level = 0; level < levelCount; level++)
+		{
+			if (ChunkData::slabSize % Layout::getChunkIntCount(level) != 0) return false;
+			if (MaskData::slabSize % Layout::getMaskWordCount(level) != 0) return false;
+		}
+		return true;
+	}
+	static_assert(chunksFitInSlabs(), "a chunk would straddle two slabs");
+
+	using LevelData = std::array<ChunkData, levelCount>;
+	using OccupancyData = std::array<MaskData, levelCount>;
+
+	// the chunks the cells point to are taken from aNextChunks, the levels must already hold them
+	template<int Level>
+	static void insertIntoLevel(LevelData& aLevels, OccupancyData& aOccupancy, std::array<int, levelCount>& aNextChunks, int aChunkIndex, const unsigned int aX, const unsigned int aY, const unsigned int aZ, int aItemIndex);
+
+	// returns the palette index of the atlas index, adds it to the palette when it isn't in there yet
+	// -1 when the palette is full
+	static int findPaletteEntry(std::vector<int>& aPalette, int aItemIndex);
+
+	// drops the palette entries of the layer 1 chunk that none of its bricks use anymore and renumbers its bricks
+	// returns false when every entry is still used
+	bool compactPalette(int aChunkIndex);
+
+	static void setBrickItem(int* aBrick, uint64_t* aMask, const unsigned int aX, const unsigned int aY, const unsigned int aZ, int aItemIndex);
+
+	// bricks are hashed by atlas index, the palette indices alone don't say what a brick holds
+	static uint64_t hashBrick(const int* aBrick, const std::vector<int>& aPalette);
+
+	// takes a chunk from the free list or adds a new one
+	int createChunk(int aLevel);
+	void freeChunk(int aLevel, int aChunkIndex);
+	bool isChunkEmpty(int aLevel, int aChunkIndex) const;
+
+	void markChunkDirty(int aLevel, int aChunkIndex);
+	void markTopLevelDirty(const glm::ivec3& aTopPosition);
+
+	bool isInside(const glm::ivec3& aPosition) const;
+	// moves the origin and size of a sparse grid so the position is inside of it
+	void growToContain(const glm::ivec3& aPosition);
+
+	// -1 when the top level chunk is empty
+	int getTopLevelChunk(const glm::ivec3& aTopPosition) const;
+	// also keeps the coarse top level counts up to date, -1 clears the top level chunk
+	void setTopLevelChunk(const glm::ivec3& aTopPosition, int aChunkIndex);
+
+	// returns a brick holding the given items, reuses an identical brick when deduplicating on insert
+	int acquireBrick(const int* aBrick, const uint64_t* aMask, int aPaletteIndex);
+
+	// drops the reference of the layer 1 chunk aPaletteIndex to the brick, the brick is freed when nothing uses it anymore
+	void releaseBrick(int aBrickIndex, int aPaletteIndex);
+	void removeFromBrickTable(int aBrickIndex);
+
+	// a brick can only be shared when it holds the same palette indices and both palettes map them to the same atlas index
+	int findBrick(const int* aBrick, uint64_t aHash, const std::vector<int>& aPalette) const;
+
+	// runs aFunction(x, y, z, palette index) for every voxel of the model inside the top level chunk, adding its materials to aPalette
+	// voxels that don't fit in the palette are skipped and counted in aRejectedCount, returns the amount of voxels visited
+	template<typename Function>
+	int visitTopLevelChunk(const VoxelModel* aModel, const unsigned int aTopX, const unsigned int aTopY, const unsigned int aTopZ, std::vector<int>& aPalette, int& aRejectedCount, Function aFunction) const;
+
+	// returns the item at the position, or the scale of the empty cell containing the position as a negative number
+	// only touches the item data when the occupancy mask says the cell is filled
+	template<int Level>
+	int sampleLevel(int aChunkIndex, const glm::ivec3& aPosition, int* aBrickIndex = nullptr) const;
+
+	// amount of cells to step along the axis from aPosition to the next filled cell in the brick, or to leave the brick
+	int findNextOccupiedCell(int aBrickIndex, const glm::ivec3& aPosition, int aAxis, int aStep) const;
+
+	// moves chunk i of the level to aRemap[i], -1 drops it, and points the level above to the new indices
+	void remapChunks(int aLevel, const std::vector<int>& aRemap, int aNewCount);
+	void rebuildBrickTable();
+
+	static int allocateChunk(LevelData& aLevels, OccupancyData& aOccupancy, int aLevel);
 
 	unsigned int sizeX{ 0 };
 	unsigned int sizeY{ 0 };
 	unsigned int sizeZ{ 0 };
 
+	// lowest voxel of the grid
+	int originX{ 0 };
+	int originY{ 0 };
+	int originZ{ 0 };
+
 	unsigned int layer1CountX{ 0 };
 	unsigned int layer1CountY{ 0 };
 	unsigned int layer1CountZ{ 0 };
 
-	int* gridLayer1Data{ nullptr }; 
-	size_t gridLayer1DataSize{ 0 };
+	ArenaVector<int, MemoryTag::VoxelGrid> gridLayer1Data;
+
+	// top level chunk coordinates to layer 1 chunk, replaces gridLayer1Data when the top level is sparse
+	bool sparseTopLevel{ false };
+	SpatialHashMap topLevelTable;
+
+	// amount of filled top level chunks in every coarse cell of 4x4x4 top level chunks, empty coarse cells aren't stored
+	// lets the traversal skip a whole coarse cell at once
+	static constexpr int coarseTopLevelShift = 2;
+	SpatialHashMap coarseTopLevel;
+
+	// chunks of every level stored back to back, Layout::getChunkIntCount(level) ints per chunk
+	LevelData levels;
+
+	// occupancy mask for every chunk, Layout::getMaskWordCount(level) words per chunk
+	OccupancyData occupancy;
+
+	// palette of every layer 1 chunk, entry 0 is always empty
+	std::vector<std::vector<int>> palettes;
+
+	bool deduplicateOnInsert{ false };
+	bool mortonOrderOnInit{ false };
+
+	// amount of chunks using every brick
+	std::vector<uint32_t> brickReferenceCounts;
+
+	// layer 1 chunk whose palette resolves the brick, every chunk using the brick maps its indices the same way
+	// -1 when that chunk stopped using the brick, the brick can't be found in the brick table then
+	std::vector<int> brickPalettes;
+
+	// content hash to brick index, only kept when deduplicating on insert
+	std::unordered_multimap<uint64_t, int> brickTable;
+
+	// chunks of every level nothing uses anymore, reused before new chunks are added
+	std::array<std::vector<int>, levelCount> freeChunks;
 
-	std::vector<Layer1Chunk> layer1Chunks;
-	std::vector<Layer2Chunk> layer2Chunks;
+	VoxelGridChanges changes;
+	std::vector<uint8_t> dirtyTopLevelFlags;
+	std::array<std::vector<uint8_t>, levelCount> dirtyChunkFlags;
 };
 
+using VoxelGrid = BasicVoxelGrid<VoxelGridLayout<4, 4>>;
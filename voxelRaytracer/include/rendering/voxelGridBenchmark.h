@@ -0,0 +1,37 @@
+#pragma once
+#include "engine\sceneGenerator.h"
+
+#include <string>
+#include <vector>
+
+struct VoxelGridBenchmarkResult
+{
+	std::string sceneName;
+	std::string layoutName;
+
+	int sceneSize{ 0 };
+
+	size_t memoryUsage{ 0 };
+	size_t brickCount{ 0 };
+
+	float buildTimeMS{ 0.f };
+	float megaRaysPerSecond{ 0.f };
+	float averageLoopCount{ 0.f };
+
+	// bytes between bricks that are neighbours along y or z, lower means rays hit fewer new cache lines
+	float neighbourBrickDistance{ 0.f };
+};
+
+// builds the model into every supported VoxelGrid layout and traces the same rays through each of them on the cpu
+std::vector<VoxelGridBenchmarkResult> runVoxelGridLayoutBenchmark(const VoxelModel* aModel, int aRayCount = 1000000);
+
+// peak memory of the scaling benchmark at aSize, the model plus the grid built from it
+// scaled from the scene generated at a small size with how fast its occupied bricks grow between half that size and it
+size_t estimateScalingBenchmarkMemory(GeneratedScene aScene, SceneGeneratorSettings aSettings, int aSize);
+
+// aBytes measured at aFromSize grown to aToSize, aExponent is 2 for memory that grows with the surface and 3 for the volume
+size_t scaleBenchmarkMemory(size_t aBytes, int aFromSize, int aToSize, double aExponent);
+
+// generates the scene at every power of two size from aMinSize up to aMaxSize and runs the layout benchmark on each of them
+// stops with a warning before the first size whose estimated memory is over aMemoryBudget, after two sizes the estimate grows from the memory and brick counts they measured
+std::vector<VoxelGridBenchmarkResult> runVoxelGridScalingBenchmark(GeneratedScene aScene, SceneGeneratorSettings aSettings, int aMinSize, int aMaxSize, size_t aMemoryBudget, int aRayCount = 1000000);
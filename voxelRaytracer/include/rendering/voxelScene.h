@@ -0,0 +1,77 @@
+#pragma once
+#include "engine\aabb.h"
+#include "rendering\voxelGrid.h"
+
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+// a voxel grid placed in the world, several instances can share one grid
+struct VoxelInstance
+{
+	const VoxelGrid* grid{ nullptr };
+
+	// voxel space of the grid to world space
+	glm::mat4 transform{ 1.f };
+	glm::mat4 inverseTransform{ 1.f };
+
+	// world space bounds of the transformed grid
+	AABB bounds;
+};
+
+struct VoxelSceneHit
+{
+	float distance{ FLT_MAX };
+	glm::vec3 normal{ 0.f, 0.f, 0.f };
+	int itemIndex{ 0 };
+
+	int instanceIndex{ -1 };
+};
+
+// two level scene, a bvh over instances of voxel grids
+// rays are moved into the voxel space of every instance they reach, so moving an instance only refits the bvh
+// only voxel grids can be instanced, the octree has no cpu traversal to trace an instance with
+class VoxelScene
+{
+public:
+	VoxelScene() {};
+	~VoxelScene() {};
+
+	// the grid has to stay alive as long as the instance uses it, returns the instance index
+	int addInstance(const VoxelGrid* aGrid, const glm::mat4& aTransform);
+	void setTransform(int aInstanceIndex, const glm::mat4& aTransform);
+	void clear();
+
+	// rebuilds the bvh, needed after instances were added
+	void build();
+	// only updates the bounds of the bvh nodes, cheaper than build() when instances moved but the tree is still good
+	void refit();
+
+	// distance is along aDirection in world space, aDirection doesn't have to be normalized
+	VoxelSceneHit traverseRay(const glm::vec3& aOrigin, const glm::vec3& aDirection) const;
+
+	const VoxelInstance& getInstance(int aInstanceIndex) const;
+	size_t getInstanceCount() const;
+	size_t getNodeCount() const;
+private:
+	// leaf when count > 0, then firstIndex points into instanceOrder, otherwise the children are firstIndex and firstIndex + 1
+	struct BvhNode
+	{
+		AABB bounds;
+		int firstIndex{ 0 };
+		int count{ 0 };
+	};
+
+	static constexpr int maxLeafSize = 2;
+	// nodes this deep become leaves whatever their count, so the traversal stack never holds more than maxDepth + 1 nodes
+	static constexpr int maxDepth = 32;
+
+	void updateBounds(VoxelInstance& aInstance);
+	void buildNode(int aNodeIndex, int aFirst, int aCount, int aDepth);
+
+	// distance to where the ray enters the bounds, FLT_MAX when it misses them
+	static float intersectBounds(const AABB& aBounds, const glm::vec3& aOrigin, const glm::vec3& aInverseDirection, float aMaxDistance);
+
+	std::vector<VoxelInstance> instances;
+	std::vector<int> instanceOrder;
+	std::vector<BvhNode> nodes;
+};
@@ -6,10 +6,6 @@
 #define FLOAT_MAX 3.402823466e+38F
 #define INT_MAX 2147483647
 
-#define CHUNK_SIZE_1 4
-#define CHUNK_SIZE_2 4
-#define TOP_LEVEL_SCALE 16
-
 struct AABBResult
 {
     float2 intersectDists;
@@ -43,7 +39,7 @@ chunkTraverseResult traverseLevel2(const RayStruct aRay, const int3 aMinBounds,
 
 HitResult traverseRay(RayStruct aRay)
 {
-    const float2 result = intersectAABB(aRay, float3(0, 0, 0), voxelGridSize.xyz);
+    const float2 result = intersectAABB(aRay, voxelGridOrigin.xyz, voxelGridOrigin.xyz + voxelGridSize.xyz);
     
     if (result.x < result.y && result.y > 0)
     {
@@ -108,52 +104,79 @@ HitResult traverseRay(RayStruct aRay)
 #define LEVEL2_EXIT_FLAG 0x00024800
 #define LEVEL1_EXIT_FLAG 0x00024800
 
-int sampleTopLevelGrid(const int aX, const int aY, const int aZ)
+// must match hashTopLevelPosition in voxelGrid.cpp
+uint hashTopLevelPosition(const int3 aIndex)
 {
-    return topLevelGrid[aX + (aY * topLevelChunkSize.x) + (aZ * topLevelChunkSize.x * topLevelChunkSize.y)];
+    return (uint(aIndex.x) * 73856093u) ^ (uint(aIndex.y) * 19349663u) ^ (uint(aIndex.z) * 83492791u);
 }
 
-int sampleLevel1Grid(const int aIndex, const int aX, const int aY, const int aZ)
+int sampleTopLevelGrid(const int3 aIndex)
 {
-    return Level1Grid[aIndex].itemIndices[aX + (aY * 4) + (aZ * 4 * 4)]; // replace constants
+    if (topLevelChunkSize.w == 0)
+    {
+        return topLevelGrid[aIndex.x + (aIndex.y * topLevelChunkSize.x) + (aIndex.z * topLevelChunkSize.x * topLevelChunkSize.y)];
+    }
+    
+    // linear probing, the table is at most half full so an empty slot ends the search
+    const uint mySlotMask = topLevelChunkSize.w - 1;
+    uint mySlot = hashTopLevelPosition(aIndex) & mySlotMask;
+    
+    while (true)
+    {
+        const int myChunk = topLevelGrid[mySlot * 4 + 3];
+        
+        if (myChunk == -1 || all(int3(topLevelGrid[mySlot * 4], topLevelGrid[mySlot * 4 + 1], topLevelGrid[mySlot * 4 + 2]) == aIndex))
+        {
+            return myChunk;
+        }
+        
+        mySlot = (mySlot + 1) & mySlotMask;
+    }
+    
+    return -1;
 }
 
-int sampleLevel2Grid(const int aIndex, const int aX, const int aY, const int aZ)
+int sampleLevel1Grid(const int aIndex, const int aX, const int aY, const int aZ)
 {
-    int combinedItems = Level2Grid[aIndex].items[aY + (aZ * 4)];
-    
-    return (combinedItems >> (aX * 8)) & 0xFF; // replace constants
+    return Level1Grid[aIndex].itemIndices[aX + (aY * CHUNK_SIZE_1) + (aZ * CHUNK_SIZE_1 * CHUNK_SIZE_1)];
 }
 
-//top level defines
-#define GET_TOP_INDEX_X(value) ((value >> 9) & 0x3F) 
-#define GET_TOP_INDEX_Y(value) ((value >> 15) & 0x3F)  
-#define GET_TOP_INDEX_Z(value) ((value >> 21) & 0x3F) 
+bool isOccupied(const uint2 aMask, const int aBit)
+{
+    return ((aBit < 32 ? (aMask.x >> aBit) : (aMask.y >> (aBit - 32))) & 0x1) != 0;
+}
 
-#define OFFSET_TOP_INDEX_X(value) ((value & 0x3F) << 9)
-#define OFFSET_TOP_INDEX_Y(value) ((value & 0x3F) << 15)  
-#define OFFSET_TOP_INDEX_Z(value) ((value & 0x3F) << 21) 
+bool isLevel1Occupied(const int aIndex, const int aX, const int aY, const int aZ)
+{
+    return isOccupied(Level1Occupancy[aIndex], aX + (aY * CHUNK_SIZE_1) + (aZ * CHUNK_SIZE_1 * CHUNK_SIZE_1));
+}
 
-#define IS_INDEX_NEGATIVE(value) (!((value & 0x3F) ^ 0x3F))
+bool isLevel2Occupied(const int aIndex, const int aX, const int aY, const int aZ)
+{
+    return isOccupied(Level2Occupancy[aIndex], aX + (aY * CHUNK_SIZE_2) + (aZ * CHUNK_SIZE_2 * CHUNK_SIZE_2));
+}
 
-#define TOP_INDEX_FLAG(value) (value & (0xFFFFFF << 6)) 
+int sampleLevel2Grid(const int aIndex, const int aX, const int aY, const int aZ)
+{
+    int combinedItems = Level2Grid[aIndex].items[(aX / 4) + (aY * (CHUNK_SIZE_2 / 4)) + (aZ * CHUNK_SIZE_2 * (CHUNK_SIZE_2 / 4))];
+    
+    return (combinedItems >> ((aX % 4) * 8)) & 0xFF;
+}
 
 HitResult traverseTopLevel(const RayStruct aRay)
 {
     const float3 scaledDelta = TOP_LEVEL_SCALE / aRay.direction;
     
-    const int3 currentIndex = floor((aRay.origin) / TOP_LEVEL_SCALE);
+    // the top level index is kept apart from the packed data, a sparse grid can be far larger than the packed bits and go below 0
+    int3 topIndex = floor((aRay.origin) / TOP_LEVEL_SCALE);
+    
+    const int3 topIndexMin = floor(float3(voxelGridOrigin.xyz) / TOP_LEVEL_SCALE);
+    const int3 topIndexMax = topIndexMin + int3(topLevelChunkSize.xyz);
 
     //data
-    int data = OFFSET_TOP_INDEX_X(currentIndex.x) + OFFSET_TOP_INDEX_Y(currentIndex.y) + OFFSET_TOP_INDEX_Z(currentIndex.z);
-    
     // 1 int
     // {
     
-    // 6 bits index X
-    // 6 bits index Y
-    // 6 bits index Z
-    
     // 1 bit normal X
     // 1 bit normal Y
     // 1 bit normal Z
@@ -174,8 +197,7 @@ HitResult traverseTopLevel(const RayStruct aRay)
     //get z dist
     tMax.z = (abs(aRay.origin.z / TOP_LEVEL_SCALE - floor(aRay.origin.z / TOP_LEVEL_SCALE) - (aRay.direction.z > 0.)) * TOP_LEVEL_SCALE) * aRay.rayDelta.z;
 
-    data = TOP_INDEX_FLAG(data) +
-            OFFSET_DIR_X((aRay.direction.x > 0) - (aRay.direction.x < 0) + 1) +
+    int data = OFFSET_DIR_X((aRay.direction.x > 0) - (aRay.direction.x < 0) + 1) +
             OFFSET_DIR_Y((aRay.direction.y > 0) - (aRay.direction.y < 0) + 1) +
             OFFSET_DIR_Z((aRay.direction.z > 0) - (aRay.direction.z < 0) + 1);
     
@@ -192,15 +214,13 @@ HitResult traverseTopLevel(const RayStruct aRay)
         //    return myResult;
         //}
         
-        if (GET_TOP_INDEX_X(data) >= topLevelChunkSize.x || IS_INDEX_NEGATIVE(GET_TOP_INDEX_X(data)) || // logic could get combined here for negatives
-            GET_TOP_INDEX_Y(data) >= topLevelChunkSize.y || IS_INDEX_NEGATIVE(GET_TOP_INDEX_Y(data)) ||
-            GET_TOP_INDEX_Z(data) >= topLevelChunkSize.z || IS_INDEX_NEGATIVE(GET_TOP_INDEX_Z(data)))
+        if (any(topIndex < topIndexMin) || any(topIndex >= topIndexMax))
         {
             HitResult myResult = hitResultDefault();
             return myResult;
         }
         
-        const int myIndex = sampleTopLevelGrid(GET_TOP_INDEX_X(data), GET_TOP_INDEX_Y(data), GET_TOP_INDEX_Z(data));
+        const int myIndex = sampleTopLevelGrid(topIndex);
         if (myIndex != -1)
         {
             RayStruct myRay;
@@ -208,7 +228,7 @@ HitResult traverseTopLevel(const RayStruct aRay)
             myRay.direction = aRay.direction;
             myRay.rayDelta = aRay.rayDelta;
             
-            const int3 myBounds = int3(GET_TOP_INDEX_X(data), GET_TOP_INDEX_Y(data), GET_TOP_INDEX_Z(data)) * TOP_LEVEL_SCALE;
+            const int3 myBounds = topIndex * TOP_LEVEL_SCALE;
 
             chunkTraverseResult myResult = traverseLevel1(myRay, myBounds, myIndex, data);
             loop += myResult.loopCount;
@@ -229,11 +249,8 @@ HitResult traverseTopLevel(const RayStruct aRay)
             
             tMax.x = tMax.x + scaledDelta.x * stepDir;
        
-            data = DIR_FLAG(data) + 
-                    OFFSET_TOP_INDEX_X(GET_TOP_INDEX_X(data) + stepDir) + 
-                    OFFSET_TOP_INDEX_Y(GET_TOP_INDEX_Y(data)) + 
-                    OFFSET_TOP_INDEX_Z(GET_TOP_INDEX_Z(data)) +
-                    OFFSET_NORMAL_X(1);
+            topIndex.x += stepDir;
+            data = DIR_FLAG(data) + OFFSET_NORMAL_X(1);
 
         }
         else if (distance == tMax.y)
@@ -243,11 +260,8 @@ HitResult traverseTopLevel(const RayStruct aRay)
             
             tMax.y = tMax.y + scaledDelta.y * stepDir;
 
-            data = DIR_FLAG(data) + 
-                    OFFSET_TOP_INDEX_X(GET_TOP_INDEX_X(data)) + 
-                    OFFSET_TOP_INDEX_Y(GET_TOP_INDEX_Y(data) + stepDir) + 
-                    OFFSET_TOP_INDEX_Z(GET_TOP_INDEX_Z(data)) +
-                    OFFSET_NORMAL_Y(1);
+            topIndex.y += stepDir;
+            data = DIR_FLAG(data) + OFFSET_NORMAL_Y(1);
         }
         else //(distance == tMax.z)
         {
@@ -256,11 +270,8 @@ HitResult traverseTopLevel(const RayStruct aRay)
             
             tMax.z = tMax.z + scaledDelta.z * stepDir;
             
-            data = DIR_FLAG(data) + 
-                    OFFSET_TOP_INDEX_X(GET_TOP_INDEX_X(data)) + 
-                    OFFSET_TOP_INDEX_Y(GET_TOP_INDEX_Y(data)) + 
-                    OFFSET_TOP_INDEX_Z(GET_TOP_INDEX_Z(data) + stepDir) +
-                    OFFSET_NORMAL_Z(1);
+            topIndex.z += stepDir;
+            data = DIR_FLAG(data) + OFFSET_NORMAL_Z(1);
         }
     }
     
@@ -308,9 +319,11 @@ chunkTraverseResult traverseLevel1(const RayStruct aRay, const int3 aMinBounds,
             return myResult;
         }
         
-        const int myIndex = sampleLevel1Grid(aChunkIndex, GET_INDEX_X(aData), GET_INDEX_Y(aData), GET_INDEX_Z(aData));
-        if (myIndex != -1)
+        // only load the chunk index when the mask says there is a chunk
+        if (isLevel1Occupied(aChunkIndex, GET_INDEX_X(aData), GET_INDEX_Y(aData), GET_INDEX_Z(aData)))
         {
+            const int myIndex = sampleLevel1Grid(aChunkIndex, GET_INDEX_X(aData), GET_INDEX_Y(aData), GET_INDEX_Z(aData));
+            
             RayStruct myRay;
             myRay.origin = aRay.origin + aRay.direction * (distance + 0.0001f);
             myRay.direction = aRay.direction;
@@ -326,6 +339,9 @@ chunkTraverseResult traverseLevel1(const RayStruct aRay, const int3 aMinBounds,
             {
                 myResult.loopCount = loop;
 
+                // bricks store palette indices, the palette of this chunk gives the atlas index
+                myResult.hit.itemIndex = PaletteEntries[Level1PaletteOffsets[aChunkIndex] + myResult.hit.itemIndex];
+
                 myResult.hit.hitDistance += distance;
                 return myResult;
             }
@@ -413,9 +429,11 @@ chunkTraverseResult traverseLevel2(const RayStruct aRay, const int3 aMinBounds,
             return myResult;
         }
        
-        const int myIndex = sampleLevel2Grid(aChunkIndex, GET_INDEX_X(aData), GET_INDEX_Y(aData), GET_INDEX_Z(aData));
-        if (myIndex > 0)
+        // material data is only loaded for the voxel that is hit
+        if (isLevel2Occupied(aChunkIndex, GET_INDEX_X(aData), GET_INDEX_Y(aData), GET_INDEX_Z(aData)))
         {
+            const int myIndex = sampleLevel2Grid(aChunkIndex, GET_INDEX_X(aData), GET_INDEX_Y(aData), GET_INDEX_Z(aData));
+
             chunkTraverseResult myResult;
             myResult.loopCount = loop;
             
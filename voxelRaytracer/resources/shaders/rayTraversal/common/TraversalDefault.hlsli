@@ -4,11 +4,11 @@ struct OctreeNode
     unsigned int childrenIndex;
     unsigned int children;
     unsigned int parentIndex;
-    unsigned int parentOctant; // first 3 bits used for parent octant, 8 bits for item index
+    unsigned int parentOctant; // first 3 bits used for parent octant, 29 bits for item index
 };
 
 #define GET_OCTREE_PARENT_OCTANT(data) (data & 0x7)
-#define GET_OCTREE_ITEM_INDEX(data) (data & (0xFF << 3))
+#define GET_OCTREE_ITEM_INDEX(data) ((data >> 3) & 0x1FFFFFFF)
 
 
 struct OctreeNodes
@@ -29,27 +29,54 @@ cbuffer octreeConstantBuffer : register(b1)
 cbuffer voxelGridConstantBuffer : register(b2)
 {
     const uint4 voxelGridSize;
+    
+    // w is the slot count of the sparse top level table, 0 when topLevelGrid is dense
     const uint4 topLevelChunkSize;
     
+    // lowest voxel of the grid, only a sparse grid goes below 0
+    const int4 voxelGridOrigin;
+    
     const uint voxelAtlasOffset;
 }
 
+// chunk sizes are passed in by the application to match the VoxelGrid layout
+#ifndef CHUNK_SIZE_1
+#define CHUNK_SIZE_1 4
+#endif
+
+#ifndef CHUNK_SIZE_2
+#define CHUNK_SIZE_2 4
+#endif
+
+#ifndef TOP_LEVEL_SCALE
+#define TOP_LEVEL_SCALE (CHUNK_SIZE_1 * CHUNK_SIZE_2)
+#endif
+
 // grid item
-// 8 bit index to atlas (0 == not filled)
+// 8 bit index into the palette of the layer 1 chunk (0 == not filled), 4 items packed per int along x
 struct Layer2Chunk
 {
-    int items[4 * 4];
+    int items[CHUNK_SIZE_2 * CHUNK_SIZE_2 * CHUNK_SIZE_2 / 4];
 };
 
 struct Layer1Chunk
 {
-    int itemIndices[4 * 4 * 4];
+    int itemIndices[CHUNK_SIZE_1 * CHUNK_SIZE_1 * CHUNK_SIZE_1];
 };
 
+// dense top level, or the sparse top level table with 4 ints per slot: top level x, y, z and the layer 1 chunk (-1 when empty)
 StructuredBuffer<int> topLevelGrid : register(t2);
 StructuredBuffer<Layer1Chunk> Level1Grid : register(t3);
 StructuredBuffer<Layer2Chunk> Level2Grid : register(t4);
 
+// 64 bit occupancy mask per chunk, bit x + y * size + z * size * size is set when that cell is filled
+StructuredBuffer<uint2> Level1Occupancy : register(t7);
+StructuredBuffer<uint2> Level2Occupancy : register(t8);
+
+// palette of every layer 1 chunk, maps the 8 bit brick items to atlas indices
+StructuredBuffer<int> Level1PaletteOffsets : register(t9);
+StructuredBuffer<int> PaletteEntries : register(t10);
+
 //common traversal
 
 #define FLOAT_MAX 3.402823466e+38F
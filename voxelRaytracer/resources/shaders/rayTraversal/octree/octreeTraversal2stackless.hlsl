@@ -186,7 +186,7 @@ int2 getInitialNode()
 
 int getOctreeItemIndex(const int2 aNode, const int aOctant)
 {
-    return (GET_OCTREE_ITEM_INDEX(flatOctreeNodes[GET_CHILD_INDEX(aNode)].nodes[aOctant].parentOctant)) >> 3;
+    return GET_OCTREE_ITEM_INDEX(flatOctreeNodes[GET_CHILD_INDEX(aNode)].nodes[aOctant].parentOctant);
 }
 
 HitResult traverseNode(RayStruct aRay)
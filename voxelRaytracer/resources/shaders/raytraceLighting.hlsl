@@ -18,8 +18,20 @@ cbuffer constantBuffer : register(b0)
     
     const int frameSeed;
     const int sampleCount;
+    
+    // octreeLayerCount and octreeSize on the cpu, they come from octreeConstantBuffer here
+    const int2 unusedOctreeVariables;
+    
+    const int skyLighting;
+    
+    // l2 sh of the skydome convolved with the cosine lobe, same order as SHIrradiance
+    const float4 skyIrradiance[9];
 }
 
+// SkyLighting on the cpu
+#define SKY_LIGHTING_TEXTURE 0
+#define SKY_LIGHTING_IRRADIANCE 1
+
 struct AtlasItem
 {
     float4 colorAndRoughness;
@@ -39,10 +51,6 @@ SamplerState skydomeSampler : register(s0);
 #define FLOAT_MAX 3.402823466e+38F
 #define INT_MAX 2147483647
 
-#define CHUNK_SIZE_1 4
-#define CHUNK_SIZE_2 4
-#define TOP_LEVEL_SCALE 16
-
 struct RandomOut
 {
     float randomNum;
@@ -61,6 +69,8 @@ struct BounceResult
 {
     RayStruct bounceRay;
     float3 colorMultiplier;
+    
+    bool isSpecular;
 };
 
 //BounceResult bounceResultDefault()
@@ -72,6 +82,7 @@ struct BounceResult
 //}
 
 float3 sampleSkydome(float3 aDirection);
+float3 evaluateSkyIrradiance(float3 aNormal);
 
 BounceResult generateBounce(const float3 hitPoint, const float3 hitNormal, const AtlasItem aItem, const float3 incommingRayDirection, inout RandomState rs);
 
@@ -132,6 +143,9 @@ void main(uint3 DTid : SV_DispatchThreadID)
     
     float3 myOutColor = float3(1, 1, 1);
     
+    //only diffuse bounce rays can use the sky irradiance, primary and specular rays need the sky itself
+    bool myIsDiffuseRay = false;
+    
     bool bounceStopped = false;
     for (int i = 0; (i < RAY_BOUNCES) && !bounceStopped; i++)
     {
@@ -145,6 +159,7 @@ void main(uint3 DTid : SV_DispatchThreadID)
             const float3 myHitPoint = myRay.origin + myRay.direction * result.hitDistance;
             BounceResult myResult = generateBounce(myHitPoint, result.hitNormal, myItem, myRay.direction, rs);
             myRay = myResult.bounceRay;
+            myIsDiffuseRay = !myResult.isSpecular;
             
             myOutColor *= myResult.colorMultiplier;
             
@@ -154,11 +169,25 @@ void main(uint3 DTid : SV_DispatchThreadID)
                 bounceStopped = true;
                 continue;
             }
+            
+            //a diffuse last bounce ray is not traced, the sky irradiance at the hit stands in for it without occlusion
+            if (skyLighting == SKY_LIGHTING_IRRADIANCE && myIsDiffuseRay && i == RAY_BOUNCES - 2)
+            {
+                myOutColor *= evaluateSkyIrradiance(result.hitNormal);
+                bounceStopped = true;
+            }
         }
         else
         {
-            //hit nothing -> sample skyDome
-            myOutColor *= (SRGBToLinear(sampleSkydome(myRay.direction)) * 2.f);
+            //hit nothing -> sample skyDome, diffuse bounce rays can use the irradiance instead
+            if (skyLighting == SKY_LIGHTING_IRRADIANCE && myIsDiffuseRay)
+            {
+                myOutColor *= evaluateSkyIrradiance(myRay.direction);
+            }
+            else
+            {
+                myOutColor *= (SRGBToLinear(sampleSkydome(myRay.direction)) * 2.f);
+            }
             bounceStopped = true;
         }
     }
@@ -174,6 +203,28 @@ float3 sampleSkydome(float3 aDirection)
     return skydomeTexture.SampleLevel(skydomeSampler, uv, 0).xyz;
 }
 
+// already linear and doubled like the texture is after SRGBToLinear, see projectSkydomeIrradiance
+float3 evaluateSkyIrradiance(float3 aNormal)
+{
+    const float x = aNormal.x;
+    const float y = aNormal.y;
+    const float z = aNormal.z;
+    
+    float3 myResult = skyIrradiance[0].xyz * 0.282095f;
+    
+    myResult += skyIrradiance[1].xyz * (0.488603f * y);
+    myResult += skyIrradiance[2].xyz * (0.488603f * z);
+    myResult += skyIrradiance[3].xyz * (0.488603f * x);
+    
+    myResult += skyIrradiance[4].xyz * (1.092548f * x * y);
+    myResult += skyIrradiance[5].xyz * (1.092548f * y * z);
+    myResult += skyIrradiance[6].xyz * (0.315392f * (3.f * z * z - 1.f));
+    myResult += skyIrradiance[7].xyz * (1.092548f * x * z);
+    myResult += skyIrradiance[8].xyz * (0.546274f * (x * x - y * y));
+    
+    return max(myResult, 0.f);
+}
+
 RayStruct createRay(const float2 windowPos)
 {
     RayStruct myRay;
@@ -236,6 +287,7 @@ BounceResult generateBounce(const float3 hitPoint, const float3 hitNormal, const
         
     // update the colorMultiplier
     myResult.colorMultiplier = lerp(aItem.colorAndRoughness.xyz, aItem.specularAndPercent.xyz, doSpecular);
+    myResult.isSpecular = doSpecular > 0.5f;
 
     return myResult;
 }
@@ -0,0 +1,210 @@
+#include "engine/hdrTextureCache.h"
+#include "engine/hash.h"
+#include "engine/logger.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string.h>
+
+constexpr const char* hdrTextureCachePath = "saves/cache/hdrTextures/";
+
+// "HDRT", the version goes up when the layout or the filtering of the files changes so the hdr files are converted again
+constexpr uint32_t cacheFileMagic = 0x54524448;
+constexpr uint32_t cacheFileVersion = 1;
+
+namespace fs = std::filesystem;
+
+struct CacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	int32_t width;
+	int32_t height;
+	int32_t mipCount;
+	uint32_t format;
+	uint64_t texelCount;
+};
+
+static std::string getCacheFileName(uint64_t aKey)
+{
+	char myName[32];
+	snprintf(myName, sizeof(myName), "%016llx.hdrt", static_cast<unsigned long long>(aKey));
+
+	return std::string(hdrTextureCachePath) + myName;
+}
+
+// texels of all mip levels together
+static size_t getMipChainTexelCount(int aWidth, int aHeight, int aMipCount)
+{
+	size_t myCount = 0;
+	for (int level = 0; level < aMipCount; level++)
+	{
+		myCount += static_cast<size_t>(aWidth) * aHeight;
+
+		aWidth = std::max(aWidth / 2, 1);
+		aHeight = std::max(aHeight / 2, 1);
+	}
+
+	return myCount;
+}
+
+uint64_t hashHdrTextureSource(const char* aFileName)
+{
+	MappedFile myFile;
+	if (!myFile.open(aFileName)) return 0;
+
+	uint64_t myHash = hashBytes(hashSeed, myFile.getData(), myFile.getSize());
+	myHash = hashBytes(myHash, &cacheFileVersion, sizeof(cacheFileVersion));
+
+	// 0 means there is no key
+	return myHash ? myHash : 1;
+}
+
+std::vector<uint32_t> encodeHdrTexture(const float* aPixels, int aWidth, int aHeight)
+{
+	const int myMipCount = getFullMipCount(aWidth, aHeight);
+
+	std::vector<uint32_t> myTexels(getMipChainTexelCount(aWidth, aHeight, myMipCount));
+	uint32_t* myLevelTexels = myTexels.data();
+
+	std::vector<glm::vec3> myLevel(static_cast<size_t>(aWidth) * aHeight);
+	for (size_t i = 0; i < myLevel.size(); i++)
+	{
+		myLevel[i] = glm::vec3(aPixels[i * 4], aPixels[i * 4 + 1], aPixels[i * 4 + 2]);
+	}
+
+	int myWidth = aWidth;
+	int myHeight = aHeight;
+
+	for (int level = 0; level < myMipCount; level++)
+	{
+		for (size_t i = 0; i < myLevel.size(); i++)
+		{
+			myLevelTexels[i] = encodeRGB9E5(myLevel[i]);
+		}
+		myLevelTexels += myLevel.size();
+
+		if (level + 1 == myMipCount) break;
+
+		// a side of 1 stays 1, the texels past the edge of an odd side are left out
+		const int myNextWidth = std::max(myWidth / 2, 1);
+		const int myNextHeight = std::max(myHeight / 2, 1);
+
+		std::vector<glm::vec3> myNextLevel(static_cast<size_t>(myNextWidth) * myNextHeight);
+
+		for (int y = 0; y < myNextHeight; y++)
+		{
+			const int myY0 = std::min(y * 2, myHeight - 1);
+			const int myY1 = std::min(y * 2 + 1, myHeight - 1);
+
+			for (int x = 0; x < myNextWidth; x++)
+			{
+				const int myX0 = std::min(x * 2, myWidth - 1);
+				const int myX1 = std::min(x * 2 + 1, myWidth - 1);
+
+				myNextLevel[static_cast<size_t>(y) * myNextWidth + x] = 0.25f *
+					(myLevel[static_cast<size_t>(myY0) * myWidth + myX0] + myLevel[static_cast<size_t>(myY0) * myWidth + myX1] +
+					myLevel[static_cast<size_t>(myY1) * myWidth + myX0] + myLevel[static_cast<size_t>(myY1) * myWidth + myX1]);
+			}
+		}
+
+		myLevel = std::move(myNextLevel);
+		myWidth = myNextWidth;
+		myHeight = myNextHeight;
+	}
+
+	return myTexels;
+}
+
+bool loadCachedHdrTexture(uint64_t aKey, MappedFile& aFile, Texture& aTexture)
+{
+	const std::string myFileName = getCacheFileName(aKey);
+
+	if (!aFile.open(myFileName.c_str())) return false;
+
+	CacheFileHeader myHeader;
+	if (aFile.getSize() < sizeof(myHeader))
+	{
+		aFile.close();
+		return false;
+	}
+
+	memcpy(&myHeader, aFile.getData(), sizeof(myHeader));
+
+	const bool myHasSize = myHeader.width > 0 && myHeader.height > 0 && myHeader.mipCount == getFullMipCount(myHeader.width, myHeader.height);
+
+	const bool myIsValid = myHeader.magic == cacheFileMagic && myHeader.version == cacheFileVersion && myHeader.key == aKey && myHasSize &&
+		myHeader.format == static_cast<uint32_t>(TextureFormat::RGB9E5) && myHeader.texelCount == getMipChainTexelCount(myHeader.width, myHeader.height, myHeader.mipCount) &&
+		aFile.getSize() == sizeof(myHeader) + myHeader.texelCount * sizeof(uint32_t);
+
+	if (!myIsValid)
+	{
+		LOG_WARNING("hdr texture cache file %s is broken or outdated", myFileName.c_str());
+		aFile.close();
+		return false;
+	}
+
+	aTexture.textureData = aFile.getData() + sizeof(myHeader);
+	aTexture.textureWidth = myHeader.width;
+	aTexture.textureHeight = myHeader.height;
+	aTexture.bytesPerPixel = sizeof(uint32_t);
+	aTexture.format = TextureFormat::RGB9E5;
+	aTexture.mipCount = myHeader.mipCount;
+
+	return true;
+}
+
+void saveCachedHdrTexture(uint64_t aKey, const Texture& aTexture)
+{
+	assert(aTexture.format == TextureFormat::RGB9E5);
+
+	std::error_code myError;
+	fs::create_directories(hdrTextureCachePath, myError);
+
+	if (myError)
+	{
+		LOG_WARNING("could not create the hdr texture cache directory %s", hdrTextureCachePath);
+		return;
+	}
+
+	CacheFileHeader myHeader;
+	myHeader.magic = cacheFileMagic;
+	myHeader.version = cacheFileVersion;
+	myHeader.key = aKey;
+	myHeader.width = aTexture.textureWidth;
+	myHeader.height = aTexture.textureHeight;
+	myHeader.mipCount = aTexture.mipCount;
+	myHeader.format = static_cast<uint32_t>(aTexture.format);
+	myHeader.texelCount = getMipChainTexelCount(aTexture.textureWidth, aTexture.textureHeight, aTexture.mipCount);
+
+	// written next to the real file first, so a file that was cut off is never read
+	const std::string myFileName = getCacheFileName(aKey);
+	const std::string myTempFileName = myFileName + ".tmp";
+
+	{
+		std::ofstream myFile(myTempFileName, std::ios::binary);
+
+		myFile.write(reinterpret_cast<const char*>(&myHeader), sizeof(myHeader));
+		myFile.write(static_cast<const char*>(aTexture.textureData), myHeader.texelCount * sizeof(uint32_t));
+
+		if (!myFile)
+		{
+			LOG_WARNING("could not write hdr texture cache file %s", myTempFileName.c_str());
+			myFile.close();
+			fs::remove(myTempFileName, myError);
+			return;
+		}
+	}
+
+	fs::rename(myTempFileName, myFileName, myError);
+
+	if (myError)
+	{
+		LOG_WARNING("could not write hdr texture cache file %s", myFileName.c_str());
+		fs::remove(myTempFileName, myError);
+	}
+}
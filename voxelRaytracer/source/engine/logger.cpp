@@ -2,12 +2,18 @@
 #include "engine/timer.h"
 
 #include <iostream>
+#include <mutex>
 #include <windows.h> 
 
 static HANDLE consoleHandle{ NULL };
 
+// a message is printed in parts, so messages from other threads have to wait
+static std::mutex logMutex;
+
 void Logger::log(LogLevel aLevel, const char* aMessage, ...)
 {
+    std::lock_guard<std::mutex> myLock(logMutex);
+
     if (!consoleHandle) consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
 
     SetConsoleTextAttribute(consoleHandle, 7);
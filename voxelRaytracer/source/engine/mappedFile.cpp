@@ -0,0 +1,111 @@
+#include "engine/mappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const char* aFileName)
+{
+	close();
+
+	HANDLE myFile = CreateFileA(aFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (myFile == INVALID_HANDLE_VALUE) return false;
+
+	fileHandle = myFile;
+
+	LARGE_INTEGER mySize;
+	if (!GetFileSizeEx(myFile, &mySize) || mySize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(myFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle)
+	{
+		close();
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		close();
+		return false;
+	}
+
+	size = static_cast<size_t>(mySize.QuadPart);
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+
+	data = nullptr;
+	size = 0;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+#else
+bool MappedFile::open(const char* aFileName)
+{
+	close();
+
+	fileDescriptor = ::open(aFileName, O_RDONLY);
+	if (fileDescriptor == -1) return false;
+
+	struct stat myStat;
+	if (fstat(fileDescriptor, &myStat) != 0 || myStat.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* myData = mmap(nullptr, static_cast<size_t>(myStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (myData == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(myData);
+	size = static_cast<size_t>(myStat.st_size);
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data) munmap(const_cast<uint8_t*>(data), size);
+	if (fileDescriptor != -1) ::close(fileDescriptor);
+
+	data = nullptr;
+	size = 0;
+	fileDescriptor = -1;
+}
+#endif
+
+const uint8_t* MappedFile::getData() const
+{
+	return data;
+}
+
+size_t MappedFile::getSize() const
+{
+	return size;
+}
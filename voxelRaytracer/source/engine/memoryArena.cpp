@@ -0,0 +1,142 @@
+#include "engine/memoryArena.h"
+#include "engine/logger.h"
+
+#include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static std::atomic<size_t> allocatedBytes[static_cast<int>(MemoryTag::Count)];
+static std::atomic<size_t> peakBytes[static_cast<int>(MemoryTag::Count)];
+
+static std::atomic<bool> useHugePages{ false };
+
+#ifdef _WIN32
+// huge page allocations have to be freed with VirtualFree, they are rare so a locked set is fine
+static std::mutex hugePageMutex;
+static std::unordered_set<void*> hugePageAllocations;
+
+static void* allocateHugePages(size_t aBytes)
+{
+	const size_t myPageSize = GetLargePageMinimum();
+	if (myPageSize == 0) return nullptr;
+
+	const size_t myBytes = (aBytes + myPageSize - 1) / myPageSize * myPageSize;
+	void* myPointer = VirtualAlloc(nullptr, myBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+	if (myPointer)
+	{
+		std::lock_guard<std::mutex> myLock(hugePageMutex);
+		hugePageAllocations.insert(myPointer);
+	}
+
+	return myPointer;
+}
+#endif
+
+void* MemoryArena::allocate(size_t aBytes, MemoryTag aTag)
+{
+	// round up so the size is a multiple of the alignment, aligned_alloc requires it
+	const size_t myBytes = aBytes == 0 ? alignment : (aBytes + alignment - 1) / alignment * alignment;
+
+	void* myPointer = nullptr;
+
+#ifdef _WIN32
+	if (useHugePages && myBytes >= hugePageThreshold)
+	{
+		myPointer = allocateHugePages(myBytes);
+	}
+
+	if (!myPointer)
+	{
+		myPointer = _aligned_malloc(myBytes, alignment);
+	}
+#else
+	myPointer = aligned_alloc(alignment, myBytes);
+
+	if (myPointer && useHugePages && myBytes >= hugePageThreshold)
+	{
+		// only a hint, transparent huge pages may be disabled
+		madvise(myPointer, myBytes, MADV_HUGEPAGE);
+	}
+#endif
+
+	if (!myPointer)
+	{
+		LOG_ERROR("failed to allocate %zu bytes for %s", aBytes, getTagName(aTag));
+		throw std::bad_alloc();
+	}
+
+	std::atomic<size_t>& myAllocated = allocatedBytes[static_cast<int>(aTag)];
+	std::atomic<size_t>& myPeak = peakBytes[static_cast<int>(aTag)];
+
+	const size_t myTotal = myAllocated += aBytes;
+
+	size_t myPeakValue = myPeak.load();
+	while (myTotal > myPeakValue && !myPeak.compare_exchange_weak(myPeakValue, myTotal)) {}
+
+	return myPointer;
+}
+
+void MemoryArena::free(void* aPointer, size_t aBytes, MemoryTag aTag)
+{
+	if (!aPointer) return;
+
+	assert(allocatedBytes[static_cast<int>(aTag)] >= aBytes);
+	allocatedBytes[static_cast<int>(aTag)] -= aBytes;
+
+#ifdef _WIN32
+	{
+		std::lock_guard<std::mutex> myLock(hugePageMutex);
+
+		if (hugePageAllocations.erase(aPointer))
+		{
+			VirtualFree(aPointer, 0, MEM_RELEASE);
+			return;
+		}
+	}
+
+	_aligned_free(aPointer);
+#else
+	::free(aPointer);
+#endif
+}
+
+void MemoryArena::setHugePages(bool aEnabled)
+{
+	useHugePages = aEnabled;
+}
+
+bool MemoryArena::getHugePages()
+{
+	return useHugePages;
+}
+
+size_t MemoryArena::getAllocatedBytes(MemoryTag aTag)
+{
+	return allocatedBytes[static_cast<int>(aTag)];
+}
+
+size_t MemoryArena::getPeakBytes(MemoryTag aTag)
+{
+	return peakBytes[static_cast<int>(aTag)];
+}
+
+const char* MemoryArena::getTagName(MemoryTag aTag)
+{
+	switch (aTag)
+	{
+	case MemoryTag::VoxelGrid: return "voxel grid";
+	case MemoryTag::VoxelModel: return "voxel model";
+	case MemoryTag::Octree: return "octree";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,996 @@
+#include "engine/meshVoxelizer.h"
+#include "engine/meshModel.h"
+
+#include <assert.h>
+#include <float.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, aValue can't be 0
+static inline int findLowestBit(uint64_t aValue)
+{
+#ifdef _MSC_VER
+	unsigned long myIndex;
+	_BitScanForward64(&myIndex, aValue);
+	return static_cast<int>(myIndex);
+#else
+	return __builtin_ctzll(aValue);
+#endif
+}
+
+// triangle box overlap test of Schwarz and Seidel, set up once per triangle for boxes of one size
+// a box overlaps when its corners are on both sides of the plane and it overlaps the triangle in the xy, yz and zx projections
+struct TriangleBoxTest
+{
+	glm::vec3 normal;
+	float planeNear;
+	float planeFar;
+
+	glm::vec2 edgesXY[3];
+	glm::vec2 edgesYZ[3];
+	glm::vec2 edgesZX[3];
+
+	float offsetsXY[3];
+	float offsetsYZ[3];
+	float offsetsZX[3];
+};
+
+// returns false for triangles without an area, they can't overlap anything
+static bool setupTriangleBoxTest(const glm::vec3* aVertices, float aBoxSize, TriangleBoxTest& aTest)
+{
+	const glm::vec3 myEdges[3] = { aVertices[1] - aVertices[0], aVertices[2] - aVertices[1], aVertices[0] - aVertices[2] };
+
+	const glm::vec3 myNormal = glm::cross(myEdges[0], aVertices[2] - aVertices[0]);
+	if (myNormal.x == 0.f && myNormal.y == 0.f && myNormal.z == 0.f) return false;
+
+	// the corner furthest along the normal and the one opposite of it
+	const glm::vec3 myCorner = glm::vec3(myNormal.x > 0.f ? aBoxSize : 0.f, myNormal.y > 0.f ? aBoxSize : 0.f, myNormal.z > 0.f ? aBoxSize : 0.f);
+
+	aTest.normal = myNormal;
+	aTest.planeFar = glm::dot(myNormal, myCorner - aVertices[0]);
+	aTest.planeNear = glm::dot(myNormal, glm::vec3(aBoxSize) - myCorner - aVertices[0]);
+
+	// edge normals point into the projected triangle, the offset moves the test to the box corner that is furthest inside
+	const float mySignXY = myNormal.z >= 0.f ? 1.f : -1.f;
+	const float mySignYZ = myNormal.x >= 0.f ? 1.f : -1.f;
+	const float mySignZX = myNormal.y >= 0.f ? 1.f : -1.f;
+
+	auto myOffset = [&](const glm::vec2& aEdgeNormal, const glm::vec2& aVertex)
+	{
+		return -glm::dot(aEdgeNormal, aVertex) + std::max(0.f, aBoxSize * aEdgeNormal.x) + std::max(0.f, aBoxSize * aEdgeNormal.y);
+	};
+
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& myEdge = myEdges[i];
+		const glm::vec3& myVertex = aVertices[i];
+
+		aTest.edgesXY[i] = glm::vec2(-myEdge.y, myEdge.x) * mySignXY;
+		aTest.edgesYZ[i] = glm::vec2(-myEdge.z, myEdge.y) * mySignYZ;
+		aTest.edgesZX[i] = glm::vec2(-myEdge.x, myEdge.z) * mySignZX;
+
+		aTest.offsetsXY[i] = myOffset(aTest.edgesXY[i], glm::vec2(myVertex.x, myVertex.y));
+		aTest.offsetsYZ[i] = myOffset(aTest.edgesYZ[i], glm::vec2(myVertex.y, myVertex.z));
+		aTest.offsetsZX[i] = myOffset(aTest.edgesZX[i], glm::vec2(myVertex.z, myVertex.x));
+	}
+
+	return true;
+}
+
+// aBoxMin is the lowest corner of the box, the box also has to overlap the bounds of the triangle
+static bool overlapsBox(const TriangleBoxTest& aTest, const glm::vec3& aBoxMin)
+{
+	const float myPlane = glm::dot(aTest.normal, aBoxMin);
+	if (myPlane + aTest.planeFar < 0.f || myPlane + aTest.planeNear > 0.f) return false;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (glm::dot(aTest.edgesXY[i], glm::vec2(aBoxMin.x, aBoxMin.y)) + aTest.offsetsXY[i] < 0.f) return false;
+		if (glm::dot(aTest.edgesYZ[i], glm::vec2(aBoxMin.y, aBoxMin.z)) + aTest.offsetsYZ[i] < 0.f) return false;
+		if (glm::dot(aTest.edgesZX[i], glm::vec2(aBoxMin.z, aBoxMin.x)) + aTest.offsetsZX[i] < 0.f) return false;
+	}
+
+	return true;
+}
+
+// runs aFunction(begin, end, thread) for equal parts of aCount on aThreadCount threads
+template<typename Function>
+static void runParallel(int aCount, int aThreadCount, Function aFunction)
+{
+	std::vector<std::thread> myThreads;
+	for (int i = 1; i < aThreadCount; i++)
+	{
+		myThreads.emplace_back(aFunction, static_cast<int>(static_cast<int64_t>(aCount) * i / aThreadCount), static_cast<int>(static_cast<int64_t>(aCount) * (i + 1) / aThreadCount), i);
+	}
+
+	aFunction(0, static_cast<int>(static_cast<int64_t>(aCount) / aThreadCount), 0);
+
+	for (auto& thread : myThreads)
+	{
+		thread.join();
+	}
+}
+
+// the shared vertices of the mesh moved to voxel space once, the triangles find their corners through the indices of the mesh
+struct VoxelSpaceMesh
+{
+	std::vector<glm::vec3> positions;
+
+	// three per triangle, into positions
+	const uint32_t* indices{ nullptr };
+	int triangleCount{ 0 };
+
+	void getTriangle(int aTriangle, glm::vec3* aCorners) const
+	{
+		const uint32_t* myIndices = &indices[static_cast<size_t>(aTriangle) * 3];
+
+		aCorners[0] = positions[myIndices[0]];
+		aCorners[1] = positions[myIndices[1]];
+		aCorners[2] = positions[myIndices[2]];
+	}
+};
+
+// the value a triangle writes, one value for the whole triangle unless it has a texture
+// with materials the value is 1 + the color packed in 5 bits per channel, so the palette can be made once the model is done
+class TriangleValues
+{
+public:
+	TriangleValues(const MeshModel& aMesh, const VoxelSpaceMesh& aVoxelMesh, const MeshVoxelizerSettings& aSettings) :
+		mesh(aMesh), voxelMesh(aVoxelMesh)
+	{
+		const int myTriangleCount = aVoxelMesh.triangleCount;
+
+		values.resize(myTriangleCount, aSettings.value);
+		textures.resize(myTriangleCount, nullptr);
+
+		if (!aSettings.useMaterials) return;
+
+		for (int triangle = 0; triangle < myTriangleCount; triangle++)
+		{
+			const int myMaterial = aMesh.triangleMaterials ? aMesh.triangleMaterials[triangle] : -1;
+			const MeshMaterial myDefault;
+			const MeshMaterial& myMaterialData = myMaterial >= 0 ? aMesh.materials[myMaterial] : myDefault;
+
+			values[triangle] = packColor(myMaterialData.diffuse);
+			diffuses.push_back(myMaterialData.diffuse);
+
+			if (aMesh.texcoordIndices && myMaterialData.diffuseTexture && myMaterialData.diffuseTexture->textureData)
+			{
+				textures[triangle] = myMaterialData.diffuseTexture;
+			}
+		}
+	}
+
+	bool isTextured(int aTriangle) const
+	{
+		return textures[aTriangle] != nullptr;
+	}
+
+	uint32_t getValue(int aTriangle) const
+	{
+		return values[aTriangle];
+	}
+
+	bool usesMaterials() const
+	{
+		return !diffuses.empty();
+	}
+
+	// squared distance from aPosition to the triangle, aWeights gets the barycentric coordinates of the closest point
+	float findClosestPoint(int aTriangle, const glm::vec3& aPosition, glm::vec3& aWeights) const
+	{
+		glm::vec3 myTriangle[3];
+		voxelMesh.getTriangle(aTriangle, myTriangle);
+
+		// the point projected on the plane
+		const glm::vec3 myEdgeA = myTriangle[1] - myTriangle[0];
+		const glm::vec3 myEdgeB = myTriangle[2] - myTriangle[0];
+		const glm::vec3 myOffset = aPosition - myTriangle[0];
+
+		const float myAA = glm::dot(myEdgeA, myEdgeA);
+		const float myAB = glm::dot(myEdgeA, myEdgeB);
+		const float myBB = glm::dot(myEdgeB, myEdgeB);
+		const float myDenominator = myAA * myBB - myAB * myAB;
+
+		if (myDenominator > 0.f)
+		{
+			const float myOA = glm::dot(myOffset, myEdgeA);
+			const float myOB = glm::dot(myOffset, myEdgeB);
+
+			const float myV = (myBB * myOA - myAB * myOB) / myDenominator;
+			const float myW = (myAA * myOB - myAB * myOA) / myDenominator;
+
+			if (myV >= 0.f && myW >= 0.f && myV + myW <= 1.f)
+			{
+				aWeights = glm::vec3(1.f - myV - myW, myV, myW);
+
+				const glm::vec3 myDifference = myOffset - myEdgeA * myV - myEdgeB * myW;
+				return glm::dot(myDifference, myDifference);
+			}
+		}
+
+		// points outside of the triangle use the closest point on its edges
+		float myClosestDistance = FLT_MAX;
+
+		for (int edge = 0; edge < 3; edge++)
+		{
+			const int myNext = (edge + 1) % 3;
+			const glm::vec3 myEdge = myTriangle[myNext] - myTriangle[edge];
+			const float myLength = glm::dot(myEdge, myEdge);
+
+			const float myT = myLength > 0.f ? glm::clamp(glm::dot(aPosition - myTriangle[edge], myEdge) / myLength, 0.f, 1.f) : 0.f;
+			const glm::vec3 myDifference = myTriangle[edge] + myEdge * myT - aPosition;
+			const float myDistance = glm::dot(myDifference, myDifference);
+
+			if (myDistance < myClosestDistance)
+			{
+				myClosestDistance = myDistance;
+				aWeights = glm::vec3(0.f);
+				aWeights[edge] = 1.f - myT;
+				aWeights[myNext] = myT;
+			}
+		}
+
+		return myClosestDistance;
+	}
+
+	// samples the texture at the barycentric coordinates
+	uint32_t sample(int aTriangle, const glm::vec3& aWeights) const
+	{
+		const int* myTexcoordIndices = &mesh.texcoordIndices[static_cast<size_t>(aTriangle) * 3];
+
+		// corners without a uv use 0, 0
+		glm::vec2 myUV{ 0.f };
+		for (int corner = 0; corner < 3; corner++)
+		{
+			if (myTexcoordIndices[corner] < 0) continue;
+
+			const float* myTexcoord = &mesh.texcoords[static_cast<size_t>(myTexcoordIndices[corner]) * 2];
+			myUV += glm::vec2(myTexcoord[0], myTexcoord[1]) * aWeights[corner];
+		}
+
+		// uvs repeat, v goes up while the rows of the image go down, so v = 0 is the bottom row
+		const Texture* myTexture = textures[aTriangle];
+		const int myX = static_cast<int>((myUV.x - std::floor(myUV.x)) * myTexture->textureWidth);
+		const int myY = static_cast<int>((1.f - (myUV.y - std::floor(myUV.y))) * myTexture->textureHeight);
+
+		const unsigned char* myTexel = static_cast<const unsigned char*>(myTexture->textureData) + (static_cast<size_t>(std::min(myY, myTexture->textureHeight - 1)) * myTexture->textureWidth + std::min(myX, myTexture->textureWidth - 1)) * 4;
+
+		// textures are srgb, the diffuse color is linear
+		const glm::vec3 myColor = glm::pow(glm::vec3(myTexel[0], myTexel[1], myTexel[2]) / 255.f, glm::vec3(2.2f));
+
+		return packColor(myColor * diffuses[aTriangle]);
+	}
+
+	// gamma encodes the color first, so dark colors don't all end up in the same few values
+	static uint32_t packColor(const glm::vec3& aColor)
+	{
+		const glm::ivec3 myColor = glm::ivec3(glm::pow(glm::clamp(aColor, 0.f, 1.f), glm::vec3(1.f / 2.2f)) * 31.f + 0.5f);
+
+		return 1 + ((myColor.r << 10) | (myColor.g << 5) | myColor.b);
+	}
+
+	static glm::vec3 unpackColor(uint32_t aValue)
+	{
+		const uint32_t myColor = aValue - 1;
+
+		return glm::pow(glm::vec3((myColor >> 10) & 31, (myColor >> 5) & 31, myColor & 31) / 31.f, glm::vec3(2.2f));
+	}
+private:
+	const MeshModel& mesh;
+	const VoxelSpaceMesh& voxelMesh;
+
+	std::vector<uint32_t> values;
+	std::vector<glm::vec3> diffuses;
+	std::vector<const Texture*> textures;
+};
+
+// merges the bins of the threads, sorts them and lists every key in the top 32 bits once with the index of its first entry
+static std::vector<uint64_t> groupBins(std::vector<std::vector<uint64_t>>& aThreadBins, std::vector<uint32_t>& aKeys, std::vector<size_t>& aStarts)
+{
+	std::vector<uint64_t> myBins;
+	for (std::vector<uint64_t>& bin : aThreadBins)
+	{
+		myBins.insert(myBins.end(), bin.begin(), bin.end());
+		bin = std::vector<uint64_t>();
+	}
+	std::sort(myBins.begin(), myBins.end());
+
+	for (size_t i = 0; i < myBins.size(); i++)
+	{
+		const uint32_t myKey = static_cast<uint32_t>(myBins[i] >> 32);
+		if (!aKeys.empty() && aKeys.back() == myKey) continue;
+
+		aKeys.push_back(myKey);
+		aStarts.push_back(i);
+	}
+	aStarts.push_back(myBins.size());
+
+	return myBins;
+}
+
+// fills every voxel a triangle touches
+static void voxelizeSurface(VoxelModel& aModel, const VoxelSpaceMesh& aMesh, const TriangleValues& aValues, int aThreadCount)
+{
+	constexpr int myBrickSize = VoxelModel::brickSize;
+
+	const glm::ivec3 mySize = glm::ivec3(aModel.sizeX, aModel.sizeY, aModel.sizeZ);
+	const int myTriangleCount = aMesh.triangleCount;
+	const glm::ivec3 myBrickGridSize = (mySize + myBrickSize - 1) / myBrickSize;
+
+	// every triangle goes into the bricks it overlaps, the key is the brick index in the top 32 bits and the triangle in the bottom
+	std::vector<std::vector<uint64_t>> myThreadBins(aThreadCount);
+
+	runParallel(myTriangleCount, aThreadCount, [&](int aBegin, int aEnd, int aThread)
+	{
+		std::vector<uint64_t>& myBin = myThreadBins[aThread];
+
+		for (int triangle = aBegin; triangle < aEnd; triangle++)
+		{
+			glm::vec3 myTriangle[3];
+			aMesh.getTriangle(triangle, myTriangle);
+
+			TriangleBoxTest myTest;
+			if (!setupTriangleBoxTest(myTriangle, static_cast<float>(myBrickSize), myTest)) continue;
+
+			const glm::vec3 myMin = glm::min(myTriangle[0], glm::min(myTriangle[1], myTriangle[2]));
+			const glm::vec3 myMax = glm::max(myTriangle[0], glm::max(myTriangle[1], myTriangle[2]));
+
+			const glm::ivec3 myMinBrick = glm::clamp(glm::ivec3(glm::floor(myMin / static_cast<float>(myBrickSize))), glm::ivec3(0), myBrickGridSize - 1);
+			const glm::ivec3 myMaxBrick = glm::clamp(glm::ivec3(glm::floor(myMax / static_cast<float>(myBrickSize))), glm::ivec3(0), myBrickGridSize - 1);
+
+			const bool myIsInOneBrick = myMinBrick == myMaxBrick;
+
+			for (int z = myMinBrick.z; z <= myMaxBrick.z; z++)
+			{
+				for (int y = myMinBrick.y; y <= myMaxBrick.y; y++)
+				{
+					for (int x = myMinBrick.x; x <= myMaxBrick.x; x++)
+					{
+						// large triangles only go into the bricks their plane and edges go through
+						if (!myIsInOneBrick && !overlapsBox(myTest, glm::vec3(x, y, z) * static_cast<float>(myBrickSize))) continue;
+
+						const uint64_t myBrickIndex = x + (static_cast<uint64_t>(y) + static_cast<uint64_t>(z) * myBrickGridSize.y) * myBrickGridSize.x;
+						myBin.push_back((myBrickIndex << 32) | static_cast<uint32_t>(triangle));
+					}
+				}
+			}
+		}
+	});
+
+	// the occupied bricks and where their triangles start in the bins
+	std::vector<uint32_t> myBrickIndices;
+	std::vector<size_t> myBrickStarts;
+	const std::vector<uint64_t> myBins = groupBins(myThreadBins, myBrickIndices, myBrickStarts);
+
+	std::vector<glm::ivec3> myBricks;
+	for (const uint32_t brickIndex : myBrickIndices)
+	{
+		myBricks.push_back(glm::ivec3(brickIndex % myBrickGridSize.x, (brickIndex / myBrickGridSize.x) % myBrickGridSize.y, brickIndex / (myBrickGridSize.x * myBrickGridSize.y)));
+	}
+
+	aModel.generateBricks(myBricks, [&](const glm::ivec3& aBrickPosition, uint32_t* aVoxels)
+	{
+		const uint32_t myBrickIndex = aBrickPosition.x + (aBrickPosition.y + aBrickPosition.z * myBrickGridSize.y) * myBrickGridSize.x;
+		const size_t myBrick = std::lower_bound(myBrickIndices.begin(), myBrickIndices.end(), myBrickIndex) - myBrickIndices.begin();
+
+		const glm::ivec3 myBrickMin = aBrickPosition * myBrickSize;
+		const glm::ivec3 myBrickMax = myBrickMin + myBrickSize - 1;
+
+		bool myHasVoxel = false;
+
+		// distance from every voxel center to the triangle that colored it
+		const bool myUsesMaterials = aValues.usesMaterials();
+
+		float myDistances[VoxelModel::brickVoxelCount];
+		if (myUsesMaterials)
+		{
+			std::fill(std::begin(myDistances), std::end(myDistances), FLT_MAX);
+		}
+
+		for (size_t i = myBrickStarts[myBrick]; i < myBrickStarts[myBrick + 1]; i++)
+		{
+			const int myTriangleIndex = static_cast<int>(static_cast<uint32_t>(myBins[i]));
+			glm::vec3 myTriangle[3];
+			aMesh.getTriangle(myTriangleIndex, myTriangle);
+
+			const bool myIsTextured = aValues.isTextured(myTriangleIndex);
+			const uint32_t myValue = aValues.getValue(myTriangleIndex);
+
+			TriangleBoxTest myTest;
+			setupTriangleBoxTest(myTriangle, 1.f, myTest);
+
+			// voxels in both the brick and the bounds of the triangle
+			const glm::vec3 myMin = glm::min(myTriangle[0], glm::min(myTriangle[1], myTriangle[2]));
+			const glm::vec3 myMax = glm::max(myTriangle[0], glm::max(myTriangle[1], myTriangle[2]));
+
+			// faces on the far side of the bounds touch the last voxel
+			const glm::ivec3 myMinVoxel = glm::max(glm::min(glm::ivec3(glm::floor(myMin)), mySize - 1), myBrickMin);
+			const glm::ivec3 myMaxVoxel = glm::min(glm::min(glm::ivec3(glm::floor(myMax)), mySize - 1), myBrickMax);
+
+			for (int z = myMinVoxel.z; z <= myMaxVoxel.z; z++)
+			{
+				for (int y = myMinVoxel.y; y <= myMaxVoxel.y; y++)
+				{
+					// the yz projection is the same for the whole row
+					const float myY = static_cast<float>(y);
+					const float myZ = static_cast<float>(z);
+
+					bool myRowOverlaps = true;
+					for (int edge = 0; edge < 3; edge++)
+					{
+						myRowOverlaps &= myTest.edgesYZ[edge].x * myY + myTest.edgesYZ[edge].y * myZ + myTest.offsetsYZ[edge] >= 0.f;
+					}
+					if (!myRowOverlaps) continue;
+
+					// the other tests are linear in x, they are done for all voxels of the row at once so the compiler can vectorize them
+					const float myPlane = myTest.normal.y * myY + myTest.normal.z * myZ;
+					const float myXY0 = myTest.edgesXY[0].y * myY + myTest.offsetsXY[0];
+					const float myXY1 = myTest.edgesXY[1].y * myY + myTest.offsetsXY[1];
+					const float myXY2 = myTest.edgesXY[2].y * myY + myTest.offsetsXY[2];
+					const float myZX0 = myTest.edgesZX[0].x * myZ + myTest.offsetsZX[0];
+					const float myZX1 = myTest.edgesZX[1].x * myZ + myTest.offsetsZX[1];
+					const float myZX2 = myTest.edgesZX[2].x * myZ + myTest.offsetsZX[2];
+
+					const int myFirstLane = myMinVoxel.x - myBrickMin.x;
+					const int myLastLane = myMaxVoxel.x - myBrickMin.x;
+
+					uint32_t* myRow = &aVoxels[(y - myBrickMin.y) * myBrickSize + (z - myBrickMin.z) * myBrickSize * myBrickSize];
+					float* myRowDistances = &myDistances[(y - myBrickMin.y) * myBrickSize + (z - myBrickMin.z) * myBrickSize * myBrickSize];
+
+					bool myOverlaps[myBrickSize];
+					for (int lane = 0; lane < myBrickSize; lane++)
+					{
+						const float myX = static_cast<float>(myBrickMin.x + lane);
+						const float myLanePlane = myTest.normal.x * myX + myPlane;
+
+						myOverlaps[lane] = lane >= myFirstLane && lane <= myLastLane &&
+							myLanePlane + myTest.planeFar >= 0.f && myLanePlane + myTest.planeNear <= 0.f &&
+							myTest.edgesXY[0].x * myX + myXY0 >= 0.f && myTest.edgesXY[1].x * myX + myXY1 >= 0.f && myTest.edgesXY[2].x * myX + myXY2 >= 0.f &&
+							myTest.edgesZX[0].y * myX + myZX0 >= 0.f && myTest.edgesZX[1].y * myX + myZX1 >= 0.f && myTest.edgesZX[2].y * myX + myZX2 >= 0.f;
+					}
+
+					for (int lane = 0; lane < myBrickSize; lane++)
+					{
+						if (!myOverlaps[lane]) continue;
+
+						myHasVoxel = true;
+
+						if (!myUsesMaterials)
+						{
+							myRow[lane] = myValue;
+							continue;
+						}
+
+						// with materials the triangle closest to the voxel center colors it
+						glm::vec3 myWeights;
+						const float myDistance = aValues.findClosestPoint(myTriangleIndex, glm::vec3(myBrickMin.x + lane, y, z) + 0.5f, myWeights);
+
+						float& myClosestDistance = myRowDistances[lane];
+						if (myDistance >= myClosestDistance) continue;
+
+						myClosestDistance = myDistance;
+						myRow[lane] = myIsTextured ? aValues.sample(myTriangleIndex, myWeights) : myValue;
+					}
+				}
+			}
+		}
+
+		return myHasVoxel;
+	}, aThreadCount);
+}
+
+// a crossing of a row through the mesh, the sign is the direction the triangle faces along x
+struct RowCrossing
+{
+	float x;
+	int sign;
+	// value of the triangle at the crossing, the voxels after it get this value
+	uint32_t value;
+
+	bool operator<(const RowCrossing& aOther) const { return x < aOther.x; }
+};
+
+// fills the voxels with their center inside the mesh, rows along x through the voxel centers count the crossings to the left of every voxel
+// every 8x8 tile of rows in y and z is done on its own, so tiles run in parallel
+static void fillInterior(VoxelModel& aModel, const VoxelSpaceMesh& aMesh, const TriangleValues& aValues, int aThreadCount)
+{
+	constexpr int myBrickSize = VoxelModel::brickSize;
+	constexpr int myTileRowCount = myBrickSize * myBrickSize;
+
+	const glm::ivec3 mySize = glm::ivec3(aModel.sizeX, aModel.sizeY, aModel.sizeZ);
+	const int myTriangleCount = aMesh.triangleCount;
+	// the rows go along x, so the tiles are in y and z
+	const glm::ivec2 myRowCount = glm::ivec2(mySize.y, mySize.z);
+	const glm::ivec2 myTileGridSize = (myRowCount + myBrickSize - 1) / myBrickSize;
+	const int myBrickCountX = (mySize.x + myBrickSize - 1) / myBrickSize;
+
+	// triangles go into the tiles with a row center inside their bounds in y and z
+	std::vector<std::vector<uint64_t>> myThreadBins(aThreadCount);
+
+	runParallel(myTriangleCount, aThreadCount, [&](int aBegin, int aEnd, int aThread)
+	{
+		std::vector<uint64_t>& myBin = myThreadBins[aThread];
+
+		for (int triangle = aBegin; triangle < aEnd; triangle++)
+		{
+			glm::vec3 myTriangle[3];
+			aMesh.getTriangle(triangle, myTriangle);
+
+			// triangles that are edge on along x can't be crossed
+			const float myNormalX = (myTriangle[1].y - myTriangle[0].y) * (myTriangle[2].z - myTriangle[0].z) - (myTriangle[1].z - myTriangle[0].z) * (myTriangle[2].y - myTriangle[0].y);
+			if (myNormalX == 0.f) continue;
+
+			const glm::vec2 myMin = glm::min(glm::vec2(myTriangle[0].y, myTriangle[0].z), glm::min(glm::vec2(myTriangle[1].y, myTriangle[1].z), glm::vec2(myTriangle[2].y, myTriangle[2].z)));
+			const glm::vec2 myMax = glm::max(glm::vec2(myTriangle[0].y, myTriangle[0].z), glm::max(glm::vec2(myTriangle[1].y, myTriangle[1].z), glm::vec2(myTriangle[2].y, myTriangle[2].z)));
+
+			const glm::ivec2 myMinRow = glm::max(glm::ivec2(glm::ceil(myMin - 0.5f)), glm::ivec2(0));
+			const glm::ivec2 myMaxRow = glm::min(glm::ivec2(glm::floor(myMax - 0.5f)), myRowCount - 1);
+			if (myMinRow.x > myMaxRow.x || myMinRow.y > myMaxRow.y) continue;
+
+			for (int z = myMinRow.y / myBrickSize; z <= myMaxRow.y / myBrickSize; z++)
+			{
+				for (int y = myMinRow.x / myBrickSize; y <= myMaxRow.x / myBrickSize; y++)
+				{
+					const uint64_t myTileIndex = y + static_cast<uint64_t>(z) * myTileGridSize.x;
+					myBin.push_back((myTileIndex << 32) | static_cast<uint32_t>(triangle));
+				}
+			}
+		}
+	});
+
+	std::vector<uint32_t> myTileIndices;
+	std::vector<size_t> myTileStarts;
+	const std::vector<uint64_t> myBins = groupBins(myThreadBins, myTileIndices, myTileStarts);
+
+	// x ranges inside the mesh, one list per tile
+	struct RowSpan
+	{
+		int row;
+		int begin;
+		int end;
+		uint32_t value;
+	};
+
+	const int myTileCount = static_cast<int>(myTileIndices.size());
+	std::vector<std::vector<RowSpan>> myTileSpans(myTileCount);
+
+	std::atomic<int> myNextTile{ 0 };
+
+	runParallel(aThreadCount, aThreadCount, [&](int, int, int)
+	{
+		std::vector<RowCrossing> myCrossings[myTileRowCount];
+
+		for (int tile = myNextTile++; tile < myTileCount; tile = myNextTile++)
+		{
+			const glm::ivec2 myTileMin = glm::ivec2(myTileIndices[tile] % myTileGridSize.x, myTileIndices[tile] / myTileGridSize.x) * myBrickSize;
+
+			for (auto& crossings : myCrossings)
+			{
+				crossings.clear();
+			}
+
+			for (size_t i = myTileStarts[tile]; i < myTileStarts[tile + 1]; i++)
+			{
+				const int myTriangleIndex = static_cast<int>(static_cast<uint32_t>(myBins[i]));
+				glm::vec3 myTriangle[3];
+				aMesh.getTriangle(myTriangleIndex, myTriangle);
+
+				const bool myIsTextured = aValues.isTextured(myTriangleIndex);
+				const uint32_t myValue = aValues.getValue(myTriangleIndex);
+
+				// the triangle in the yz plane, turned counter clockwise
+				glm::vec2 myCorners[3] = { glm::vec2(myTriangle[0].y, myTriangle[0].z), glm::vec2(myTriangle[1].y, myTriangle[1].z), glm::vec2(myTriangle[2].y, myTriangle[2].z) };
+
+				const glm::vec2 myEdgeA = myCorners[1] - myCorners[0];
+				const glm::vec2 myEdgeB = myCorners[2] - myCorners[0];
+				const float myArea = myEdgeA.x * myEdgeB.y - myEdgeA.y * myEdgeB.x;
+
+				const int mySign = myArea > 0.f ? 1 : -1;
+				if (mySign < 0)
+				{
+					std::swap(myCorners[1], myCorners[2]);
+				}
+
+				const glm::vec3 myNormal = glm::cross(myTriangle[1] - myTriangle[0], myTriangle[2] - myTriangle[0]);
+
+				const glm::vec2 myMin = glm::min(myCorners[0], glm::min(myCorners[1], myCorners[2]));
+				const glm::vec2 myMax = glm::max(myCorners[0], glm::max(myCorners[1], myCorners[2]));
+
+				const glm::ivec2 myMinRow = glm::max(glm::ivec2(glm::ceil(myMin - 0.5f)), myTileMin);
+				const glm::ivec2 myMaxRow = glm::min(glm::min(glm::ivec2(glm::floor(myMax - 0.5f)), myTileMin + myBrickSize - 1), myRowCount - 1);
+
+				for (int z = myMinRow.y; z <= myMaxRow.y; z++)
+				{
+					for (int y = myMinRow.x; y <= myMaxRow.x; y++)
+					{
+						const glm::vec2 myPoint = glm::vec2(y + 0.5f, z + 0.5f);
+
+						// points on an edge only count for the triangle on one side of it, so shared edges aren't crossed twice
+						bool myIsInside = true;
+						for (int edge = 0; edge < 3 && myIsInside; edge++)
+						{
+							const glm::vec2 myFrom = myCorners[edge];
+							const glm::vec2 myDirection = myCorners[(edge + 1) % 3] - myFrom;
+							const float mySide = myDirection.x * (myPoint.y - myFrom.y) - myDirection.y * (myPoint.x - myFrom.x);
+
+							myIsInside = mySide > 0.f || (mySide == 0.f && (myDirection.y < 0.f || (myDirection.y == 0.f && myDirection.x > 0.f)));
+						}
+						if (!myIsInside) continue;
+
+						const float myX = myTriangle[0].x - (myNormal.y * (myPoint.x - myTriangle[0].y) + myNormal.z * (myPoint.y - myTriangle[0].z)) / myNormal.x;
+						uint32_t myCrossingValue = myValue;
+						if (myIsTextured)
+						{
+							glm::vec3 myWeights;
+							aValues.findClosestPoint(myTriangleIndex, glm::vec3(myX, myPoint.x, myPoint.y), myWeights);
+							myCrossingValue = aValues.sample(myTriangleIndex, myWeights);
+						}
+
+						myCrossings[(y - myTileMin.x) + (z - myTileMin.y) * myBrickSize].push_back({ myX, mySign, myCrossingValue });
+					}
+				}
+			}
+
+			// voxels with their center between crossings with a winding other than 0 are inside, rows that aren't closed stay empty at the end
+			for (int row = 0; row < myTileRowCount; row++)
+			{
+				std::vector<RowCrossing>& myRow = myCrossings[row];
+				std::sort(myRow.begin(), myRow.end());
+
+				int myWinding = 0;
+				for (size_t i = 0; i + 1 < myRow.size(); i++)
+				{
+					myWinding += myRow[i].sign;
+					if (myWinding == 0) continue;
+
+					const int myBegin = std::max(static_cast<int>(std::ceil(myRow[i].x - 0.5f)), 0);
+					const int myEnd = std::min(static_cast<int>(std::ceil(myRow[i + 1].x - 0.5f)), mySize.x);
+
+					if (myBegin < myEnd)
+					{
+						myTileSpans[tile].push_back({ row, myBegin, myEnd, myRow[i].value });
+					}
+				}
+			}
+		}
+	});
+
+	// every brick a span goes through
+	std::vector<glm::ivec3> myBricks;
+	for (int tile = 0; tile < myTileCount; tile++)
+	{
+		const glm::ivec2 myTile = glm::ivec2(myTileIndices[tile] % myTileGridSize.x, myTileIndices[tile] / myTileGridSize.x);
+
+		std::vector<bool> myHasBrick(myBrickCountX, false);
+		for (const RowSpan& span : myTileSpans[tile])
+		{
+			for (int x = span.begin / myBrickSize; x <= (span.end - 1) / myBrickSize; x++)
+			{
+				myHasBrick[x] = true;
+			}
+		}
+
+		for (int x = 0; x < myBrickCountX; x++)
+		{
+			if (myHasBrick[x]) myBricks.push_back(glm::ivec3(x, myTile.x, myTile.y));
+		}
+	}
+
+	aModel.generateBricks(myBricks, [&](const glm::ivec3& aBrickPosition, uint32_t* aVoxels)
+	{
+		const uint32_t myTileIndex = aBrickPosition.y + aBrickPosition.z * myTileGridSize.x;
+		const size_t myTile = std::lower_bound(myTileIndices.begin(), myTileIndices.end(), myTileIndex) - myTileIndices.begin();
+
+		const int myBrickMinX = aBrickPosition.x * myBrickSize;
+
+		for (const RowSpan& span : myTileSpans[myTile])
+		{
+			const int myBegin = std::max(span.begin, myBrickMinX) - myBrickMinX;
+			const int myEnd = std::min(span.end, myBrickMinX + myBrickSize) - myBrickMinX;
+
+			for (int x = myBegin; x < myEnd; x++)
+			{
+				aVoxels[x + span.row * myBrickSize] = span.value;
+			}
+		}
+
+		return true;
+	}, aThreadCount);
+}
+
+// keeps the voxels of the solid that have an empty neighbour along one of the axes
+// works on the occupancy masks, every mask word is one 8x8 slice of a brick in z with bit x + y * 8
+static VoxelModel hollowModel(const VoxelModel& aSolid, int aThreadCount)
+{
+	constexpr int myBrickSize = VoxelModel::brickSize;
+	constexpr uint64_t myFirstColumn = 0x0101010101010101ull;
+	constexpr uint64_t myLastColumn = myFirstColumn << (myBrickSize - 1);
+
+	VoxelModel myShell(aSolid.sizeX, aSolid.sizeY, aSolid.sizeZ);
+	myShell.transform = aSolid.transform;
+
+	std::vector<glm::ivec3> myBricks(aSolid.getBrickCount());
+	for (int i = 0; i < aSolid.getBrickCount(); i++)
+	{
+		myBricks[i] = aSolid.getBrickPosition(i);
+	}
+
+	const glm::ivec3 myDirections[6] = { glm::ivec3(-1, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(0, -1, 0), glm::ivec3(0, 1, 0), glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 1) };
+	const uint64_t myEmpty[VoxelModel::brickMaskWordCount] = {};
+
+	myShell.generateBricks(myBricks, [&](const glm::ivec3& aBrickPosition, uint32_t* aVoxels)
+	{
+		const int myBrick = aSolid.findBrick(aBrickPosition);
+		const uint32_t* mySolidVoxels = aSolid.getBrickVoxels(myBrick);
+		const uint64_t* mySolid = aSolid.getBrickOccupancy(myBrick);
+
+		// the bricks next to this one, outside the model counts as empty
+		const uint64_t* myNeighbours[6];
+		for (int direction = 0; direction < 6; direction++)
+		{
+			const int myNeighbour = aSolid.findBrick(aBrickPosition + myDirections[direction]);
+			myNeighbours[direction] = myNeighbour >= 0 ? aSolid.getBrickOccupancy(myNeighbour) : myEmpty;
+		}
+
+		bool myHasVoxel = false;
+
+		for (int z = 0; z < myBrickSize; z++)
+		{
+			const uint64_t mySlice = mySolid[z];
+			if (!mySlice) continue;
+
+			// for every voxel, if the voxel next to it is filled
+			const uint64_t myLeft = ((mySlice << 1) & ~myFirstColumn) | ((myNeighbours[0][z] & myLastColumn) >> (myBrickSize - 1));
+			const uint64_t myRight = ((mySlice >> 1) & ~myLastColumn) | ((myNeighbours[1][z] & myFirstColumn) << (myBrickSize - 1));
+			const uint64_t myUp = (mySlice << myBrickSize) | (myNeighbours[2][z] >> (myBrickSize * (myBrickSize - 1)));
+			const uint64_t myDown = (mySlice >> myBrickSize) | (myNeighbours[3][z] << (myBrickSize * (myBrickSize - 1)));
+			const uint64_t myBack = z > 0 ? mySolid[z - 1] : myNeighbours[4][myBrickSize - 1];
+			const uint64_t myFront = z < myBrickSize - 1 ? mySolid[z + 1] : myNeighbours[5][0];
+
+			uint64_t mySurface = mySlice & ~(myLeft & myRight & myUp & myDown & myBack & myFront);
+			myHasVoxel |= mySurface != 0;
+
+			while (mySurface)
+			{
+				const int myVoxel = z * myBrickSize * myBrickSize + findLowestBit(mySurface);
+				aVoxels[myVoxel] = mySolidVoxels[myVoxel];
+				mySurface &= mySurface - 1;
+			}
+		}
+
+		return myHasVoxel;
+	}, aThreadCount);
+
+	return myShell;
+}
+
+// reduces the packed colors of the model to at most aPaletteSize colors with median cut
+// the voxels get aFirstValue + the index of the closest palette color
+static void quantizeColors(VoxelModel& aModel, int aPaletteSize, uint32_t aFirstValue, std::vector<glm::vec3>& aPalette)
+{
+	constexpr uint32_t myColorCount = 1 << 15;
+
+	std::vector<uint32_t> myHistogram(myColorCount, 0);
+	for (int brick = 0; brick < aModel.getBrickCount(); brick++)
+	{
+		const uint32_t* myVoxels = aModel.getBrickVoxels(brick);
+		const uint64_t* myOccupancy = aModel.getBrickOccupancy(brick);
+
+		for (int word = 0; word < VoxelModel::brickMaskWordCount; word++)
+		{
+			for (uint64_t bits = myOccupancy[word]; bits; bits &= bits - 1)
+			{
+				myHistogram[myVoxels[word * 64 + findLowestBit(bits)] - 1]++;
+			}
+		}
+	}
+
+	// the used colors, median cut works on the gamma encoded channels
+	struct ColorCell
+	{
+		glm::ivec3 color;
+		uint32_t count;
+	};
+
+	std::vector<ColorCell> myCells;
+	for (uint32_t color = 0; color < myColorCount; color++)
+	{
+		if (myHistogram[color]) myCells.push_back({ glm::ivec3(color >> 10, (color >> 5) & 31, color & 31), myHistogram[color] });
+	}
+
+	// boxes are ranges of the cells, the box with the most voxels times its longest side is split at its median along that side
+	struct ColorBox
+	{
+		size_t begin;
+		size_t end;
+		int axis;
+		uint64_t priority;
+	};
+
+	auto myMakeBox = [&](size_t aBegin, size_t aEnd)
+	{
+		glm::ivec3 myMin = glm::ivec3(31);
+		glm::ivec3 myMax = glm::ivec3(0);
+		uint64_t myCount = 0;
+
+		for (size_t i = aBegin; i < aEnd; i++)
+		{
+			myMin = glm::min(myMin, myCells[i].color);
+			myMax = glm::max(myMax, myCells[i].color);
+			myCount += myCells[i].count;
+		}
+
+		const glm::ivec3 mySize = myMax - myMin;
+		const int myAxis = mySize.x >= mySize.y && mySize.x >= mySize.z ? 0 : (mySize.y >= mySize.z ? 1 : 2);
+
+		return ColorBox{ aBegin, aEnd, myAxis, myCount * mySize[myAxis] };
+	};
+
+	std::vector<ColorBox> myBoxes;
+	if (!myCells.empty()) myBoxes.push_back(myMakeBox(0, myCells.size()));
+
+	while (static_cast<int>(myBoxes.size()) < aPaletteSize)
+	{
+		auto myLargest = std::max_element(myBoxes.begin(), myBoxes.end(), [](const ColorBox& aA, const ColorBox& aB) { return aA.priority < aB.priority; });
+		if (myLargest->priority == 0) break;
+
+		const ColorBox myBox = *myLargest;
+		std::sort(myCells.begin() + myBox.begin, myCells.begin() + myBox.end, [&](const ColorCell& aA, const ColorCell& aB) { return aA.color[myBox.axis] < aB.color[myBox.axis]; });
+
+		uint64_t myTotal = 0;
+		for (size_t i = myBox.begin; i < myBox.end; i++)
+		{
+			myTotal += myCells[i].count;
+		}
+
+		// both halves keep at least one cell, the box has more than one because its size isn't 0
+		size_t mySplit = myBox.begin + 1;
+		uint64_t myCount = myCells[myBox.begin].count;
+		while (mySplit < myBox.end - 1 && myCount * 2 < myTotal)
+		{
+			myCount += myCells[mySplit++].count;
+		}
+
+		*myLargest = myMakeBox(myBox.begin, mySplit);
+		myBoxes.push_back(myMakeBox(mySplit, myBox.end));
+	}
+
+	// the palette color of a box is the average of its voxels
+	std::vector<glm::vec3> myEncodedPalette;
+	for (const ColorBox& box : myBoxes)
+	{
+		glm::dvec3 mySum = glm::dvec3(0.0);
+		uint64_t myCount = 0;
+
+		for (size_t i = box.begin; i < box.end; i++)
+		{
+			mySum += glm::dvec3(myCells[i].color) * static_cast<double>(myCells[i].count);
+			myCount += myCells[i].count;
+		}
+
+		myEncodedPalette.push_back(glm::vec3(mySum / static_cast<double>(myCount)));
+		aPalette.push_back(glm::pow(myEncodedPalette.back() / 31.f, glm::vec3(2.2f)));
+	}
+
+	// every used color maps to the closest palette color
+	std::vector<uint32_t> myTable(myColorCount + 1, 0);
+	for (const ColorCell& cell : myCells)
+	{
+		float myClosestDistance = FLT_MAX;
+		uint32_t myClosest = 0;
+
+		for (size_t i = 0; i < myEncodedPalette.size(); i++)
+		{
+			const glm::vec3 myDifference = myEncodedPalette[i] - glm::vec3(cell.color);
+			const float myDistance = glm::dot(myDifference, myDifference);
+
+			if (myDistance < myClosestDistance)
+			{
+				myClosestDistance = myDistance;
+				myClosest = static_cast<uint32_t>(i);
+			}
+		}
+
+		myTable[1 + ((cell.color.r << 10) | (cell.color.g << 5) | cell.color.b)] = aFirstValue + myClosest;
+	}
+
+	aModel.remapVoxels(myTable);
+}
+
+static void applyPalette(VoxelModel& aModel, const MeshVoxelizerSettings& aSettings, std::vector<glm::vec3>* aPalette)
+{
+	if (!aSettings.useMaterials) return;
+
+	std::vector<glm::vec3> myPalette;
+	quantizeColors(aModel, aSettings.paletteSize, aSettings.value, myPalette);
+
+	if (aPalette) *aPalette = std::move(myPalette);
+}
+
+VoxelModel voxelizeTriangles(const MeshModel& aMesh, const MeshVoxelizerSettings& aSettings, std::vector<glm::vec3>* aPalette)
+{
+	// vertices in voxel space
+	const glm::vec3 myExtent = aMesh.aabb.getDimensions();
+	const float myLongest = std::max(myExtent.x, std::max(myExtent.y, myExtent.z));
+
+	float myScale = 1.f;
+	if (aSettings.voxelSize > 0.f)
+	{
+		myScale = 1.f / aSettings.voxelSize;
+	}
+	else if (myLongest > 0.f)
+	{
+		myScale = aSettings.resolution / myLongest;
+	}
+
+	glm::ivec3 mySize = glm::ivec3(aSettings.resolution);
+	if (aSettings.voxelSize > 0.f || aSettings.fitBounds)
+	{
+		// the bounds rounded up to whole voxels, a flat mesh still gets one layer
+		mySize = glm::max(glm::ivec3(glm::ceil(myExtent * myScale)), glm::ivec3(1));
+
+		// rounding can't make the longest side larger than the resolution asked for
+		if (aSettings.voxelSize <= 0.f) mySize = glm::min(mySize, glm::ivec3(aSettings.resolution));
+	}
+
+	VoxelModel myModel(mySize.x, mySize.y, mySize.z);
+	myModel.transform = glm::translate(glm::mat4(1.f), aMesh.aabb.min) * glm::scale(glm::mat4(1.f), glm::vec3(1.f / myScale));
+
+	const int myTriangleCount = static_cast<int>(aMesh.triangleCount);
+	if (myTriangleCount == 0) return myModel;
+
+	const glm::ivec3 myBrickGridSize = (mySize + VoxelModel::brickSize - 1) / VoxelModel::brickSize;
+	assert(static_cast<uint64_t>(myBrickGridSize.x) * myBrickGridSize.y * myBrickGridSize.z <= UINT32_MAX);
+
+	int myThreadCount = aSettings.threadCount;
+	if (myThreadCount <= 0)
+	{
+		myThreadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+	myThreadCount = std::min(myThreadCount, myTriangleCount);
+
+	// every vertex is moved once, however many triangles share it
+	VoxelSpaceMesh myVoxelMesh;
+	myVoxelMesh.positions.resize(aMesh.vertexCount);
+	myVoxelMesh.indices = aMesh.indices;
+	myVoxelMesh.triangleCount = myTriangleCount;
+
+	runParallel(static_cast<int>(aMesh.vertexCount), myThreadCount, [&](int aBegin, int aEnd, int)
+	{
+		for (int i = aBegin; i < aEnd; i++)
+		{
+			const float* myPosition = &aMesh.positions[static_cast<size_t>(i) * 3];
+			myVoxelMesh.positions[i] = (glm::vec3(myPosition[0], myPosition[1], myPosition[2]) - aMesh.aabb.min) * myScale;
+		}
+	});
+
+	const TriangleValues myValues(aMesh, myVoxelMesh, aSettings);
+
+	voxelizeSurface(myModel, myVoxelMesh, myValues, myThreadCount);
+
+	if (aSettings.mode != VoxelizeMode::Surface)
+	{
+		// the surface closes the gaps the interior test leaves at the edges of the mesh
+		fillInterior(myModel, myVoxelMesh, myValues, myThreadCount);
+	}
+
+	// only the colors of the voxels that are left go into the palette
+	if (aSettings.mode == VoxelizeMode::Shell)
+	{
+		VoxelModel myShell = hollowModel(myModel, myThreadCount);
+		applyPalette(myShell, aSettings, aPalette);
+
+		return myShell;
+	}
+
+	applyPalette(myModel, aSettings, aPalette);
+
+	return myModel;
+}
@@ -0,0 +1,111 @@
+#include "engine/resourceCache.h"
+#include "engine/logger.h"
+
+void ResourceCache::setBudget(size_t aBytes)
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	budget = aBytes;
+	evict(budget);
+}
+
+size_t ResourceCache::getBudget() const
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	return budget;
+}
+
+size_t ResourceCache::getUsedBytes() const
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	return usedBytes;
+}
+
+int ResourceCache::getResourceCount() const
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	return static_cast<int>(entries.size());
+}
+
+void ResourceCache::clearUnused()
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	evict(0);
+}
+
+std::shared_ptr<void> ResourceCache::findResource(const std::string& aKey)
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	auto myEntry = entryLookup.find(aKey);
+	if (myEntry == entryLookup.end()) return nullptr;
+
+	entries.splice(entries.begin(), entries, myEntry->second);
+
+	return myEntry->second->resource;
+}
+
+std::shared_ptr<void> ResourceCache::insertResource(const std::string& aKey, std::shared_ptr<void> aResource, size_t aBytes)
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	// another thread loaded it first
+	auto myEntry = entryLookup.find(aKey);
+	if (myEntry != entryLookup.end())
+	{
+		entries.splice(entries.begin(), entries, myEntry->second);
+		return myEntry->second->resource;
+	}
+
+	// room is made before adding, so the new resource is never the one that is dropped
+	evict(budget > aBytes ? budget - aBytes : 0);
+
+	entries.push_front({ aKey, aResource, aBytes });
+	entryLookup[aKey] = entries.begin();
+	usedBytes += aBytes;
+
+	if (usedBytes > budget)
+	{
+		LOG_WARNING("resource cache is over its budget, %zu of %zu bytes are in use", usedBytes, budget);
+	}
+
+	return aResource;
+}
+
+std::shared_ptr<void> ResourceCache::takeUnusedResource(const std::string& aKey)
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	auto myEntry = entryLookup.find(aKey);
+
+	// a handle can only be made from the cache while the mutex is held, so a count of 1 can't go up behind our back
+	if (myEntry == entryLookup.end() || myEntry->second->resource.use_count() != 1) return nullptr;
+
+	std::shared_ptr<void> myResource = std::move(myEntry->second->resource);
+
+	usedBytes -= myEntry->second->bytes;
+	entries.erase(myEntry->second);
+	entryLookup.erase(myEntry);
+
+	return myResource;
+}
+
+void ResourceCache::evict(size_t aBytes)
+{
+	auto myEntry = entries.end();
+
+	while (usedBytes > aBytes && myEntry != entries.begin())
+	{
+		--myEntry;
+
+		if (myEntry->resource.use_count() != 1) continue;
+
+		usedBytes -= myEntry->bytes;
+		entryLookup.erase(myEntry->key);
+		myEntry = entries.erase(myEntry);
+	}
+}
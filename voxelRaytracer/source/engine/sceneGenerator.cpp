@@ -0,0 +1,274 @@
+#include "engine/sceneGenerator.h"
+#include "engine/voxelShape.h"
+
+#include <assert.h>
+#include <algorithm>
+
+static constexpr int brickSize = VoxelModel::brickSize;
+
+// hash of a lattice point to a float between 0 and 1
+static float hashToUnit(int aX, int aY, uint32_t aSeed)
+{
+	uint32_t myHash = static_cast<uint32_t>(aX) * 0x8da6b343u ^ static_cast<uint32_t>(aY) * 0xd8163841u ^ aSeed * 0x9e3779b9u;
+	myHash ^= myHash >> 16;
+	myHash *= 0x7feb352du;
+	myHash ^= myHash >> 15;
+	myHash *= 0x846ca68bu;
+	myHash ^= myHash >> 16;
+
+	return static_cast<float>(myHash) / 4294967295.f;
+}
+
+static glm::ivec3 getMaxBrick(const VoxelModel& aModel)
+{
+	return (glm::ivec3(aModel.sizeX, aModel.sizeY, aModel.sizeZ) - 1) / brickSize;
+}
+
+// the largest power of three that fits in the model, with a hole in the middle of every 3x3x3 block at every level
+static void generateMengerSponge(VoxelModel& aModel)
+{
+	int mySpongeSize = 1;
+	while (mySpongeSize * 3 <= aModel.sizeX)
+	{
+		mySpongeSize *= 3;
+	}
+
+	aModel.generateBricks(glm::ivec3(0), glm::ivec3((mySpongeSize - 1) / brickSize), [&](const glm::ivec3& aBrickPosition, uint32_t* aVoxels)
+	{
+		bool myHasVoxel = false;
+
+		for (int i = 0; i < VoxelModel::brickVoxelCount; i++)
+		{
+			const glm::ivec3 myVoxel = aBrickPosition * brickSize + glm::ivec3(i % brickSize, (i / brickSize) % brickSize, i / (brickSize * brickSize));
+			if (myVoxel.x >= mySpongeSize || myVoxel.y >= mySpongeSize || myVoxel.z >= mySpongeSize) continue;
+
+			// a voxel is removed when two of its coordinates are in the middle third at any level
+			bool myIsHole = false;
+			for (int scale = 1; scale < mySpongeSize && !myIsHole; scale *= 3)
+			{
+				const int myMiddleCount = ((myVoxel.x / scale) % 3 == 1) + ((myVoxel.y / scale) % 3 == 1) + ((myVoxel.z / scale) % 3 == 1);
+				myIsHole = myMiddleCount >= 2;
+			}
+
+			if (!myIsHole)
+			{
+				aVoxels[i] = 1;
+				myHasVoxel = true;
+			}
+		}
+
+		return myHasVoxel;
+	});
+}
+
+// a ground block with three octaves of noise on its surface, the noise is 3d so there are overhangs
+static void generateNoiseTerrain(VoxelModel& aModel, const SceneGeneratorSettings& aSettings)
+{
+	const float mySize = static_cast<float>(aSettings.size);
+	const float myGroundHeight = mySize * std::clamp(aSettings.density, 0.f, 1.f);
+
+	VoxelShape myShape;
+	int myTerrain = myShape.addBox(glm::vec3(mySize * 0.5f, mySize - myGroundHeight * 0.5f, mySize * 0.5f), glm::vec3(mySize * 0.5f, myGroundHeight * 0.5f, mySize * 0.5f), 2);
+	myTerrain = myShape.addNoiseDisplacement(myTerrain, mySize * 0.12f, 2.f / mySize, aSettings.seed);
+	myTerrain = myShape.addNoiseDisplacement(myTerrain, mySize * 0.02f, 8.f / mySize, aSettings.seed + 1);
+	myShape.addNoiseDisplacement(myTerrain, 1.5f, 1.f / 8.f, aSettings.seed + 2);
+
+	myShape.voxelize(&aModel);
+}
+
+// an open box with a light in the ceiling, two blocks on the floor and small lights scattered through the room
+static void generateCornellBox(VoxelModel& aModel, const SceneGeneratorSettings& aSettings)
+{
+	const float mySize = static_cast<float>(aSettings.size);
+	const float myWall = std::max(1.f, mySize / 32.f);
+	const float myHalf = mySize * 0.5f;
+
+	VoxelShape myShape;
+
+	// floor, ceiling and back wall are white, the side walls gray, the front is open
+	int myRoom = myShape.addBox(glm::vec3(myHalf, mySize - myWall * 0.5f, myHalf), glm::vec3(myHalf, myWall * 0.5f, myHalf), 1);
+	myRoom = myShape.addUnion(myRoom, myShape.addBox(glm::vec3(myHalf, myWall * 0.5f, myHalf), glm::vec3(myHalf, myWall * 0.5f, myHalf), 1));
+	myRoom = myShape.addUnion(myRoom, myShape.addBox(glm::vec3(myHalf, myHalf, mySize - myWall * 0.5f), glm::vec3(myHalf, myHalf, myWall * 0.5f), 1));
+	myRoom = myShape.addUnion(myRoom, myShape.addBox(glm::vec3(myWall * 0.5f, myHalf, myHalf), glm::vec3(myWall * 0.5f, myHalf, myHalf), 2));
+	myRoom = myShape.addUnion(myRoom, myShape.addBox(glm::vec3(mySize - myWall * 0.5f, myHalf, myHalf), glm::vec3(myWall * 0.5f, myHalf, myHalf), 2));
+
+	// the light replaces the middle of the ceiling
+	const float myLightHalf = (myHalf - myWall) * std::sqrt(std::clamp(aSettings.density, 0.f, 1.f));
+	if (myLightHalf >= 0.5f)
+	{
+		myRoom = myShape.addUnion(myRoom, myShape.addBox(glm::vec3(myHalf, myWall * 0.5f, myHalf), glm::vec3(myLightHalf, myWall * 0.5f + 0.5f, myLightHalf), 3));
+	}
+
+	// a tall and a short block
+	const float myFloor = mySize - myWall;
+	myRoom = myShape.addUnion(myRoom, myShape.addBox(glm::vec3(mySize * 0.33f, myFloor - mySize * 0.3f, mySize * 0.62f), glm::vec3(mySize * 0.12f, mySize * 0.3f, mySize * 0.12f), 1));
+	myRoom = myShape.addUnion(myRoom, myShape.addBox(glm::vec3(mySize * 0.66f, myFloor - mySize * 0.15f, mySize * 0.35f), glm::vec3(mySize * 0.12f, mySize * 0.15f, mySize * 0.12f), 1));
+
+	const float myLightRadius = std::max(1.f, mySize / 64.f);
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec3 myPosition = glm::vec3(hashToUnit(i, 0, aSettings.seed), hashToUnit(i, 1, aSettings.seed), hashToUnit(i, 2, aSettings.seed)) * (mySize - myWall * 2.f) + myWall;
+		myRoom = myShape.addUnion(myRoom, myShape.addSphere(myPosition, myLightRadius, 4));
+	}
+
+	myShape.voxelize(&aModel);
+}
+
+// square lots split by streets, every building has one voxel thick walls and a floor every brickSize voxels
+static void generateCity(VoxelModel& aModel, const SceneGeneratorSettings& aSettings)
+{
+	const int mySize = aSettings.size;
+	const int myGroundThickness = std::max(1, mySize / 64);
+	const int myGround = mySize - myGroundThickness;
+
+	const int myLotSize = std::max(16, mySize / 16);
+	const int myStreet = myLotSize / 4;
+	const int myMaxHeight = myGround - 1;
+
+	// height of the building on a lot, 0 for an empty lot
+	auto myGetHeight = [&](int aLotX, int aLotZ)
+	{
+		if (hashToUnit(aLotX, aLotZ, aSettings.seed) >= aSettings.density) return 0;
+
+		const float myHeight = mySize * (0.1f + 0.6f * hashToUnit(aLotX, aLotZ, aSettings.seed + 1));
+		return std::min(static_cast<int>(myHeight), myMaxHeight);
+	};
+
+	aModel.generateBricks(glm::ivec3(0), getMaxBrick(aModel), [&](const glm::ivec3& aBrickPosition, uint32_t* aVoxels)
+	{
+		const glm::ivec3 myBrickMin = aBrickPosition * brickSize;
+
+		// lots are at least two bricks wide, so a brick touches at most two lots along every axis
+		int myTallest = 0;
+		for (int lotZ = myBrickMin.z / myLotSize; lotZ <= (myBrickMin.z + brickSize - 1) / myLotSize; lotZ++)
+		{
+			for (int lotX = myBrickMin.x / myLotSize; lotX <= (myBrickMin.x + brickSize - 1) / myLotSize; lotX++)
+			{
+				myTallest = std::max(myTallest, myGetHeight(lotX, lotZ));
+			}
+		}
+
+		// above every roof and not in the ground
+		if (myBrickMin.y + brickSize <= myGround - myTallest) return false;
+
+		bool myHasVoxel = false;
+
+		for (int i = 0; i < VoxelModel::brickVoxelCount; i++)
+		{
+			const glm::ivec3 myVoxel = myBrickMin + glm::ivec3(i % brickSize, (i / brickSize) % brickSize, i / (brickSize * brickSize));
+
+			if (myVoxel.y >= myGround)
+			{
+				aVoxels[i] = 2;
+				myHasVoxel = true;
+				continue;
+			}
+
+			const int myHeight = myGetHeight(myVoxel.x / myLotSize, myVoxel.z / myLotSize);
+			const int myDepth = myGround - myVoxel.y;
+			if (myDepth > myHeight) continue;
+
+			// position in the lot, the street runs along the low side
+			const int myLotX = myVoxel.x % myLotSize - myStreet;
+			const int myLotZ = myVoxel.z % myLotSize - myStreet;
+			const int myWidth = myLotSize - myStreet;
+			if (myLotX < 0 || myLotZ < 0) continue;
+
+			const bool myIsWall = myLotX == 0 || myLotZ == 0 || myLotX == myWidth - 1 || myLotZ == myWidth - 1;
+			const bool myIsFloor = myDepth % brickSize == 0 || myDepth == myHeight;
+
+			if (myIsWall || myIsFloor)
+			{
+				aVoxels[i] = 1;
+				myHasVoxel = true;
+			}
+		}
+
+		return myHasVoxel;
+	});
+}
+
+// thin nested spheres with holes, so rays go through many mostly empty bricks
+static void generateHollowShells(VoxelModel& aModel, const SceneGeneratorSettings& aSettings)
+{
+	const float myHalf = aSettings.size * 0.5f;
+	const glm::vec3 myCenter = glm::vec3(myHalf);
+	const int myShellCount = std::max(1, static_cast<int>(std::clamp(aSettings.density, 0.f, 1.f) * 16.f));
+
+	const float myMinRadius = myHalf * 0.1f;
+	const float myMaxRadius = myHalf * 0.95f;
+	const float myThickness = std::max(1.f, aSettings.size / 256.f);
+
+	VoxelShape myShape;
+	int myShells = -1;
+
+	for (int i = 0; i < myShellCount; i++)
+	{
+		const float myRadius = myShellCount == 1 ? myMaxRadius : myMinRadius + (myMaxRadius - myMinRadius) * i / (myShellCount - 1);
+
+		int myShell = myShape.addSubtraction(myShape.addSphere(myCenter, myRadius, 1 + (i & 1)), myShape.addSphere(myCenter, myRadius - myThickness, 1));
+
+		// three holes per shell in random directions
+		for (int hole = 0; hole < 3; hole++)
+		{
+			const float myAngle = hashToUnit(i, hole * 2, aSettings.seed) * 6.2831853f;
+			const float myHeight = hashToUnit(i, hole * 2 + 1, aSettings.seed) * 2.f - 1.f;
+			const float myRing = std::sqrt(1.f - myHeight * myHeight);
+			const glm::vec3 myDirection = glm::vec3(myRing * std::cos(myAngle), myHeight, myRing * std::sin(myAngle));
+
+			myShell = myShape.addSubtraction(myShell, myShape.addSphere(myCenter + myDirection * myRadius, myRadius * 0.3f, 1));
+		}
+
+		myShells = myShells == -1 ? myShell : myShape.addUnion(myShells, myShell);
+	}
+
+	myShape.voxelize(&aModel);
+}
+
+VoxelModel generateScene(GeneratedScene aScene, const SceneGeneratorSettings& aSettings)
+{
+	assert(aSettings.size > 0);
+
+	VoxelModel myModel(aSettings.size, aSettings.size, aSettings.size);
+
+	switch (aScene)
+	{
+	case GeneratedScene::MengerSponge:
+		generateMengerSponge(myModel);
+		break;
+	case GeneratedScene::RandomFill:
+		initRandomVoxels(&myModel, 1, aSettings.density, aSettings.seed);
+		break;
+	case GeneratedScene::NoiseTerrain:
+		generateNoiseTerrain(myModel, aSettings);
+		break;
+	case GeneratedScene::CornellBox:
+		generateCornellBox(myModel, aSettings);
+		break;
+	case GeneratedScene::City:
+		generateCity(myModel, aSettings);
+		break;
+	case GeneratedScene::HollowShells:
+		generateHollowShells(myModel, aSettings);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+
+	return myModel;
+}
+
+const char* getGeneratedSceneName(GeneratedScene aScene)
+{
+	switch (aScene)
+	{
+	case GeneratedScene::MengerSponge: return "menger sponge";
+	case GeneratedScene::RandomFill: return "random fill";
+	case GeneratedScene::NoiseTerrain: return "noise terrain";
+	case GeneratedScene::CornellBox: return "cornell box";
+	case GeneratedScene::City: return "city";
+	case GeneratedScene::HollowShells: return "hollow shells";
+	default: return "unknown";
+	}
+}
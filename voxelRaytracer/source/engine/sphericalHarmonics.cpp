@@ -0,0 +1,105 @@
+#include "engine/sphericalHarmonics.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/common.hpp>
+
+constexpr float pi = 3.14159265358979f;
+
+// the basis functions, kept the same as the shaders
+static void evaluateBasis(const glm::vec3& aDirection, float* aValues)
+{
+	const float x = aDirection.x;
+	const float y = aDirection.y;
+	const float z = aDirection.z;
+
+	aValues[0] = 0.282095f;
+
+	aValues[1] = 0.488603f * y;
+	aValues[2] = 0.488603f * z;
+	aValues[3] = 0.488603f * x;
+
+	aValues[4] = 1.092548f * x * y;
+	aValues[5] = 1.092548f * y * z;
+	aValues[6] = 0.315392f * (3.f * z * z - 1.f);
+	aValues[7] = 1.092548f * x * z;
+	aValues[8] = 0.546274f * (x * x - y * y);
+}
+
+static float srgbToLinear(float aValue)
+{
+	aValue = std::min(std::max(aValue, 0.f), 1.f);
+
+	return aValue < 0.04045f ? aValue / 12.92f : std::pow((aValue + 0.055f) / 1.055f, 2.4f);
+}
+
+glm::vec3 evaluateIrradiance(const SHIrradiance& aIrradiance, const glm::vec3& aNormal)
+{
+	float myBasis[9];
+	evaluateBasis(aNormal, myBasis);
+
+	glm::vec3 myResult{ 0.f };
+	for (int i = 0; i < 9; i++)
+	{
+		myResult += aIrradiance.coefficients[i] * myBasis[i];
+	}
+
+	// the few coefficients ring around bright spots like the sun
+	return glm::max(myResult, glm::vec3(0.f));
+}
+
+SHIrradiance projectSkydomeIrradiance(const Texture& aSkydome, int aMaxWidth)
+{
+	assert(aSkydome.format == TextureFormat::RGB9E5 && aSkydome.textureData);
+
+	// skip to the level
+	const uint32_t* myTexels = static_cast<const uint32_t*>(aSkydome.textureData);
+	int myWidth = aSkydome.textureWidth;
+	int myHeight = aSkydome.textureHeight;
+
+	for (int level = 1; level < aSkydome.mipCount && myWidth > aMaxWidth; level++)
+	{
+		myTexels += static_cast<size_t>(myWidth) * myHeight;
+
+		myWidth = std::max(myWidth / 2, 1);
+		myHeight = std::max(myHeight / 2, 1);
+	}
+
+	SHIrradiance myIrradiance{};
+	float myBasis[9];
+
+	for (int y = 0; y < myHeight; y++)
+	{
+		// v = acos(-direction.y) / pi, every texel of a row covers the same solid angle
+		const float myTheta = (y + 0.5f) / myHeight * pi;
+		const float mySolidAngle = (2.f * pi / myWidth) * (pi / myHeight) * std::sin(myTheta);
+
+		for (int x = 0; x < myWidth; x++)
+		{
+			// u = atan2(direction.z, direction.x) / (2 pi) + 0.5
+			const float myPhi = ((x + 0.5f) / myWidth - 0.5f) * 2.f * pi;
+			const glm::vec3 myDirection = glm::vec3(std::sin(myTheta) * std::cos(myPhi), -std::cos(myTheta), std::sin(myTheta) * std::sin(myPhi));
+
+			const glm::vec3 myTexel = decodeRGB9E5(myTexels[static_cast<size_t>(y) * myWidth + x]);
+			const glm::vec3 myRadiance = glm::vec3(srgbToLinear(myTexel.r), srgbToLinear(myTexel.g), srgbToLinear(myTexel.b)) * 2.f;
+
+			evaluateBasis(myDirection, myBasis);
+
+			for (int i = 0; i < 9; i++)
+			{
+				myIrradiance.coefficients[i] += myRadiance * (myBasis[i] * mySolidAngle);
+			}
+		}
+	}
+
+	// the cosine lobe per band is pi, 2 pi / 3 and pi / 4, divided by pi for the reflected light
+	const float myBandScales[3] = { 1.f, 2.f / 3.f, 0.25f };
+	for (int i = 0; i < 9; i++)
+	{
+		myIrradiance.coefficients[i] *= myBandScales[i == 0 ? 0 : i < 4 ? 1 : 2];
+	}
+
+	return myIrradiance;
+}
@@ -0,0 +1,203 @@
+#include "engine/taskGraph.h"
+
+#include <assert.h>
+#include <algorithm>
+
+TaskGraph::~TaskGraph()
+{
+	stop();
+}
+
+void TaskGraph::start(int aThreadCount)
+{
+	assert(workers.empty());
+
+	if (aThreadCount <= 0)
+	{
+		aThreadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	shouldStop = false;
+
+	for (int i = 0; i < aThreadCount; i++)
+	{
+		workers.emplace_back(&TaskGraph::workerLoop, this);
+	}
+}
+
+void TaskGraph::stop()
+{
+	{
+		std::lock_guard<std::mutex> myLock(mutex);
+		shouldStop = true;
+	}
+
+	workAvailable.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	workers.clear();
+}
+
+TaskId TaskGraph::addTask(const char* aName, std::function<void()> aWork, const std::vector<TaskId>& aDependencies, std::function<void()> aOnComplete)
+{
+	std::unique_ptr<Task> myTask = std::make_unique<Task>();
+	myTask->name = aName;
+	myTask->work = std::move(aWork);
+	myTask->onComplete = std::move(aOnComplete);
+
+	TaskId myId;
+
+	{
+		std::lock_guard<std::mutex> myLock(mutex);
+
+		myId = static_cast<TaskId>(tasks.size());
+
+		for (TaskId dependency : aDependencies)
+		{
+			assert(dependency >= 0 && dependency < myId);
+
+			// dependencies that are already done don't have to be waited for
+			if (tasks[dependency]->isFinished) continue;
+
+			tasks[dependency]->dependents.push_back(myId);
+			myTask->waitingDependencyCount++;
+		}
+
+		const bool myIsReady = myTask->waitingDependencyCount == 0;
+
+		tasks.push_back(std::move(myTask));
+		pendingTaskCount++;
+
+		if (myIsReady)
+		{
+			readyTasks.push_back(myId);
+		}
+	}
+
+	workAvailable.notify_one();
+
+	return myId;
+}
+
+void TaskGraph::runCompletions()
+{
+	std::vector<TaskId> myCompletedTasks;
+
+	{
+		std::lock_guard<std::mutex> myLock(mutex);
+		myCompletedTasks.swap(completedTasks);
+	}
+
+	for (TaskId task : myCompletedTasks)
+	{
+		std::function<void()> myOnComplete;
+
+		{
+			std::lock_guard<std::mutex> myLock(mutex);
+			myOnComplete = std::move(tasks[task]->onComplete);
+		}
+
+		// the lock isn't held, so the callback can add tasks
+		if (myOnComplete) myOnComplete();
+
+		std::lock_guard<std::mutex> myLock(mutex);
+		pendingTaskCount--;
+	}
+}
+
+bool TaskGraph::isFinished(TaskId aTask) const
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	assert(aTask >= 0 && aTask < static_cast<TaskId>(tasks.size()));
+	return tasks[aTask]->isFinished;
+}
+
+bool TaskGraph::isIdle() const
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	return pendingTaskCount == 0;
+}
+
+const char* TaskGraph::getPendingTaskName() const
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	for (const std::unique_ptr<Task>& task : tasks)
+	{
+		if (!task->isFinished) return task->name;
+	}
+
+	return nullptr;
+}
+
+int TaskGraph::getPendingTaskCount() const
+{
+	std::lock_guard<std::mutex> myLock(mutex);
+
+	return pendingTaskCount;
+}
+
+void TaskGraph::waitIdle()
+{
+	// without workers nothing would finish
+	assert(!workers.empty());
+
+	while (true)
+	{
+		runCompletions();
+
+		std::unique_lock<std::mutex> myLock(mutex);
+
+		if (pendingTaskCount == 0) return;
+
+		taskCompleted.wait(myLock, [this]() { return !completedTasks.empty(); });
+	}
+}
+
+void TaskGraph::workerLoop()
+{
+	std::unique_lock<std::mutex> myLock(mutex);
+
+	while (true)
+	{
+		workAvailable.wait(myLock, [this]() { return shouldStop || !readyTasks.empty(); });
+
+		if (shouldStop) return;
+
+		const TaskId myId = readyTasks.front();
+		readyTasks.pop_front();
+
+		// tasks are stored by pointer, so the task stays in place when other threads add tasks
+		Task& myTask = *tasks[myId];
+		std::function<void()> myWork = std::move(myTask.work);
+
+		myLock.unlock();
+
+		if (myWork) myWork();
+
+		// the captures of the work are released before the task is marked as done
+		myWork = nullptr;
+
+		myLock.lock();
+
+		myTask.isFinished = true;
+		completedTasks.push_back(myId);
+
+		for (TaskId dependent : myTask.dependents)
+		{
+			if (--tasks[dependent]->waitingDependencyCount == 0)
+			{
+				readyTasks.push_back(dependent);
+				workAvailable.notify_one();
+			}
+		}
+
+		taskCompleted.notify_all();
+	}
+}
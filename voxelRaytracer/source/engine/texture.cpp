@@ -1 +1,62 @@
 #include "engine/texture.h"
+
+#include <algorithm>
+#include <cmath>
+
+// 9 bit mantissas without an implied 1 and an exponent bias of 15
+constexpr int rgb9e5MantissaBits = 9;
+constexpr int rgb9e5ExponentBias = 15;
+constexpr float rgb9e5MaxValue = 65408.f;
+
+int getFullMipCount(int aWidth, int aHeight)
+{
+	int myCount = 1;
+	for (int mySize = std::max(aWidth, aHeight); mySize > 1; mySize /= 2)
+	{
+		myCount++;
+	}
+
+	return myCount;
+}
+
+uint32_t encodeRGB9E5(const glm::vec3& aColor)
+{
+	float myColor[3];
+	for (int i = 0; i < 3; i++)
+	{
+		// written so nans fail the test
+		myColor[i] = aColor[i] > 0.f ? std::min(aColor[i], rgb9e5MaxValue) : 0.f;
+	}
+
+	const float myMax = std::max(myColor[0], std::max(myColor[1], myColor[2]));
+	if (myMax == 0.f) return 0;
+
+	// the exponent of the largest component, frexp gives a fraction in [0.5, 1)
+	int myExponent;
+	std::frexp(myMax, &myExponent);
+
+	int mySharedExponent = std::max(myExponent - 1, -rgb9e5ExponentBias - 1) + 1 + rgb9e5ExponentBias;
+	float myScale = std::ldexp(1.f, rgb9e5ExponentBias + rgb9e5MantissaBits - mySharedExponent);
+
+	// rounding can push the largest mantissa to 512, then the exponent goes up one
+	if (static_cast<int>(std::floor(myMax * myScale + 0.5f)) == 1 << rgb9e5MantissaBits)
+	{
+		mySharedExponent++;
+		myScale *= 0.5f;
+	}
+
+	uint32_t myValue = static_cast<uint32_t>(mySharedExponent) << 27;
+	for (int i = 0; i < 3; i++)
+	{
+		myValue |= static_cast<uint32_t>(std::floor(myColor[i] * myScale + 0.5f)) << (i * rgb9e5MantissaBits);
+	}
+
+	return myValue;
+}
+
+glm::vec3 decodeRGB9E5(uint32_t aValue)
+{
+	const float myScale = std::ldexp(1.f, static_cast<int>(aValue >> 27) - rgb9e5ExponentBias - rgb9e5MantissaBits);
+
+	return glm::vec3(static_cast<float>(aValue & 0x1ff), static_cast<float>((aValue >> 9) & 0x1ff), static_cast<float>((aValue >> 18) & 0x1ff)) * myScale;
+}
@@ -0,0 +1,549 @@
+#include "engine/voxFile.h"
+#include "engine/mappedFile.h"
+#include "engine/logger.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <glm/glm.hpp>
+
+// "VOX "
+constexpr uint32_t voxFileMagic = 0x20584f56;
+
+// scene graphs deeper than this are treated as broken
+constexpr int maxSceneDepth = 64;
+
+// larger than magicavoxel makes them, files past these are treated as broken so the sums below can't overflow
+constexpr int maxModelSize = 1 << 12;
+constexpr int maxTranslation = 1 << 20;
+constexpr int maxResultSize = 1 << 16;
+
+// a model of the file, the voxels point into the mapped file
+struct VoxFileModel
+{
+	glm::ivec3 size;
+
+	// 4 bytes per voxel, x y z and the palette index
+	const uint8_t* voxels;
+	uint32_t voxelCount;
+};
+
+// rotation of a scene node, every row has one entry of 1 or -1
+struct VoxTransform
+{
+	glm::ivec3 rows[3]{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+	glm::ivec3 translation{ 0 };
+
+	glm::ivec3 rotate(const glm::ivec3& aVector) const
+	{
+		return glm::ivec3(
+			rows[0].x * aVector.x + rows[0].y * aVector.y + rows[0].z * aVector.z,
+			rows[1].x * aVector.x + rows[1].y * aVector.y + rows[1].z * aVector.z,
+			rows[2].x * aVector.x + rows[2].y * aVector.y + rows[2].z * aVector.z);
+	}
+
+	// aLocal applied first
+	VoxTransform combine(const VoxTransform& aLocal) const
+	{
+		VoxTransform myResult;
+
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+			{
+				myResult.rows[row][column] = rows[row].x * aLocal.rows[0][column] + rows[row].y * aLocal.rows[1][column] + rows[row].z * aLocal.rows[2][column];
+			}
+		}
+
+		myResult.translation = rotate(aLocal.translation) + translation;
+
+		return myResult;
+	}
+};
+
+struct VoxSceneNode
+{
+	enum class Type { Transform, Group, Shape };
+
+	Type type;
+	VoxTransform transform;
+
+	// the child of a transform, the children of a group
+	std::vector<int> children;
+	// the model of a shape
+	int model{ -1 };
+};
+
+// a model placed in the world, the voxels are moved by -pivot before they are transformed
+struct VoxInstance
+{
+	int model;
+	VoxTransform transform;
+	glm::ivec3 pivot;
+};
+
+// reads the file piece by piece, every read fails once the data runs out
+class VoxReader
+{
+public:
+	VoxReader(const uint8_t* aData, size_t aSize) : data(aData), end(aData + aSize) {};
+
+	bool readInt(int32_t& aValue)
+	{
+		if (end - data < 4) return false;
+
+		memcpy(&aValue, data, 4);
+		data += 4;
+
+		return true;
+	}
+
+	bool readString(std::string& aString)
+	{
+		int32_t mySize;
+		if (!readInt(mySize) || mySize < 0 || end - data < mySize) return false;
+
+		aString.assign(reinterpret_cast<const char*>(data), static_cast<size_t>(mySize));
+		data += mySize;
+
+		return true;
+	}
+
+	// the keys and values of a dictionary, only the ones the importer uses are kept
+	bool readDictionary(std::string* aTranslation, std::string* aRotation)
+	{
+		int32_t myPairCount;
+		if (!readInt(myPairCount) || myPairCount < 0) return false;
+
+		std::string myKey;
+		std::string myValue;
+
+		for (int i = 0; i < myPairCount; i++)
+		{
+			if (!readString(myKey) || !readString(myValue)) return false;
+
+			if (aTranslation && myKey == "_t") *aTranslation = myValue;
+			if (aRotation && myKey == "_r") *aRotation = myValue;
+		}
+
+		return true;
+	}
+
+	bool skip(size_t aBytes)
+	{
+		if (static_cast<size_t>(end - data) < aBytes) return false;
+
+		data += aBytes;
+
+		return true;
+	}
+
+	const uint8_t* getData() const { return data; }
+	size_t getBytesLeft() const { return static_cast<size_t>(end - data); }
+private:
+	const uint8_t* data;
+	const uint8_t* end;
+};
+
+// the palette magicavoxel uses when a file has no RGBA chunk, a 6x6x6 color cube without black followed by ramps of red, green, blue and gray
+static void getDefaultPalette(uint32_t* aPalette)
+{
+	int myIndex = 0;
+	aPalette[myIndex++] = 0;
+
+	for (int r = 5; r >= 0; r--)
+	{
+		for (int g = 5; g >= 0; g--)
+		{
+			for (int b = 5; b >= 0; b--)
+			{
+				if (!r && !g && !b) continue;
+
+				aPalette[myIndex++] = 0xff000000u | (b * 0x33u) << 16 | (g * 0x33u) << 8 | (r * 0x33u);
+			}
+		}
+	}
+
+	const uint32_t myRampValues[10] = { 0xee, 0xdd, 0xbb, 0xaa, 0x88, 0x77, 0x55, 0x44, 0x22, 0x11 };
+
+	for (uint32_t value : myRampValues) aPalette[myIndex++] = 0xff000000u | value;
+	for (uint32_t value : myRampValues) aPalette[myIndex++] = 0xff000000u | value << 8;
+	for (uint32_t value : myRampValues) aPalette[myIndex++] = 0xff000000u | value << 16;
+	for (uint32_t value : myRampValues) aPalette[myIndex++] = 0xff000000u | value << 16 | value << 8 | value;
+}
+
+// "_r" stores the column of the nonzero entry of the first two rows in bits 0-1 and 2-3, the signs of the rows are bits 4-6
+static bool decodeRotation(int aBits, VoxTransform& aTransform)
+{
+	const int myFirstColumn = aBits & 3;
+	const int mySecondColumn = (aBits >> 2) & 3;
+
+	if (myFirstColumn > 2 || mySecondColumn > 2 || myFirstColumn == mySecondColumn) return false;
+
+	const int myColumns[3] = { myFirstColumn, mySecondColumn, 3 - myFirstColumn - mySecondColumn };
+
+	for (int row = 0; row < 3; row++)
+	{
+		aTransform.rows[row] = glm::ivec3(0);
+		aTransform.rows[row][myColumns[row]] = (aBits >> (4 + row)) & 1 ? -1 : 1;
+	}
+
+	return true;
+}
+
+static bool readTransformNode(VoxReader& aReader, VoxSceneNode& aNode)
+{
+	int32_t myReserved;
+	int32_t myLayer;
+	int32_t myFrameCount;
+	int32_t myChild;
+
+	if (!aReader.readDictionary(nullptr, nullptr) || !aReader.readInt(myChild) || !aReader.readInt(myReserved) || !aReader.readInt(myLayer) || !aReader.readInt(myFrameCount)) return false;
+
+	aNode.type = VoxSceneNode::Type::Transform;
+	aNode.children.push_back(myChild);
+
+	// only the first frame of an animation is used
+	for (int frame = 0; frame < myFrameCount; frame++)
+	{
+		std::string myTranslation;
+		std::string myRotation;
+
+		if (!aReader.readDictionary(&myTranslation, &myRotation)) return false;
+		if (frame) continue;
+
+		if (!myTranslation.empty())
+		{
+			glm::ivec3& myValue = aNode.transform.translation;
+			if (sscanf(myTranslation.c_str(), "%d %d %d", &myValue.x, &myValue.y, &myValue.z) != 3) return false;
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (myValue[axis] < -maxTranslation || myValue[axis] > maxTranslation) return false;
+			}
+		}
+
+		if (!myRotation.empty() && !decodeRotation(atoi(myRotation.c_str()), aNode.transform)) return false;
+	}
+
+	return true;
+}
+
+static bool readGroupNode(VoxReader& aReader, VoxSceneNode& aNode)
+{
+	int32_t myChildCount;
+	if (!aReader.readDictionary(nullptr, nullptr) || !aReader.readInt(myChildCount) || myChildCount < 0) return false;
+
+	aNode.type = VoxSceneNode::Type::Group;
+
+	for (int i = 0; i < myChildCount; i++)
+	{
+		int32_t myChild;
+		if (!aReader.readInt(myChild)) return false;
+
+		aNode.children.push_back(myChild);
+	}
+
+	return true;
+}
+
+static bool readShapeNode(VoxReader& aReader, VoxSceneNode& aNode)
+{
+	int32_t myModelCount;
+	if (!aReader.readDictionary(nullptr, nullptr) || !aReader.readInt(myModelCount) || myModelCount < 0) return false;
+
+	aNode.type = VoxSceneNode::Type::Shape;
+
+	// more than one model is an animation, the first one is used
+	for (int i = 0; i < myModelCount; i++)
+	{
+		int32_t myModel;
+		if (!aReader.readInt(myModel) || !aReader.readDictionary(nullptr, nullptr)) return false;
+
+		if (!i) aNode.model = myModel;
+	}
+
+	return true;
+}
+
+// every node is visited once, magicavoxel never shares nodes and a broken file that does can't blow up or loop
+static void collectInstances(const std::unordered_map<int, VoxSceneNode>& aNodes, const std::vector<VoxFileModel>& aModels, int aNode, const VoxTransform& aTransform, int aDepth, std::unordered_set<int>& aVisited, std::vector<VoxInstance>& aInstances)
+{
+	auto myNode = aNodes.find(aNode);
+	if (myNode == aNodes.end() || aDepth > maxSceneDepth || !aVisited.insert(aNode).second) return;
+
+	const VoxSceneNode& myData = myNode->second;
+
+	if (myData.type == VoxSceneNode::Type::Shape)
+	{
+		if (myData.model >= 0 && myData.model < static_cast<int>(aModels.size()))
+		{
+			// magicavoxel turns models around their center
+			aInstances.push_back({ myData.model, aTransform, aModels[myData.model].size / 2 });
+		}
+
+		return;
+	}
+
+	const VoxTransform myTransform = myData.type == VoxSceneNode::Type::Transform ? aTransform.combine(myData.transform) : aTransform;
+
+	for (int child : myData.children)
+	{
+		collectInstances(aNodes, aModels, child, myTransform, aDepth + 1, aVisited, aInstances);
+	}
+}
+
+VoxelModel loadVoxFile(const char* aFileName, VoxelAtlas* aAtlas)
+{
+	MappedFile myFile;
+	if (!myFile.open(aFileName))
+	{
+		LOG_ERROR("could not open vox file %s", aFileName);
+		return VoxelModel();
+	}
+
+	VoxReader myReader(myFile.getData(), myFile.getSize());
+
+	int32_t myMagic;
+	int32_t myVersion;
+	int32_t myContentSize;
+	int32_t myChildrenSize;
+	char myChunkId[4];
+
+	const bool myHasHeader = myReader.readInt(myMagic) && myReader.readInt(myVersion) && static_cast<uint32_t>(myMagic) == voxFileMagic &&
+		myReader.getBytesLeft() >= 4 && memcmp(myReader.getData(), "MAIN", 4) == 0 && myReader.skip(4) &&
+		myReader.readInt(myContentSize) && myReader.readInt(myChildrenSize) && myContentSize >= 0 && myReader.skip(static_cast<size_t>(myContentSize));
+
+	if (!myHasHeader)
+	{
+		LOG_ERROR("%s is not a vox file", aFileName);
+		return VoxelModel();
+	}
+
+	std::vector<VoxFileModel> myModels;
+	std::unordered_map<int, VoxSceneNode> myNodes;
+
+	uint32_t myPalette[256];
+	getDefaultPalette(myPalette);
+
+	glm::ivec3 mySize{ 0 };
+	bool myIsBroken = false;
+
+	// the children of MAIN, chunks the importer doesn't know are skipped
+	while (myReader.getBytesLeft() && !myIsBroken)
+	{
+		if (myReader.getBytesLeft() < 4)
+		{
+			myIsBroken = true;
+			break;
+		}
+
+		memcpy(myChunkId, myReader.getData(), 4);
+		myReader.skip(4);
+
+		if (!myReader.readInt(myContentSize) || !myReader.readInt(myChildrenSize) || myContentSize < 0 || myChildrenSize < 0 ||
+			myReader.getBytesLeft() < static_cast<size_t>(myContentSize) + static_cast<size_t>(myChildrenSize))
+		{
+			myIsBroken = true;
+			break;
+		}
+
+		VoxReader myContent(myReader.getData(), static_cast<size_t>(myContentSize));
+		myReader.skip(static_cast<size_t>(myContentSize) + static_cast<size_t>(myChildrenSize));
+
+		if (memcmp(myChunkId, "SIZE", 4) == 0)
+		{
+			myIsBroken = !myContent.readInt(mySize.x) || !myContent.readInt(mySize.y) || !myContent.readInt(mySize.z) || mySize.x <= 0 || mySize.y <= 0 || mySize.z <= 0 ||
+				mySize.x > maxModelSize || mySize.y > maxModelSize || mySize.z > maxModelSize;
+		}
+		else if (memcmp(myChunkId, "XYZI", 4) == 0)
+		{
+			// belongs to the SIZE chunk before it
+			int32_t myVoxelCount;
+			myIsBroken = !mySize.x || !myContent.readInt(myVoxelCount) || myVoxelCount < 0 || myContent.getBytesLeft() < static_cast<size_t>(myVoxelCount) * 4;
+
+			if (!myIsBroken)
+			{
+				myModels.push_back({ mySize, myContent.getData(), static_cast<uint32_t>(myVoxelCount) });
+				mySize = glm::ivec3(0);
+			}
+		}
+		else if (memcmp(myChunkId, "RGBA", 4) == 0)
+		{
+			// color i of the chunk is palette index i + 1, index 0 is empty
+			myIsBroken = myContent.getBytesLeft() < 256 * 4;
+
+			if (!myIsBroken)
+			{
+				memcpy(myPalette + 1, myContent.getData(), 255 * 4);
+			}
+		}
+		else if (memcmp(myChunkId, "nTRN", 4) == 0 || memcmp(myChunkId, "nGRP", 4) == 0 || memcmp(myChunkId, "nSHP", 4) == 0)
+		{
+			int32_t myNodeId;
+			VoxSceneNode myNode;
+
+			myIsBroken = !myContent.readInt(myNodeId);
+
+			if (!myIsBroken)
+			{
+				if (myChunkId[1] == 'T') myIsBroken = !readTransformNode(myContent, myNode);
+				else if (myChunkId[1] == 'G') myIsBroken = !readGroupNode(myContent, myNode);
+				else myIsBroken = !readShapeNode(myContent, myNode);
+			}
+
+			if (!myIsBroken)
+			{
+				myNodes[myNodeId] = std::move(myNode);
+			}
+		}
+	}
+
+	if (myIsBroken)
+	{
+		LOG_ERROR("vox file %s is broken", aFileName);
+		return VoxelModel();
+	}
+
+	// files without a scene graph have their models at the origin
+	std::vector<VoxInstance> myInstances;
+
+	if (myNodes.empty())
+	{
+		for (int model = 0; model < static_cast<int>(myModels.size()); model++)
+		{
+			myInstances.push_back({ model, VoxTransform(), glm::ivec3(0) });
+		}
+	}
+	else
+	{
+		std::unordered_set<int> myVisited;
+		collectInstances(myNodes, myModels, 0, VoxTransform(), 0, myVisited, myInstances);
+	}
+
+	if (myInstances.empty())
+	{
+		LOG_WARNING("vox file %s has no models", aFileName);
+		return VoxelModel();
+	}
+
+	// bounds of the placed models in the space of the file, from the corners of the models
+	glm::ivec3 myMin{ INT32_MAX };
+	glm::ivec3 myMax{ INT32_MIN };
+
+	for (const VoxInstance& instance : myInstances)
+	{
+		const glm::ivec3 myModelSize = myModels[instance.model].size;
+
+		for (int corner = 0; corner < 8; corner++)
+		{
+			const glm::ivec3 myCorner = glm::ivec3(corner & 1 ? myModelSize.x - 1 : 0, corner & 2 ? myModelSize.y - 1 : 0, corner & 4 ? myModelSize.z - 1 : 0);
+			const glm::ivec3 myPosition = instance.transform.rotate(myCorner - instance.pivot) + instance.transform.translation;
+
+			myMin = glm::min(myMin, myPosition);
+			myMax = glm::max(myMax, myPosition);
+		}
+	}
+
+	const glm::ivec3 myExtent = myMax - myMin;
+	if (myExtent.x >= maxResultSize || myExtent.y >= maxResultSize || myExtent.z >= maxResultSize)
+	{
+		LOG_ERROR("the models of vox file %s are spread too far apart", aFileName);
+		return VoxelModel();
+	}
+
+	// palette indices to atlas items, only the colors that are used get an item
+	uint32_t myAtlasItems[256] = {};
+	std::vector<uint8_t> myUsedColors;
+
+	for (const VoxInstance& instance : myInstances)
+	{
+		const VoxFileModel& myModel = myModels[instance.model];
+
+		for (uint32_t voxel = 0; voxel < myModel.voxelCount; voxel++)
+		{
+			const uint8_t myColor = myModel.voxels[voxel * 4 + 3];
+			if (myColor && !myAtlasItems[myColor])
+			{
+				myAtlasItems[myColor] = 1;
+				myUsedColors.push_back(myColor);
+			}
+		}
+	}
+
+	// added in palette order, so a file always gets the same items
+	std::sort(myUsedColors.begin(), myUsedColors.end());
+
+	const size_t myFirstItem = aAtlas->getItemCount();
+	const size_t myItemCount = std::min(myUsedColors.size(), VoxelAtlas::maxItemCount - myFirstItem);
+
+	std::vector<glm::vec3> myItemColors;
+
+	for (size_t i = 0; i < myUsedColors.size(); i++)
+	{
+		const uint32_t myRgba = myPalette[myUsedColors[i]];
+
+		// the palette is srgb, the atlas is linear
+		const glm::vec3 myColor = glm::pow(glm::vec3(myRgba & 0xff, (myRgba >> 8) & 0xff, (myRgba >> 16) & 0xff) / 255.f, glm::vec3(2.2f));
+
+		if (i < myItemCount)
+		{
+			VoxelAtlasItem myItem;
+			myItem.colorAndRoughness = glm::vec4(myColor, 1.f);
+
+			aAtlas->addItem(myItem);
+			myItemColors.push_back(myColor);
+
+			myAtlasItems[myUsedColors[i]] = static_cast<uint32_t>(myFirstItem + i);
+			continue;
+		}
+
+		// the atlas is full, the color gets the closest item that was added
+		size_t myClosest = 0;
+		for (size_t item = 1; item < myItemColors.size(); item++)
+		{
+			const glm::vec3 myOffset = myItemColors[item] - myColor;
+			const glm::vec3 myClosestOffset = myItemColors[myClosest] - myColor;
+
+			if (glm::dot(myOffset, myOffset) < glm::dot(myClosestOffset, myClosestOffset)) myClosest = item;
+		}
+
+		myAtlasItems[myUsedColors[i]] = myItemColors.empty() ? 0 : static_cast<uint32_t>(myFirstItem + myClosest);
+	}
+
+	if (myItemCount < myUsedColors.size())
+	{
+		LOG_WARNING("the voxel atlas is full, %zu colors of %s use the closest color instead", myUsedColors.size() - myItemCount, aFileName);
+	}
+
+	// file x y z becomes x -z y
+	VoxelModel myResult(myMax.x - myMin.x + 1, myMax.z - myMin.z + 1, myMax.y - myMin.y + 1);
+
+	for (const VoxInstance& instance : myInstances)
+	{
+		const VoxFileModel& myModel = myModels[instance.model];
+
+		for (uint32_t voxel = 0; voxel < myModel.voxelCount; voxel++)
+		{
+			const uint8_t* myVoxel = myModel.voxels + voxel * 4;
+			const glm::ivec3 myLocal = glm::ivec3(myVoxel[0], myVoxel[1], myVoxel[2]);
+
+			// voxels outside of their model would land outside of the result
+			if (myLocal.x >= myModel.size.x || myLocal.y >= myModel.size.y || myLocal.z >= myModel.size.z) continue;
+
+			const uint32_t myValue = myAtlasItems[myVoxel[3]];
+			if (!myValue) continue;
+
+			const glm::ivec3 myPosition = instance.transform.rotate(myLocal - instance.pivot) + instance.transform.translation;
+
+			myResult.setVoxel(myPosition.x - myMin.x, myMax.z - myPosition.z, myPosition.y - myMin.y, myValue);
+		}
+	}
+
+	return myResult;
+}
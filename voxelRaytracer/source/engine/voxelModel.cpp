@@ -1,109 +1,460 @@
 #include "engine/voxelModel.h"
+#include "engine/voxelShape.h"
 #include <random>
 #include <assert.h>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
-VoxelModel::VoxelModel(int aSizeX, int aSizeY, int aSizeZ) :
-	sizeX(aSizeX), sizeY(aSizeY), sizeZ(aSizeZ),
-	dataSize(aSizeX * aSizeY * aSizeZ)
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, aValue can't be 0
+static inline int findLowestBit(uint64_t aValue)
+{
+#ifdef _MSC_VER
+	unsigned long myIndex;
+	_BitScanForward64(&myIndex, aValue);
+	return static_cast<int>(myIndex);
+#else
+	return __builtin_ctzll(aValue);
+#endif
+}
+
+static inline int countBits(uint64_t aValue)
 {
-	data = new uint32_t[dataSize]{ 0 };
+#ifdef _MSC_VER
+	return static_cast<int>(__popcnt64(aValue));
+#else
+	return __builtin_popcountll(aValue);
+#endif
 }
 
-VoxelModel::~VoxelModel()
+VoxelModel::VoxelModel(int aSizeX, int aSizeY, int aSizeZ) :
+	sizeX(aSizeX), sizeY(aSizeY), sizeZ(aSizeZ)
 {}
 
-void VoxelModel::combineModel(int aX, int aY, int aZ, VoxelModel * aModel)
+void VoxelModel::combineModel(int aX, int aY, int aZ, const VoxelModel* aModel)
 {
-	//find bounds of voxel model
-	int minX = std::clamp(aX, 0, sizeX);
-	int minY = std::clamp(aY, 0, sizeY);
-	int minZ = std::clamp(aZ, 0, sizeZ);
+	// only the filled voxels of the model are visited, the ones outside of this model are dropped
+	for (const Voxel& voxel : *aModel)
+	{
+		const int myX = voxel.x + aX;
+		const int myY = voxel.y + aY;
+		const int myZ = voxel.z + aZ;
 
-	int maxX = std::clamp(aX + aModel->sizeX, 0, sizeX);
-	int maxY = std::clamp(aY + aModel->sizeY, 0, sizeY);
-	int maxZ = std::clamp(aZ + aModel->sizeZ, 0, sizeZ);
+		if (myX < 0 || myY < 0 || myZ < 0 || myX >= sizeX || myY >= sizeY || myZ >= sizeZ) continue;
 
-	/*assert(aX + aModel->sizeX <= sizeX);
-	assert(aY + aModel->sizeY <= sizeY);
-	assert(aZ + aModel->sizeZ <= sizeZ);*/
+		setVoxel(myX, myY, myZ, voxel.value);
+	}
+}
+
+void VoxelModel::combineModel(int aX, int aY, int aZ, VoxelModel&& aModel)
+{
+	const bool myIsAligned = aX % brickSize == 0 && aY % brickSize == 0 && aZ % brickSize == 0;
+	const bool myFits = aX >= 0 && aY >= 0 && aZ >= 0 && aX + aModel.sizeX <= sizeX && aY + aModel.sizeY <= sizeY && aZ + aModel.sizeZ <= sizeZ;
 
-	for (int i = minX; i < maxX; i++)
+	if (!brickPositions.empty() || !myIsAligned || !myFits)
 	{
-		for (int j = minY; j < maxY; j++)
-		{
-			for (int k = minZ; k < maxZ; k++)
-			{
-				// don't fill empty voxels
-				if (!aModel->getVoxel(i - aX, j - aY, k - aZ)) continue;
+		combineModel(aX, aY, aZ, &aModel);
+		return;
+	}
 
-				setVoxel(i, j, k, aModel->getVoxel(i - aX, j - aY, k - aZ));
-			}
-		}
+	// the voxels stay where they are, only the brick positions move
+	const glm::ivec3 myBrickOffset = glm::ivec3(aX, aY, aZ) / brickSize;
+
+	brickVoxels = std::move(aModel.brickVoxels);
+	brickOccupancy = std::move(aModel.brickOccupancy);
+	brickPositions = std::move(aModel.brickPositions);
+
+	brickTable.clear();
+	for (int i = 0; i < getBrickCount(); i++)
+	{
+		brickPositions[i] += myBrickOffset;
+		brickTable.findOrInsert(brickPositions[i], i);
 	}
+
+	aModel.brickVoxels.clear();
+	aModel.brickOccupancy.clear();
+	aModel.brickPositions.clear();
+	aModel.brickTable.clear();
 }
 
 uint32_t VoxelModel::getVoxel(int aX, int aY, int aZ) const
 {
-	return data[aX + aY * sizeX + aZ * sizeX * sizeY];
+	const int myBrickIndex = findBrick(glm::ivec3(aX, aY, aZ) / brickSize);
+	if (myBrickIndex == -1) return 0;
+
+	const int myVoxelIndex = (aX % brickSize) + (aY % brickSize) * brickSize + (aZ % brickSize) * brickSize * brickSize;
+
+	return brickVoxels[static_cast<size_t>(myBrickIndex) * brickVoxelCount + myVoxelIndex];
 }
 
 void VoxelModel::setVoxel(int aX, int aY, int aZ, uint32_t aValue)
 {
-	assert(aX + aY * sizeX + aZ * sizeX * sizeY < sizeX * sizeY * sizeZ);
+	assert(aX >= 0 && aY >= 0 && aZ >= 0 && aX < sizeX && aY < sizeY && aZ < sizeZ);
 
-	data[aX + aY * sizeX + aZ * sizeX * sizeY] = aValue;
+	const glm::ivec3 myBrickPosition = glm::ivec3(aX, aY, aZ) / brickSize;
+
+	// clearing a voxel in empty space changes nothing, bricks that become empty are kept
+	int myBrickIndex = findBrick(myBrickPosition);
+	if (myBrickIndex == -1)
+	{
+		if (!aValue) return;
+
+		myBrickIndex = findOrCreateBrick(myBrickPosition);
+	}
+
+	const int myVoxelIndex = (aX % brickSize) + (aY % brickSize) * brickSize + (aZ % brickSize) * brickSize * brickSize;
+
+	brickVoxels[static_cast<size_t>(myBrickIndex) * brickVoxelCount + myVoxelIndex] = aValue;
+
+	uint64_t& myMaskWord = brickOccupancy[static_cast<size_t>(myBrickIndex) * brickMaskWordCount + (myVoxelIndex >> 6)];
+	if (aValue)
+	{
+		myMaskWord |= uint64_t(1) << (myVoxelIndex & 63);
+	}
+	else
+	{
+		myMaskWord &= ~(uint64_t(1) << (myVoxelIndex & 63));
+	}
 }
 
-void initRandomVoxels(VoxelModel* aModel, int aVoxelIndex, int aFillAmount)
+void VoxelModel::combineBrick(const glm::ivec3& aBrickPosition, const uint32_t* aVoxels)
 {
-	for (int i = 0; i < aModel->sizeX * aModel->sizeY * aModel->sizeZ; i++)
+	uint64_t myMask[brickMaskWordCount] = {};
+	for (int i = 0; i < brickVoxelCount; i++)
+	{
+		if (aVoxels[i]) myMask[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+
+	bool myHasVoxel = false;
+	for (const uint64_t word : myMask)
+	{
+		myHasVoxel |= word != 0;
+	}
+	if (!myHasVoxel) return;
+
+	const int myBrickIndex = findOrCreateBrick(aBrickPosition);
+
+	uint32_t* myVoxels = &brickVoxels[static_cast<size_t>(myBrickIndex) * brickVoxelCount];
+	uint64_t* myOccupancy = &brickOccupancy[static_cast<size_t>(myBrickIndex) * brickMaskWordCount];
+
+	for (int word = 0; word < brickMaskWordCount; word++)
 	{
-		bool myFilled = rand() % aFillAmount;
+		myOccupancy[word] |= myMask[word];
 
-		if (!myFilled)
+		for (uint64_t bits = myMask[word]; bits; bits &= bits - 1)
 		{
-			aModel->data[i] = aVoxelIndex;
+			const int myVoxelIndex = word * 64 + findLowestBit(bits);
+			myVoxels[myVoxelIndex] = aVoxels[myVoxelIndex];
 		}
 	}
 }
 
-void initFilled(VoxelModel* aModel, int aVoxelIndex)
+void VoxelModel::remapVoxels(const std::vector<uint32_t>& aTable)
 {
-	for (int i = 0; i < aModel->sizeX * aModel->sizeY * aModel->sizeZ; i++)
+	for (size_t word = 0; word < brickOccupancy.size(); word++)
 	{
-		aModel->data[i] = aVoxelIndex;
+		for (uint64_t bits = brickOccupancy[word]; bits; bits &= bits - 1)
+		{
+			uint32_t& myVoxel = brickVoxels[word * 64 + findLowestBit(bits)];
+
+			assert(myVoxel < aTable.size() && aTable[myVoxel]);
+			myVoxel = aTable[myVoxel];
+		}
 	}
 }
 
-void placeFilledSphere(VoxelModel* aModel, int aX, int aY, int aZ, float aRadius, uint32_t aValue)
+void VoxelModel::generateBricks(const glm::ivec3& aMinBrick, const glm::ivec3& aMaxBrick, const BrickGenerator& aGenerator, int aThreadCount)
 {
-	//find bounds of sphere
-	int minX = floor(std::clamp(aX - aRadius, 0.f, static_cast<float>(aModel->sizeX)));
-	int minY = floor(std::clamp(aY - aRadius, 0.f, static_cast<float>(aModel->sizeY)));
-	int minZ = floor(std::clamp(aZ - aRadius, 0.f, static_cast<float>(aModel->sizeZ)));
+	const glm::ivec3 myMinBrick = glm::max(aMinBrick, glm::ivec3(0));
+	const glm::ivec3 myMaxBrick = glm::min(aMaxBrick, (glm::ivec3(sizeX, sizeY, sizeZ) - 1) / brickSize);
 
-	int maxX = ceil(std::clamp(aX + aRadius, 0.f, static_cast<float>(aModel->sizeX)));
-	int maxY = ceil(std::clamp(aY + aRadius, 0.f, static_cast<float>(aModel->sizeY)));
-	int maxZ = ceil(std::clamp(aZ + aRadius, 0.f, static_cast<float>(aModel->sizeZ)));
+	if (myMinBrick.x > myMaxBrick.x || myMinBrick.y > myMaxBrick.y || myMinBrick.z > myMaxBrick.z) return;
 
-	for (int x = minX; x < maxX; x++)
+	// every piece of work is a slab of bricks along z
+	generateBricks(myMaxBrick.z - myMinBrick.z + 1, [&](int aSlab, auto aVisit)
 	{
-		for (int y = minY; y < maxY; y++)
+		for (int y = myMinBrick.y; y <= myMaxBrick.y; y++)
 		{
-			for (int z = minZ; z < maxZ; z++)
+			for (int x = myMinBrick.x; x <= myMaxBrick.x; x++)
 			{
-				int dx = x - aX;
-				int dy = y - aY;
-				int dz = z - aZ;
+				aVisit(glm::ivec3(x, y, myMinBrick.z + aSlab));
+			}
+		}
+	}, aGenerator, aThreadCount);
+}
+
+void VoxelModel::generateBricks(const std::vector<glm::ivec3>& aBrickPositions, const BrickGenerator& aGenerator, int aThreadCount)
+{
+	constexpr int myBricksPerPiece = 64;
+
+	const int myBrickCount = static_cast<int>(aBrickPositions.size());
+
+	generateBricks((myBrickCount + myBricksPerPiece - 1) / myBricksPerPiece, [&](int aPiece, auto aVisit)
+	{
+		for (int i = aPiece * myBricksPerPiece; i < std::min(myBrickCount, (aPiece + 1) * myBricksPerPiece); i++)
+		{
+			assert(aBrickPositions[i].x >= 0 && aBrickPositions[i].x * brickSize < sizeX);
+			assert(aBrickPositions[i].y >= 0 && aBrickPositions[i].y * brickSize < sizeY);
+			assert(aBrickPositions[i].z >= 0 && aBrickPositions[i].z * brickSize < sizeZ);
+
+			aVisit(aBrickPositions[i]);
+		}
+	}, aGenerator, aThreadCount);
+}
 
-				float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+template<typename GetBricks>
+void VoxelModel::generateBricks(int aWorkCount, GetBricks aGetBricks, const BrickGenerator& aGenerator, int aThreadCount)
+{
+	if (aWorkCount <= 0) return;
 
-				if (dist <= aRadius)
+	if (aThreadCount <= 0)
+	{
+		aThreadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	const glm::ivec3 myModelSize = glm::ivec3(sizeX, sizeY, sizeZ);
+
+	// every piece is only written by the thread that took it, they are combined in order afterwards
+	struct PieceBricks
+	{
+		std::vector<glm::ivec3> positions;
+		std::vector<uint32_t> voxels;
+	};
+
+	std::vector<PieceBricks> myPieces(aWorkCount);
+
+	std::atomic<int> myNextPiece{ 0 };
+
+	auto myWorker = [&]()
+	{
+		uint32_t myVoxels[brickVoxelCount];
+
+		for (int piece = myNextPiece++; piece < aWorkCount; piece = myNextPiece++)
+		{
+			PieceBricks& myPiece = myPieces[piece];
+
+			aGetBricks(piece, [&](const glm::ivec3& aBrickPosition)
+			{
+				std::fill(std::begin(myVoxels), std::end(myVoxels), 0);
+				if (!aGenerator(aBrickPosition, myVoxels)) return;
+
+				// bricks on the edge of the model are only partly in it
+				const glm::ivec3 myEnd = myModelSize - aBrickPosition * brickSize;
+				if (myEnd.x < brickSize || myEnd.y < brickSize || myEnd.z < brickSize)
 				{
-					aModel->setVoxel(x, y, z, aValue);
+					for (int i = 0; i < brickVoxelCount; i++)
+					{
+						if (i % brickSize >= myEnd.x || (i / brickSize) % brickSize >= myEnd.y || i / (brickSize * brickSize) >= myEnd.z)
+						{
+							myVoxels[i] = 0;
+						}
+					}
 				}
+
+				myPiece.positions.push_back(aBrickPosition);
+				myPiece.voxels.insert(myPiece.voxels.end(), std::begin(myVoxels), std::end(myVoxels));
+			});
+		}
+	};
+
+	std::vector<std::thread> myThreads;
+	for (int i = 1; i < std::min(aThreadCount, aWorkCount); i++)
+	{
+		myThreads.emplace_back(myWorker);
+	}
+
+	myWorker();
+
+	for (auto& thread : myThreads)
+	{
+		thread.join();
+	}
+
+	for (PieceBricks& piece : myPieces)
+	{
+		for (size_t i = 0; i < piece.positions.size(); i++)
+		{
+			combineBrick(piece.positions[i], &piece.voxels[i * brickVoxelCount]);
+		}
+
+		// the pieces can be large, free them as soon as they are in the model
+		piece = PieceBricks();
+	}
+}
+
+VoxelModel::Iterator VoxelModel::begin() const
+{
+	return Iterator(this, 0);
+}
+
+VoxelModel::Iterator VoxelModel::end() const
+{
+	return Iterator(this, getBrickCount());
+}
+
+size_t VoxelModel::getVoxelCount() const
+{
+	size_t myCount = 0;
+	for (size_t word = 0; word < brickOccupancy.size(); word++)
+	{
+		myCount += countBits(brickOccupancy[word]);
+	}
+	return myCount;
+}
+
+size_t VoxelModel::getMemoryUsage() const
+{
+	return brickVoxels.size() * sizeof(uint32_t) + brickOccupancy.size() * sizeof(uint64_t) + brickPositions.size() * sizeof(glm::ivec3) + brickTable.getMemoryUsage();
+}
+
+int VoxelModel::getBrickCount() const
+{
+	return static_cast<int>(brickPositions.size());
+}
+
+int VoxelModel::findBrick(const glm::ivec3& aBrickPosition) const
+{
+	const int* myBrickIndex = brickTable.find(aBrickPosition);
+	return myBrickIndex ? *myBrickIndex : -1;
+}
+
+glm::ivec3 VoxelModel::getBrickPosition(int aBrickIndex) const
+{
+	return brickPositions[aBrickIndex];
+}
+
+const uint32_t* VoxelModel::getBrickVoxels(int aBrickIndex) const
+{
+	return &brickVoxels[static_cast<size_t>(aBrickIndex) * brickVoxelCount];
+}
+
+const uint64_t* VoxelModel::getBrickOccupancy(int aBrickIndex) const
+{
+	return &brickOccupancy[static_cast<size_t>(aBrickIndex) * brickMaskWordCount];
+}
+
+int VoxelModel::findOrCreateBrick(const glm::ivec3& aBrickPosition)
+{
+	int& myBrickIndex = brickTable.findOrInsert(aBrickPosition, -1);
+
+	if (myBrickIndex == -1)
+	{
+		myBrickIndex = getBrickCount();
+
+		brickVoxels.resize(brickVoxels.size() + brickVoxelCount, 0);
+		brickOccupancy.resize(brickOccupancy.size() + brickMaskWordCount, 0);
+		brickPositions.push_back(aBrickPosition);
+	}
+
+	return myBrickIndex;
+}
+
+VoxelModel::Iterator::Iterator(const VoxelModel* aModel, int aBrickIndex) :
+	model(aModel), brickIndex(aBrickIndex)
+{
+	findNextVoxel();
+}
+
+VoxelModel::Iterator& VoxelModel::Iterator::operator++()
+{
+	bitIndex++;
+	findNextVoxel();
+
+	return *this;
+}
+
+void VoxelModel::Iterator::findNextVoxel()
+{
+	const int myBrickCount = model->getBrickCount();
+
+	while (brickIndex < myBrickCount)
+	{
+		const uint64_t* myMask = model->getBrickOccupancy(brickIndex);
+
+		// skip to the next set bit in the mask
+		while (bitIndex < brickVoxelCount)
+		{
+			const uint64_t myWord = myMask[bitIndex >> 6] & (~uint64_t(0) << (bitIndex & 63));
+
+			if (myWord)
+			{
+				bitIndex = (bitIndex & ~63) + findLowestBit(myWord);
+
+				const glm::ivec3 myBrickMin = model->getBrickPosition(brickIndex) * brickSize;
+				voxel.x = myBrickMin.x + bitIndex % brickSize;
+				voxel.y = myBrickMin.y + (bitIndex / brickSize) % brickSize;
+				voxel.z = myBrickMin.z + bitIndex / (brickSize * brickSize);
+				voxel.value = model->getBrickVoxels(brickIndex)[bitIndex];
+				return;
 			}
+
+			bitIndex = (bitIndex & ~63) + 64;
 		}
+
+		brickIndex++;
+		bitIndex = 0;
 	}
+
+	// end iterator
+	bitIndex = 0;
+}
+
+void initRandomVoxels(VoxelModel* aModel, int aVoxelIndex, int aFillAmount)
+{
+	initRandomVoxels(aModel, aVoxelIndex, 1.f / aFillAmount, static_cast<uint32_t>(rand()));
+}
+
+void initRandomVoxels(VoxelModel* aModel, int aVoxelIndex, float aDensity, uint32_t aSeed)
+{
+	constexpr int myBrickSize = VoxelModel::brickSize;
+
+	// every voxel hashes its own position, so bricks can be filled on any thread
+	const uint32_t myThreshold = static_cast<uint32_t>(std::clamp(aDensity, 0.f, 1.f) * 4294967295.0);
+	const glm::ivec3 myMaxBrick = (glm::ivec3(aModel->sizeX, aModel->sizeY, aModel->sizeZ) - 1) / myBrickSize;
+
+	aModel->generateBricks(glm::ivec3(0), myMaxBrick, [&](const glm::ivec3& aBrickPosition, uint32_t* aVoxels)
+	{
+		const uint64_t myBrickKey = (static_cast<uint64_t>(aBrickPosition.x) << 42) ^ (static_cast<uint64_t>(aBrickPosition.y) << 21) ^ static_cast<uint64_t>(aBrickPosition.z);
+
+		bool myHasVoxel = false;
+		for (int i = 0; i < VoxelModel::brickVoxelCount; i++)
+		{
+			// splitmix64
+			uint64_t myHash = (myBrickKey * VoxelModel::brickVoxelCount + i) ^ (static_cast<uint64_t>(aSeed) << 32);
+			myHash += 0x9e3779b97f4a7c15ull;
+			myHash = (myHash ^ (myHash >> 30)) * 0xbf58476d1ce4e5b9ull;
+			myHash = (myHash ^ (myHash >> 27)) * 0x94d049bb133111ebull;
+			myHash ^= myHash >> 31;
+
+			if (static_cast<uint32_t>(myHash) < myThreshold)
+			{
+				aVoxels[i] = aVoxelIndex;
+				myHasVoxel = true;
+			}
+		}
+
+		return myHasVoxel;
+	});
+}
+
+void initFilled(VoxelModel* aModel, int aVoxelIndex)
+{
+	// every brick is fully inside the box, so the voxels are filled without evaluating them
+	const glm::vec3 myHalfSize = glm::vec3(aModel->sizeX, aModel->sizeY, aModel->sizeZ) * 0.5f;
+
+	VoxelShape myShape;
+	myShape.addBox(myHalfSize, myHalfSize, aVoxelIndex);
+	myShape.voxelize(aModel);
+}
+
+void placeFilledSphere(VoxelModel* aModel, int aX, int aY, int aZ, float aRadius, uint32_t aValue)
+{
+	// the shape is measured from voxel centers
+	VoxelShape myShape;
+	myShape.addSphere(glm::vec3(aX, aY, aZ) + 0.5f, aRadius, aValue);
+	myShape.voxelize(aModel);
 }
@@ -0,0 +1,303 @@
+#include "engine/voxelModelCache.h"
+#include "engine/hash.h"
+#include "engine/mappedFile.h"
+#include "engine/meshVoxelizer.h"
+#include "engine/logger.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+constexpr const char* voxelModelCachePath = "saves/cache/voxelModels/";
+
+// "VOXM", the version goes up when the layout of the files changes so older files are voxelized again
+constexpr uint32_t cacheFileMagic = 0x4d584f56;
+constexpr uint32_t cacheFileVersion = 2;
+
+namespace fs = std::filesystem;
+
+struct CacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	int32_t size[3];
+	uint32_t brickCount;
+	uint64_t valueByteCount;
+	float transform[16];
+};
+
+// index of the lowest set bit, aValue can't be 0
+static inline int findLowestBit(uint64_t aValue)
+{
+#ifdef _MSC_VER
+	unsigned long myIndex;
+	_BitScanForward64(&myIndex, aValue);
+	return static_cast<int>(myIndex);
+#else
+	return __builtin_ctzll(aValue);
+#endif
+}
+
+static std::string getCacheFileName(uint64_t aKey)
+{
+	char myName[32];
+	snprintf(myName, sizeof(myName), "%016llx.vxm", static_cast<unsigned long long>(aKey));
+
+	return std::string(voxelModelCachePath) + myName;
+}
+
+// 7 bits per byte, the high bit says another byte follows
+static void writeVarint(std::vector<uint8_t>& aBytes, uint32_t aValue)
+{
+	while (aValue >= 0x80)
+	{
+		aBytes.push_back(static_cast<uint8_t>(aValue | 0x80));
+		aValue >>= 7;
+	}
+
+	aBytes.push_back(static_cast<uint8_t>(aValue));
+}
+
+// returns false when the value doesn't end before aEnd
+static bool readVarint(const uint8_t*& aBytes, const uint8_t* aEnd, uint32_t& aValue)
+{
+	aValue = 0;
+
+	for (int shift = 0; shift < 32; shift += 7)
+	{
+		if (aBytes == aEnd) return false;
+
+		const uint8_t myByte = *aBytes++;
+		aValue |= static_cast<uint32_t>(myByte & 0x7f) << shift;
+
+		if (!(myByte & 0x80)) return true;
+	}
+
+	return false;
+}
+
+uint64_t hashVoxelModelSource(const char* aFileName, const MeshVoxelizerSettings& aSettings)
+{
+	// the mtl files and textures aren't part of the key, a model colored by them would stay cached after they change
+	assert(!aSettings.useMaterials && "models voxelized with materials can't be cached");
+
+	MappedFile myFile;
+	if (!myFile.open(aFileName)) return 0;
+
+	uint64_t myHash = hashBytes(hashSeed, myFile.getData(), myFile.getSize());
+
+	// the thread count doesn't change the voxels
+	const int32_t mySettings[7] = { static_cast<int32_t>(aSettings.mode), aSettings.resolution, aSettings.fitBounds, static_cast<int32_t>(aSettings.value),
+		aSettings.useMaterials, aSettings.useMaterials ? aSettings.paletteSize : 0, static_cast<int32_t>(meshVoxelizerVersion) };
+	myHash = hashBytes(myHash, mySettings, sizeof(mySettings));
+	myHash = hashBytes(myHash, &aSettings.voxelSize, sizeof(aSettings.voxelSize));
+
+	// 0 means there is no key
+	return myHash ? myHash : 1;
+}
+
+VoxelModel loadCachedVoxelModel(uint64_t aKey)
+{
+	const std::string myFileName = getCacheFileName(aKey);
+
+	MappedFile myFile;
+	if (!myFile.open(myFileName.c_str())) return VoxelModel();
+
+	const uint8_t* myData = myFile.getData();
+	const uint8_t* myEnd = myData + myFile.getSize();
+
+	CacheFileHeader myHeader;
+	if (myFile.getSize() < sizeof(myHeader)) return VoxelModel();
+
+	memcpy(&myHeader, myData, sizeof(myHeader));
+
+	const size_t myPositionByteCount = static_cast<size_t>(myHeader.brickCount) * 3 * sizeof(int32_t);
+	const size_t myMaskByteCount = static_cast<size_t>(myHeader.brickCount) * VoxelModel::brickMaskWordCount * sizeof(uint64_t);
+
+	const bool myIsValid = myHeader.magic == cacheFileMagic && myHeader.version == cacheFileVersion && myHeader.key == aKey &&
+		myFile.getSize() == sizeof(myHeader) + myPositionByteCount + myMaskByteCount + myHeader.valueByteCount;
+
+	if (!myIsValid) return VoxelModel();
+
+	if (myHeader.size[0] <= 0 || myHeader.size[1] <= 0 || myHeader.size[2] <= 0)
+	{
+		LOG_WARNING("voxel model cache file %s has a broken size", myFileName.c_str());
+		return VoxelModel();
+	}
+
+	VoxelModel myModel(myHeader.size[0], myHeader.size[1], myHeader.size[2]);
+	memcpy(&myModel.transform, myHeader.transform, sizeof(myHeader.transform));
+
+	const uint8_t* myPositions = myData + sizeof(myHeader);
+	const uint8_t* myMasks = myPositions + myPositionByteCount;
+	const uint8_t* myValues = myMasks + myMaskByteCount;
+
+	uint32_t myVoxels[VoxelModel::brickVoxelCount];
+
+	uint32_t myRunValue = 0;
+	uint32_t myRunLength = 0;
+
+	for (uint32_t brick = 0; brick < myHeader.brickCount; brick++)
+	{
+		int32_t myPosition[3];
+		memcpy(myPosition, myPositions + static_cast<size_t>(brick) * sizeof(myPosition), sizeof(myPosition));
+
+		uint64_t myMask[VoxelModel::brickMaskWordCount];
+		memcpy(myMask, myMasks + static_cast<size_t>(brick) * sizeof(myMask), sizeof(myMask));
+
+		const glm::ivec3 myBrickPosition = glm::ivec3(myPosition[0], myPosition[1], myPosition[2]);
+		const glm::ivec3 myBrickVoxel = myBrickPosition * VoxelModel::brickSize;
+
+		const bool myIsInside = myBrickVoxel.x >= 0 && myBrickVoxel.y >= 0 && myBrickVoxel.z >= 0 && myBrickVoxel.x < myModel.sizeX && myBrickVoxel.y < myModel.sizeY && myBrickVoxel.z < myModel.sizeZ;
+		if (!myIsInside)
+		{
+			LOG_WARNING("voxel model cache file %s has a brick outside of the model", myFileName.c_str());
+			return VoxelModel();
+		}
+
+		std::fill(std::begin(myVoxels), std::end(myVoxels), 0);
+
+		for (int word = 0; word < VoxelModel::brickMaskWordCount; word++)
+		{
+			for (uint64_t bits = myMask[word]; bits; bits &= bits - 1)
+			{
+				if (!myRunLength)
+				{
+					if (!readVarint(myValues, myEnd, myRunLength) || !readVarint(myValues, myEnd, myRunValue) || !myRunLength || !myRunValue)
+					{
+						LOG_WARNING("voxel model cache file %s has broken values", myFileName.c_str());
+						return VoxelModel();
+					}
+				}
+
+				myVoxels[word * 64 + findLowestBit(bits)] = myRunValue;
+				myRunLength--;
+			}
+		}
+
+		myModel.combineBrick(myBrickPosition, myVoxels);
+	}
+
+	if (myRunLength || myValues != myEnd)
+	{
+		LOG_WARNING("voxel model cache file %s has broken values", myFileName.c_str());
+		return VoxelModel();
+	}
+
+	return myModel;
+}
+
+void saveCachedVoxelModel(uint64_t aKey, const VoxelModel& aModel)
+{
+	std::error_code myError;
+	fs::create_directories(voxelModelCachePath, myError);
+
+	if (myError)
+	{
+		LOG_WARNING("could not create the voxel model cache directory %s", voxelModelCachePath);
+		return;
+	}
+
+	const int myBrickCount = aModel.getBrickCount();
+
+	std::vector<int32_t> myPositions;
+	std::vector<uint64_t> myMasks;
+	myPositions.reserve(static_cast<size_t>(myBrickCount) * 3);
+	myMasks.reserve(static_cast<size_t>(myBrickCount) * VoxelModel::brickMaskWordCount);
+
+	// the values of the filled voxels in brick and mask order, neighbours mostly have the same value so they are stored as runs
+	std::vector<uint8_t> myValues;
+
+	uint32_t myRunValue = 0;
+	uint32_t myRunLength = 0;
+
+	for (int brick = 0; brick < myBrickCount; brick++)
+	{
+		const glm::ivec3 myPosition = aModel.getBrickPosition(brick);
+		myPositions.insert(myPositions.end(), { myPosition.x, myPosition.y, myPosition.z });
+
+		const uint32_t* myVoxels = aModel.getBrickVoxels(brick);
+		const uint64_t* myMask = aModel.getBrickOccupancy(brick);
+
+		for (int word = 0; word < VoxelModel::brickMaskWordCount; word++)
+		{
+			myMasks.push_back(myMask[word]);
+
+			for (int bit = 0; bit < 64; bit++)
+			{
+				if (!(myMask[word] >> bit & 1)) continue;
+
+				const uint32_t myValue = myVoxels[word * 64 + bit];
+				if (myRunLength && myValue == myRunValue)
+				{
+					myRunLength++;
+					continue;
+				}
+
+				if (myRunLength)
+				{
+					writeVarint(myValues, myRunLength);
+					writeVarint(myValues, myRunValue);
+				}
+
+				myRunValue = myValue;
+				myRunLength = 1;
+			}
+		}
+	}
+
+	if (myRunLength)
+	{
+		writeVarint(myValues, myRunLength);
+		writeVarint(myValues, myRunValue);
+	}
+
+	CacheFileHeader myHeader;
+	myHeader.magic = cacheFileMagic;
+	myHeader.version = cacheFileVersion;
+	myHeader.key = aKey;
+	myHeader.size[0] = aModel.sizeX;
+	myHeader.size[1] = aModel.sizeY;
+	myHeader.size[2] = aModel.sizeZ;
+	myHeader.brickCount = static_cast<uint32_t>(myBrickCount);
+	myHeader.valueByteCount = myValues.size();
+	memcpy(myHeader.transform, &aModel.transform, sizeof(myHeader.transform));
+
+	// written next to the real file first, so a file that was cut off is never read
+	const std::string myFileName = getCacheFileName(aKey);
+	const std::string myTempFileName = myFileName + ".tmp";
+
+	{
+		std::ofstream myFile(myTempFileName, std::ios::binary);
+
+		myFile.write(reinterpret_cast<const char*>(&myHeader), sizeof(myHeader));
+		myFile.write(reinterpret_cast<const char*>(myPositions.data()), myPositions.size() * sizeof(int32_t));
+		myFile.write(reinterpret_cast<const char*>(myMasks.data()), myMasks.size() * sizeof(uint64_t));
+		myFile.write(reinterpret_cast<const char*>(myValues.data()), myValues.size());
+
+		if (!myFile)
+		{
+			LOG_WARNING("could not write voxel model cache file %s", myTempFileName.c_str());
+			myFile.close();
+			fs::remove(myTempFileName, myError);
+			return;
+		}
+	}
+
+	fs::rename(myTempFileName, myFileName, myError);
+
+	if (myError)
+	{
+		LOG_WARNING("could not write voxel model cache file %s", myFileName.c_str());
+		fs::remove(myTempFileName, myError);
+	}
+}
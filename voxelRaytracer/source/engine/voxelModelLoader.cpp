@@ -2,9 +2,19 @@
 #include "engine\logger.h"
 
 #include "engine\meshModel.h"
-
-#include <unordered_map>
+#include "engine\meshVoxelizer.h"
+#include "engine\voxelModelCache.h"
+#include "engine\hdrTextureCache.h"
+#include "engine\voxFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
 #include <rapidobj\rapidobj.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -13,202 +23,438 @@
 #include <stb/stb_image.h>
 #pragma warning(pop)
 
-#define VOXELIZER_IMPLEMENTATION
-#include <voxelizer\voxelizer.h>
+// owners of the memory of a loaded resource, the handles point at the mesh or texture inside them
+struct LoadedMesh
+{
+    MeshModel mesh;
+
+    // taken over from the parser, so the vertex data isn't copied
+    rapidobj::Array<float> positions;
+    rapidobj::Array<float> texcoords;
+
+    std::vector<uint32_t> indices;
+    std::vector<int> texcoordIndices;
+    std::vector<int> triangleMaterials;
+
+    // the material textures live as long as the mesh
+    std::vector<ResourceHandle<const Texture>> materialTextures;
+};
 
-// A hash function used to hash a pair of any kind
-struct hash_pair
+struct LoadedTexture
 {
-    template <class T1, class T2>
-    size_t operator()(const std::pair<T1, T2>& p) const
-    {
-        auto hash1 = std::hash<T1>{}(p.first);
-        auto hash2 = std::hash<T2>{}(p.second);
+    LoadedTexture() {};
+    ~LoadedTexture() { stbi_image_free(const_cast<void*>(texture.textureData)); };
 
-        if (hash1 != hash2) {
-            return hash1 ^ hash2;
-        }
+    LoadedTexture(const LoadedTexture& aTexture) = delete;
+    LoadedTexture& operator=(const LoadedTexture& aTexture) = delete;
 
-        // If hash1 == hash2, their XOR is zero.
-        return hash1;
-    }
+    Texture texture;
+};
+
+// the texels are in the mapped cache file, or in texels when the hdr was converted by this run
+struct LoadedHdrTexture
+{
+    Texture texture;
+
+    MappedFile file;
+    std::vector<uint32_t> texels;
 };
 
-static std::unordered_map<const char*, MeshModel> modelMeshes;
-static std::unordered_map<std::pair<const char* , int>, VoxelModel, hash_pair> voxelizedModels;
-static std::unordered_map<const char*, Texture> textures;
-static std::unordered_map<const char*, Texture> hdrTextures;
+// meshes, voxelized models and textures, keyed by their kind, normalized path and the settings they were made with
+static ResourceCache resourceCache;
+
+// the loader can be used from several threads, each lock is held while a resource of its kind loads
+// models and textures use separate locks so a texture can load while a model voxelizes, the model lock also covers the meshes
+static std::mutex modelMutex;
+static std::mutex textureMutex;
+static std::mutex hdrTextureMutex;
 
-void loadModel(const char* aFileName);
-void voxelizeMesh(const char* aFileName, int aResolution);
-void voxelizeMesh2(const char* aFileName, int aResolution, int aFillVoxelIndex = -1);
+std::shared_ptr<LoadedMesh> loadModel(const char* aFileName);
 void ReportError(const rapidobj::Error& error);
 
-void loadTexture(const char* aFileName);
-void loadHdrTexture(const char* aFileName);
+ResourceHandle<const Texture> loadTexture(const std::string& aKey, const std::string& aFileName);
+ResourceHandle<const Texture> loadHdrTexture(const std::string& aKey, const std::string& aFileName);
+ResourceHandle<const Texture> getMaterialTexture(const std::string& aPath);
+
+// the same file given by another path gets the same key
+static std::string getPathKey(const char* aKind, const std::string& aFileName)
+{
+    std::error_code myError;
+    std::filesystem::path myPath = std::filesystem::weakly_canonical(aFileName, myError);
+
+    if (myError)
+    {
+        myPath = std::filesystem::path(aFileName).lexically_normal();
+    }
+
+    return std::string(aKind) + ":" + myPath.generic_string();
+}
 
-VoxelModel* VoxelModelLoader::getModel(const char* aFileName, int aResolution, int aFillVoxelIndex)
+static std::string getModelKey(const char* aFileName, const MeshVoxelizerSettings& aSettings)
 {
-	if (!modelMeshes.count(aFileName))
-	{
-		loadModel(aFileName);
-	}
+    return getPathKey("model", aFileName) + ":" + std::to_string(aSettings.resolution) + ":" + std::to_string(aSettings.voxelSize) + ":" +
+        std::to_string(aSettings.fitBounds) + ":" + std::to_string(aSettings.value);
+}
 
-	if (!voxelizedModels.count({ aFileName, aResolution }))
-	{
-        voxelizeMesh2(aFileName, aResolution, aFillVoxelIndex);
-	}
+static MeshVoxelizerSettings getModelSettings(int aResolution, int aFillVoxelIndex)
+{
+    MeshVoxelizerSettings mySettings;
+    mySettings.resolution = aResolution;
+    mySettings.value = aFillVoxelIndex != -1 ? aFillVoxelIndex : 1;
 
-    return &voxelizedModels[{ aFileName, aResolution }];
+    return mySettings;
 }
 
-Texture* VoxelModelLoader::getTexture(const char* aFileName)
+static MeshVoxelizerSettings getFittedModelSettings(float aVoxelSize, int aFillVoxelIndex)
 {
-    if (!textures.count(aFileName))
+    MeshVoxelizerSettings mySettings;
+    mySettings.voxelSize = aVoxelSize;
+    mySettings.fitBounds = true;
+    mySettings.value = aFillVoxelIndex != -1 ? aFillVoxelIndex : 1;
+
+    return mySettings;
+}
+
+// null when the obj can't be parsed, the model lock has to be held
+static ResourceHandle<const MeshModel> getMesh(const char* aFileName)
+{
+    const std::string myKey = getPathKey("mesh", aFileName);
+
+    if (ResourceHandle<const MeshModel> myMesh = resourceCache.find<const MeshModel>(myKey)) return myMesh;
+
+    std::shared_ptr<LoadedMesh> myLoadedMesh = loadModel(aFileName);
+    if (!myLoadedMesh) return nullptr;
+
+    // the material textures are counted by their own entries
+    const size_t myBytes = (myLoadedMesh->positions.size() + myLoadedMesh->texcoords.size()) * sizeof(float) + myLoadedMesh->indices.size() * sizeof(uint32_t) +
+        (myLoadedMesh->texcoordIndices.size() + myLoadedMesh->triangleMaterials.size()) * sizeof(int) + myLoadedMesh->mesh.materials.size() * sizeof(MeshMaterial);
+
+    return resourceCache.insert(myKey, ResourceHandle<const MeshModel>(myLoadedMesh, &myLoadedMesh->mesh), myBytes);
+}
+
+// reads the model from the disk cache or voxelizes the obj, the model lock has to be held
+static VoxelModel loadVoxelModel(const char* aFileName, const MeshVoxelizerSettings& aSettings)
+{
+    // a model voxelized by an earlier run skips parsing and voxelizing the obj
+    const uint64_t myCacheKey = hashVoxelModelSource(aFileName, aSettings);
+
+    if (myCacheKey)
     {
-        loadTexture(aFileName);
+        VoxelModel myCachedModel = loadCachedVoxelModel(myCacheKey);
+
+        if (myCachedModel.sizeX > 0) return myCachedModel;
     }
 
-    return &textures[aFileName];
+    ResourceHandle<const MeshModel> myMesh = getMesh(aFileName);
+    if (!myMesh)
+    {
+        // the size of a fitted model comes from the mesh, without one it is a single voxel
+        const int mySize = aSettings.voxelSize > 0.f || aSettings.fitBounds ? 1 : aSettings.resolution;
+        return VoxelModel(mySize, mySize, mySize);
+    }
+
+    VoxelModel myModel = voxelizeTriangles(*myMesh, aSettings);
+
+    if (myCacheKey)
+    {
+        saveCachedVoxelModel(myCacheKey, myModel);
+    }
+
+    return myModel;
 }
 
-Texture* VoxelModelLoader::getHdrTexture(const char* aFileName)
+static ResourceHandle<const VoxelModel> getModelWithSettings(const char* aFileName, const MeshVoxelizerSettings& aSettings)
 {
-    if (!hdrTextures.count(aFileName))
+    std::lock_guard<std::mutex> myLock(modelMutex);
+
+    const std::string myKey = getModelKey(aFileName, aSettings);
+
+    if (ResourceHandle<const VoxelModel> myModel = resourceCache.find<const VoxelModel>(myKey)) return myModel;
+
+    ResourceHandle<const VoxelModel> myModel = std::make_shared<VoxelModel>(loadVoxelModel(aFileName, aSettings));
+
+    return resourceCache.insert(myKey, myModel, myModel->getMemoryUsage());
+}
+
+static VoxelModel takeModelWithSettings(const char* aFileName, const MeshVoxelizerSettings& aSettings)
+{
+    std::lock_guard<std::mutex> myLock(modelMutex);
+
+    // a cached model nobody else holds is moved out, otherwise the caller gets a model of its own
+    if (ResourceHandle<VoxelModel> myModel = resourceCache.takeUnused<VoxelModel>(getModelKey(aFileName, aSettings)))
     {
-        loadHdrTexture(aFileName);
+        return std::move(*myModel);
     }
 
-    return &hdrTextures[aFileName];
+    return loadVoxelModel(aFileName, aSettings);
 }
 
-void loadModel(const char* aFileName)
+ResourceHandle<const VoxelModel> VoxelModelLoader::getModel(const char* aFileName, int aResolution, int aFillVoxelIndex)
 {
-    auto result = rapidobj::ParseFile(aFileName);
+    return getModelWithSettings(aFileName, getModelSettings(aResolution, aFillVoxelIndex));
+}
 
-    if (result.error) 
+VoxelModel VoxelModelLoader::takeModel(const char* aFileName, int aResolution, int aFillVoxelIndex)
+{
+    return takeModelWithSettings(aFileName, getModelSettings(aResolution, aFillVoxelIndex));
+}
+
+ResourceHandle<const VoxelModel> VoxelModelLoader::getFittedModel(const char* aFileName, float aVoxelSize, int aFillVoxelIndex)
+{
+    return getModelWithSettings(aFileName, getFittedModelSettings(aVoxelSize, aFillVoxelIndex));
+}
+
+VoxelModel VoxelModelLoader::takeFittedModel(const char* aFileName, float aVoxelSize, int aFillVoxelIndex)
+{
+    return takeModelWithSettings(aFileName, getFittedModelSettings(aVoxelSize, aFillVoxelIndex));
+}
+
+VoxelModel VoxelModelLoader::takeColoredModel(const char* aFileName, int aResolution, VoxelAtlas* aAtlas, int aPaletteSize)
+{
+    // atlas item 0 is empty, so a palette can't start there
+    assert(aAtlas->getItemCount() > 0);
+
+    std::lock_guard<std::mutex> myLock(modelMutex);
+
+    ResourceHandle<const MeshModel> myMesh = getMesh(aFileName);
+    if (!myMesh) return VoxelModel(aResolution, aResolution, aResolution);
+
+    MeshVoxelizerSettings mySettings;
+    mySettings.resolution = aResolution;
+    mySettings.useMaterials = true;
+    mySettings.value = static_cast<uint32_t>(aAtlas->getItemCount());
+    mySettings.paletteSize = std::min(aPaletteSize, static_cast<int>(VoxelAtlas::maxItemCount - aAtlas->getItemCount()));
+
+    std::vector<glm::vec3> myPalette;
+    VoxelModel myModel = voxelizeTriangles(*myMesh, mySettings, &myPalette);
+
+    for (const glm::vec3& color : myPalette)
     {
-        ReportError(result.error);
-        return;
+        VoxelAtlasItem myItem;
+        myItem.colorAndRoughness = glm::vec4(color, 1.f);
+
+        aAtlas->addItem(myItem);
     }
 
-    rapidobj::Triangulate(result);
+    return myModel;
+}
 
-    if (result.error) {
-        ReportError(result.error);
-        return;
-    }
+VoxelModel VoxelModelLoader::takeVoxModel(const char* aFileName, VoxelAtlas* aAtlas)
+{
+    // atlas item 0 is empty, so the colors can't start there
+    assert(aAtlas->getItemCount() > 0);
 
-    AABB myAABB;
-    myAABB.initInvertedInfinity();
+    return loadVoxFile(aFileName, aAtlas);
+}
+
+ResourceHandle<const Texture> VoxelModelLoader::getTexture(const char* aFileName)
+{
+    std::lock_guard<std::mutex> myLock(textureMutex);
 
-    // Temp Buffer.
-    std::vector<float> rawData;
-    int indexOffset = 0;
+    const std::string myKey = getPathKey("texture", aFileName);
 
-    for (int i = 0; i < result.shapes.size(); i++)
+    ResourceHandle<const Texture> myTexture = resourceCache.find<const Texture>(myKey);
+    if (!myTexture)
     {
-        rapidobj::Shape& myShape = result.shapes[i];
+        myTexture = loadTexture(myKey, aFileName);
 
-        for (int f = 0; f < myShape.mesh.num_face_vertices.size(); f++)
+        if (!myTexture)
         {
-            int fv = myShape.mesh.num_face_vertices[f];
-            for (int v = 0; v < fv; v++)
-            {
-                rapidobj::Index idx = myShape.mesh.indices[static_cast<size_t>(indexOffset) + v];
+            LOG_ERROR("could not load texture %s", aFileName);
+        }
+    }
 
-                //only make use of the position data for now
-                rawData.push_back(result.attributes.positions[3 * static_cast<size_t>(idx.position_index) + 0]);
-                rawData.push_back(-result.attributes.positions[3 * static_cast<size_t>(idx.position_index) + 1]);
-                rawData.push_back(result.attributes.positions[3 * static_cast<size_t>(idx.position_index) + 2]);
+    return myTexture;
+}
 
-                glm::vec3 myPosition{ rawData[rawData.size() - 3], rawData[rawData.size() - 2], rawData[rawData.size() - 1] };
+ResourceHandle<const Texture> VoxelModelLoader::getHdrTexture(const char* aFileName)
+{
+    std::lock_guard<std::mutex> myLock(hdrTextureMutex);
 
-                myAABB.growToContain(myPosition);
+    const std::string myKey = getPathKey("hdrTexture", aFileName);
 
-                //rawData.push_back(result.attributes.normals[3 * idx.normal_index + 0]);
-                //rawData.push_back(result.attributes.normals[3 * idx.normal_index + 1]);
-                //rawData.push_back(result.attributes.normals[3 * idx.normal_index + 2]);
-                //rawData.push_back(result.attributes.texcoords[2 * idx.texcoord_index + 0]);
-                //rawData.push_back(result.attributes.texcoords[2 * idx.texcoord_index + 1]);
-            }
-            indexOffset += fv;
+    ResourceHandle<const Texture> myTexture = resourceCache.find<const Texture>(myKey);
+    if (!myTexture)
+    {
+        myTexture = loadHdrTexture(myKey, aFileName);
+
+        if (!myTexture)
+        {
+            LOG_ERROR("could not load texture %s", aFileName);
         }
     }
 
-    MeshModel myModel;
+    return myTexture;
+}
 
-    //one index per xyz
-    myModel.positions = reinterpret_cast<float*>(malloc(rawData.size() * sizeof(float)));
-    memcpy(myModel.positions, rawData.data(), rawData.size() * sizeof(float));
-    myModel.vertexCount = rawData.size() / 3;
+void VoxelModelLoader::setMemoryBudget(size_t aBytes)
+{
+    resourceCache.setBudget(aBytes);
+}
 
-    myModel.aabb = myAABB;
+size_t VoxelModelLoader::getMemoryBudget()
+{
+    return resourceCache.getBudget();
+}
 
-    modelMeshes.insert({ aFileName, myModel });
+size_t VoxelModelLoader::getMemoryUsage()
+{
+    return resourceCache.getUsedBytes();
 }
 
-void voxelizeMesh(const char* aFileName, int aResolution)
+std::shared_ptr<LoadedMesh> loadModel(const char* aFileName)
 {
-    MeshModel myModel = modelMeshes[aFileName];
-    AABB myAABB = myModel.aabb;
+    // rapidobj parses the file on several threads
+    auto result = rapidobj::ParseFile(aFileName);
 
-    VoxelModel myVoxelModel{ aResolution, aResolution, aResolution };
+    if (result.error) 
+    {
+        ReportError(result.error);
+        return nullptr;
+    }
+
+    rapidobj::Triangulate(result);
 
-	// voxelize mesh
-    for (int i = 0; i < myModel.vertexCount; i++)
+    if (result.error) {
+        ReportError(result.error);
+        return nullptr;
+    }
+
+    std::shared_ptr<LoadedMesh> myLoadedMesh = std::make_shared<LoadedMesh>();
+    MeshModel& myModel = myLoadedMesh->mesh;
+
+    // y points down in voxel space
+    rapidobj::Array<float>& myPositions = result.attributes.positions;
+    for (size_t i = 1; i < myPositions.size(); i += 3)
     {
-        glm::vec3 myVertexPosition{ myModel.positions[3 * i], myModel.positions[3 * i + 1], myModel.positions[3 * i + 2] };
+        myPositions[i] = -myPositions[i];
+    }
 
-        glm::vec3 myNormalizedPosition = myAABB.calculateNormalizedPosition(myVertexPosition);
+    const bool myHasTexcoords = result.attributes.texcoords.size() > 0;
+    const bool myHasMaterials = !result.materials.empty();
 
-        int myVoxelX = static_cast<int>((myNormalizedPosition.x - 0.001f) * aResolution);
-        int myVoxelY = static_cast<int>((myNormalizedPosition.y - 0.001f) * aResolution);
-        int myVoxelZ = static_cast<int>((myNormalizedPosition.z - 0.001f) * aResolution);
+    // where the triangles of every shape start, so the shapes can be written at the same time
+    const int myShapeCount = static_cast<int>(result.shapes.size());
+    std::vector<size_t> myShapeStarts(static_cast<size_t>(myShapeCount) + 1, 0);
 
-        myVoxelModel.setVoxel(myVoxelX, myVoxelY, myVoxelZ, 2);
+    for (int shape = 0; shape < myShapeCount; shape++)
+    {
+        // faces are triangles after triangulating
+        myShapeStarts[shape + 1] = myShapeStarts[shape] + result.shapes[shape].mesh.num_face_vertices.size();
     }
 
-    voxelizedModels.insert({ { aFileName, aResolution }, myVoxelModel });
-}
+    const size_t myTriangleCount = myShapeStarts.back();
 
-void voxelizeMesh2(const char* aFileName, int aResolution, int aFillVoxelIndex)
-{
-    MeshModel myModel = modelMeshes[aFileName];
-    
-    // initialize mesh in correct format for voxelization
+    myLoadedMesh->indices.resize(myTriangleCount * 3);
+    if (myHasTexcoords) myLoadedMesh->texcoordIndices.resize(myTriangleCount * 3);
+    if (myHasMaterials) myLoadedMesh->triangleMaterials.resize(myTriangleCount);
+
+    // the bounds only grow around vertices that are used by a triangle
+    std::vector<AABB> myShapeBounds(myShapeCount);
+
+    std::atomic<int> myNextShape{ 0 };
+
+    auto myCopyShapes = [&]()
+    {
+        for (int shape = myNextShape++; shape < myShapeCount; shape = myNextShape++)
+        {
+            const rapidobj::Mesh& myMesh = result.shapes[shape].mesh;
+            const size_t myStart = myShapeStarts[shape];
+
+            AABB& myAABB = myShapeBounds[shape];
+            myAABB.initInvertedInfinity();
+
+            for (size_t corner = 0; corner < myMesh.indices.size(); corner++)
+            {
+                const rapidobj::Index& myIndex = myMesh.indices[corner];
+
+                myLoadedMesh->indices[myStart * 3 + corner] = static_cast<uint32_t>(myIndex.position_index);
+                if (myHasTexcoords) myLoadedMesh->texcoordIndices[myStart * 3 + corner] = myIndex.texcoord_index;
+
+                const float* myPosition = &myPositions[static_cast<size_t>(myIndex.position_index) * 3];
+                myAABB.growToContain(glm::vec3(myPosition[0], myPosition[1], myPosition[2]));
+            }
+
+            if (!myHasMaterials) continue;
+
+            for (size_t face = 0; face < myMesh.num_face_vertices.size(); face++)
+            {
+                myLoadedMesh->triangleMaterials[myStart + face] = myMesh.material_ids.empty() ? -1 : myMesh.material_ids[face];
+            }
+        }
+    };
+
+    const int myThreadCount = std::min(myShapeCount, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+
+    std::vector<std::thread> myThreads;
+    for (int i = 1; i < myThreadCount; i++)
+    {
+        myThreads.emplace_back(myCopyShapes);
+    }
+
+    myCopyShapes();
+
+    for (std::thread& thread : myThreads)
+    {
+        thread.join();
+    }
 
-    vx_mesh_t* myMesh;
-    myMesh = vx_mesh_alloc(myModel.vertexCount, myModel.vertexCount);
+    AABB myAABB;
+    myAABB.initInvertedInfinity();
 
-    // init position data
-    for (int i = 0; i < myModel.vertexCount; i++)
+    for (const AABB& bounds : myShapeBounds)
     {
-        vx_vertex_t myVertex;
-        myVertex.x = myModel.positions[3 * i + 0];
-        myVertex.y = myModel.positions[3 * i + 1];
-        myVertex.z = myModel.positions[3 * i + 2];
+        if (bounds.min.x <= bounds.max.x)
+        {
+            myAABB.growToContain(bounds.min);
+            myAABB.growToContain(bounds.max);
+        }
+    }
+
+    myLoadedMesh->positions = std::move(myPositions);
+    myModel.positions = myLoadedMesh->positions.data();
+    myModel.vertexCount = static_cast<uint32_t>(myLoadedMesh->positions.size() / 3);
 
-        myMesh->vertices[i] = myVertex;
+    myModel.indices = myLoadedMesh->indices.data();
+    myModel.triangleCount = static_cast<uint32_t>(myTriangleCount);
 
-        myMesh->indices[i] = i;
+    if (myHasTexcoords)
+    {
+        myLoadedMesh->texcoords = std::move(result.attributes.texcoords);
+        myModel.texcoords = myLoadedMesh->texcoords.data();
+        myModel.texcoordIndices = myLoadedMesh->texcoordIndices.data();
     }
 
-    unsigned int* data = vx_voxelize_snap_3dgrid(myMesh, aResolution, aResolution, aResolution);
+    if (myHasMaterials)
+    {
+        myModel.triangleMaterials = myLoadedMesh->triangleMaterials.data();
+    }
 
-    VoxelModel myVoxelModel{ aResolution, aResolution, aResolution };
-    myVoxelModel.data = data;
+    // texture paths in the mtl are relative to the obj
+    const std::filesystem::path myFolder = std::filesystem::path(aFileName).parent_path();
 
-    if (aFillVoxelIndex != -1)
+    for (const rapidobj::Material& material : result.materials)
     {
-        //replace all voxels that are filled in with a specific index that isn't 0
-        for (int i = 0; i < myVoxelModel.dataSize; i++)
+        MeshMaterial myMaterial;
+        myMaterial.diffuse = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+
+        if (!material.diffuse_texname.empty())
         {
-            myVoxelModel.data[i] = (!(myVoxelModel.data[i] == 0)) * aFillVoxelIndex;
+            ResourceHandle<const Texture> myTexture = getMaterialTexture((myFolder / material.diffuse_texname).string());
+
+            if (myTexture)
+            {
+                myMaterial.diffuseTexture = myTexture.get();
+                myLoadedMesh->materialTextures.push_back(myTexture);
+            }
         }
+
+        myModel.materials.push_back(myMaterial);
     }
 
-    voxelizedModels.insert({ { aFileName, aResolution }, myVoxelModel });
+    myModel.aabb = myAABB;
+
+    return myLoadedMesh;
 }
 
 // rapidobj error handling
@@ -222,48 +468,89 @@ void ReportError(const rapidobj::Error& error)
     }
 }
 
-void loadTexture(const char* aFileName)
+// always 4 channels so users don't have to check, a file that can't be loaded gives an empty handle
+// failed loads aren't cached, so a file that shows up later is still loaded
+ResourceHandle<const Texture> loadTexture(const std::string& aKey, const std::string& aFileName)
 {
-    // load image
+    std::shared_ptr<LoadedTexture> myLoadedTexture = std::make_shared<LoadedTexture>();
+    Texture& myTexture = myLoadedTexture->texture;
+
     int width;
     int height;
     int comp;
-    unsigned char* data = nullptr;
-    data = stbi_load(aFileName, &width, &height, &comp, 4);
-
-    // assert data is loaded
-    assert(data);
 
-    int totalMemSize = sizeof(unsigned char) * comp * width * height;
+    myTexture.textureData = stbi_load(aFileName.c_str(), &width, &height, &comp, 4);
+    if (!myTexture.textureData) return nullptr;
 
-    Texture myTexture;
+    myTexture.bytesPerPixel = 4;
     myTexture.textureWidth = width;
     myTexture.textureHeight = height;
-    myTexture.bytesPerPixel = comp;
-    myTexture.textureData = data;
 
-    textures.insert({ aFileName, myTexture });
+    const size_t myBytes = static_cast<size_t>(myTexture.textureWidth) * myTexture.textureHeight * myTexture.bytesPerPixel;
+
+    return resourceCache.insert(aKey, ResourceHandle<const Texture>(myLoadedTexture, &myTexture), myBytes);
 }
 
-void loadHdrTexture(const char* aFileName)
+// the hdr is only decoded when the disk cache has no converted copy of it, a file that can't be loaded gives an empty handle
+ResourceHandle<const Texture> loadHdrTexture(const std::string& aKey, const std::string& aFileName)
 {
-    // load image
-    int width;
-    int height;
-    int comp;
-    float* data = nullptr;
-    data = stbi_loadf(aFileName, &width, &height, &comp, 4);
+    std::shared_ptr<LoadedHdrTexture> myLoadedTexture = std::make_shared<LoadedHdrTexture>();
+    Texture& myTexture = myLoadedTexture->texture;
+
+    const uint64_t myCacheKey = hashHdrTextureSource(aFileName.c_str());
 
-    // assert data is loaded
-    assert(data);
+    if (!myCacheKey || !loadCachedHdrTexture(myCacheKey, myLoadedTexture->file, myTexture))
+    {
+        int width;
+        int height;
+        int comp;
 
-    int totalMemSize = sizeof(float) * comp * width * height;
+        float* myPixels = stbi_loadf(aFileName.c_str(), &width, &height, &comp, 4);
 
-    Texture myTexture;
-    myTexture.textureWidth = width;
-    myTexture.textureHeight = height;
-    myTexture.bytesPerPixel = sizeof(float) * 4;
-    myTexture.textureData = data;
+        if (myPixels)
+        {
+            myLoadedTexture->texels = encodeHdrTexture(myPixels, width, height);
+            stbi_image_free(myPixels);
+
+            myTexture.textureData = myLoadedTexture->texels.data();
+            myTexture.textureWidth = width;
+            myTexture.textureHeight = height;
+            myTexture.bytesPerPixel = sizeof(uint32_t);
+            myTexture.format = TextureFormat::RGB9E5;
+            myTexture.mipCount = getFullMipCount(width, height);
+
+            if (myCacheKey)
+            {
+                saveCachedHdrTexture(myCacheKey, myTexture);
+            }
+        }
+    }
+
+    if (!myTexture.textureData) return nullptr;
+
+    // the mapped pages count as well, they are read in once the texture is used
+    const size_t myBytes = myLoadedTexture->texels.size() * sizeof(uint32_t) + myLoadedTexture->file.getSize();
+
+    return resourceCache.insert(aKey, ResourceHandle<const Texture>(myLoadedTexture, &myTexture), myBytes);
+}
+
+// shares the entries of getTexture, both load 4 channels of 8 bits
+ResourceHandle<const Texture> getMaterialTexture(const std::string& aPath)
+{
+    std::lock_guard<std::mutex> myLock(textureMutex);
+
+    const std::string myKey = getPathKey("texture", aPath);
+
+    ResourceHandle<const Texture> myTexture = resourceCache.find<const Texture>(myKey);
+    if (!myTexture)
+    {
+        myTexture = loadTexture(myKey, aPath);
+
+        if (!myTexture)
+        {
+            LOG_WARNING("could not load material texture %s, using the diffuse color", aPath.c_str());
+        }
+    }
 
-    hdrTextures.insert({ aFileName, myTexture });
+    return myTexture;
 }
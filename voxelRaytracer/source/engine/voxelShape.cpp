@@ -0,0 +1,414 @@
+#include "engine/voxelShape.h"
+#include "engine/voxelModel.h"
+
+#include <assert.h>
+#include <algorithm>
+
+// value noise of a hashed integer lattice between -1 and 1
+static inline float hashLattice(int aX, int aY, int aZ, uint32_t aSeed)
+{
+	uint32_t myHash = static_cast<uint32_t>(aX) * 0x8da6b343u ^ static_cast<uint32_t>(aY) * 0xd8163841u ^ static_cast<uint32_t>(aZ) * 0xcb1ab31fu ^ aSeed * 0x9e3779b9u;
+	myHash ^= myHash >> 16;
+	myHash *= 0x7feb352du;
+	myHash ^= myHash >> 15;
+	myHash *= 0x846ca68bu;
+	myHash ^= myHash >> 16;
+
+	return static_cast<float>(myHash) * (2.f / 4294967295.f) - 1.f;
+}
+
+static float valueNoise(const glm::vec3& aPosition, uint32_t aSeed)
+{
+	const glm::vec3 myFloor = glm::floor(aPosition);
+	const glm::ivec3 myCell = glm::ivec3(myFloor);
+
+	// smoothstep weights, the slope of these is at most 1.5
+	const glm::vec3 myFraction = aPosition - myFloor;
+	const glm::vec3 myWeight = myFraction * myFraction * (3.f - 2.f * myFraction);
+
+	float myCorners[8];
+	for (int i = 0; i < 8; i++)
+	{
+		myCorners[i] = hashLattice(myCell.x + (i & 1), myCell.y + ((i >> 1) & 1), myCell.z + (i >> 2), aSeed);
+	}
+
+	const float myX0 = glm::mix(myCorners[0], myCorners[1], myWeight.x);
+	const float myX1 = glm::mix(myCorners[2], myCorners[3], myWeight.x);
+	const float myX2 = glm::mix(myCorners[4], myCorners[5], myWeight.x);
+	const float myX3 = glm::mix(myCorners[6], myCorners[7], myWeight.x);
+
+	return glm::mix(glm::mix(myX0, myX1, myWeight.y), glm::mix(myX2, myX3, myWeight.y), myWeight.z);
+}
+
+// distance to the bounds from outside of them, 0 inside
+static inline float distanceToBounds(const AABB& aBounds, const glm::vec3& aPosition)
+{
+	return glm::length(glm::max(glm::max(aBounds.min - aPosition, aPosition - aBounds.max), 0.f));
+}
+
+// every axis changes at most 1.5 * 2 per lattice cell, so the gradient is at most 3 * sqrt(3)
+static constexpr float valueNoiseLipschitz = 5.197f;
+
+int VoxelShape::addBox(const glm::vec3& aCenter, const glm::vec3& aHalfSize, uint32_t aMaterial)
+{
+	ShapeNode myNode;
+	myNode.type = ShapeType::Box;
+	myNode.positionA = aCenter;
+	myNode.positionB = aHalfSize;
+	myNode.material = aMaterial;
+	myNode.bounds = { aCenter - aHalfSize, aCenter + aHalfSize };
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addSphere(const glm::vec3& aCenter, float aRadius, uint32_t aMaterial)
+{
+	ShapeNode myNode;
+	myNode.type = ShapeType::Sphere;
+	myNode.positionA = aCenter;
+	myNode.radius = aRadius;
+	myNode.material = aMaterial;
+	myNode.bounds = { aCenter - aRadius, aCenter + aRadius };
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addCapsule(const glm::vec3& aStart, const glm::vec3& aEnd, float aRadius, uint32_t aMaterial)
+{
+	ShapeNode myNode;
+	myNode.type = ShapeType::Capsule;
+	myNode.positionA = aStart;
+	myNode.positionB = aEnd;
+	myNode.radius = aRadius;
+	myNode.material = aMaterial;
+	myNode.bounds = { glm::min(aStart, aEnd) - aRadius, glm::max(aStart, aEnd) + aRadius };
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addCylinder(const glm::vec3& aCenter, float aRadius, float aHalfHeight, uint32_t aMaterial)
+{
+	ShapeNode myNode;
+	myNode.type = ShapeType::Cylinder;
+	myNode.positionA = aCenter;
+	myNode.radius = aRadius;
+	myNode.radius2 = aHalfHeight;
+	myNode.material = aMaterial;
+
+	const glm::vec3 myExtent = glm::vec3(aRadius, aHalfHeight, aRadius);
+	myNode.bounds = { aCenter - myExtent, aCenter + myExtent };
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addTorus(const glm::vec3& aCenter, float aMajorRadius, float aMinorRadius, uint32_t aMaterial)
+{
+	ShapeNode myNode;
+	myNode.type = ShapeType::Torus;
+	myNode.positionA = aCenter;
+	myNode.radius = aMajorRadius;
+	myNode.radius2 = aMinorRadius;
+	myNode.material = aMaterial;
+
+	const glm::vec3 myExtent = glm::vec3(aMajorRadius + aMinorRadius, aMinorRadius, aMajorRadius + aMinorRadius);
+	myNode.bounds = { aCenter - myExtent, aCenter + myExtent };
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addUnion(int aShapeA, int aShapeB)
+{
+	const ShapeNode& myA = nodes[aShapeA];
+	const ShapeNode& myB = nodes[aShapeB];
+
+	ShapeNode myNode;
+	myNode.type = ShapeType::Union;
+	myNode.childA = aShapeA;
+	myNode.childB = aShapeB;
+	myNode.bounds = { glm::min(myA.bounds.min, myB.bounds.min), glm::max(myA.bounds.max, myB.bounds.max) };
+	myNode.lipschitz = std::max(myA.lipschitz, myB.lipschitz);
+	myNode.uniformMaterial = myA.uniformMaterial == myB.uniformMaterial ? myA.uniformMaterial : 0;
+	myNode.isBoundedDistance = myA.isBoundedDistance && myB.isBoundedDistance;
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addSubtraction(int aShapeA, int aShapeB)
+{
+	const ShapeNode& myA = nodes[aShapeA];
+	const ShapeNode& myB = nodes[aShapeB];
+
+	ShapeNode myNode;
+	myNode.type = ShapeType::Subtraction;
+	myNode.childA = aShapeA;
+	myNode.childB = aShapeB;
+	myNode.bounds = myA.bounds;
+	myNode.lipschitz = std::max(myA.lipschitz, myB.lipschitz);
+	myNode.uniformMaterial = myA.uniformMaterial;
+	myNode.isBoundedDistance = myA.isBoundedDistance;
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addIntersection(int aShapeA, int aShapeB)
+{
+	const ShapeNode& myA = nodes[aShapeA];
+	const ShapeNode& myB = nodes[aShapeB];
+
+	// the bounds can end up inverted, nothing is voxelized then
+	ShapeNode myNode;
+	myNode.type = ShapeType::Intersection;
+	myNode.childA = aShapeA;
+	myNode.childB = aShapeB;
+	myNode.bounds = { glm::max(myA.bounds.min, myB.bounds.min), glm::min(myA.bounds.max, myB.bounds.max) };
+	myNode.lipschitz = std::max(myA.lipschitz, myB.lipschitz);
+	myNode.uniformMaterial = myA.uniformMaterial == myB.uniformMaterial ? myA.uniformMaterial : 0;
+	myNode.isBoundedDistance = false;
+
+	return addNode(myNode);
+}
+
+int VoxelShape::addNoiseDisplacement(int aShape, float aAmplitude, float aFrequency, uint32_t aSeed)
+{
+	const ShapeNode& myChild = nodes[aShape];
+
+	ShapeNode myNode;
+	myNode.type = ShapeType::NoiseDisplacement;
+	myNode.childA = aShape;
+	myNode.amplitude = aAmplitude;
+	myNode.frequency = aFrequency;
+	myNode.seed = aSeed;
+	myNode.bounds = { myChild.bounds.min - std::abs(aAmplitude), myChild.bounds.max + std::abs(aAmplitude) };
+	myNode.lipschitz = myChild.lipschitz + std::abs(aAmplitude * aFrequency) * valueNoiseLipschitz;
+	myNode.uniformMaterial = myChild.uniformMaterial;
+	myNode.isBoundedDistance = myChild.isBoundedDistance;
+
+	return addNode(myNode);
+}
+
+void VoxelShape::setRoot(int aShape)
+{
+	assert(aShape >= 0 && aShape < getNodeCount());
+	root = aShape;
+}
+
+void VoxelShape::clear()
+{
+	nodes.clear();
+	root = -1;
+}
+
+float VoxelShape::evaluate(const glm::vec3& aPosition, uint32_t* aMaterial) const
+{
+	assert(root != -1);
+
+	uint32_t myMaterial = 0;
+	const float myDistance = evaluateNode(root, aPosition, myMaterial);
+
+	if (aMaterial) *aMaterial = myMaterial;
+	return myDistance;
+}
+
+void VoxelShape::voxelize(VoxelModel* aModel, int aThreadCount) const
+{
+	if (root == -1) return;
+
+	constexpr int myBrickSize = VoxelModel::brickSize;
+
+	// voxel centers are at +0.5, only bricks with a voxel center inside the bounds are visited
+	const AABB& myBounds = nodes[root].bounds;
+	const glm::ivec3 myMinBrick = glm::ivec3(glm::floor((myBounds.min - 0.5f) / static_cast<float>(myBrickSize)));
+	const glm::ivec3 myMaxBrick = glm::ivec3(glm::floor((myBounds.max - 0.5f) / static_cast<float>(myBrickSize)));
+
+	// the distance can't change by more than lipschitz per unit, so a brick whose center is further from the surface than its half diagonal is on one side of it
+	const float myReach = nodes[root].lipschitz * (myBrickSize - 1) * 0.5f * 1.7320508f;
+	const uint32_t myUniformMaterial = nodes[root].uniformMaterial;
+
+	aModel->generateBricks(myMinBrick, myMaxBrick, [&](const glm::ivec3& aBrickPosition, uint32_t* aVoxels)
+	{
+		const glm::ivec3 myBrickMin = aBrickPosition * myBrickSize;
+
+		uint32_t myMaterial = 0;
+		const float myCenterDistance = evaluateNode(root, glm::vec3(myBrickMin) + myBrickSize * 0.5f, myMaterial);
+
+		if (myCenterDistance > myReach) return false;
+
+		// fully inside bricks only skip the evaluation when the material can't change inside of them
+		if (myCenterDistance <= -myReach && myUniformMaterial)
+		{
+			std::fill(aVoxels, aVoxels + VoxelModel::brickVoxelCount, myUniformMaterial);
+			return true;
+		}
+
+		// the brick is close to the surface, the same test on its eight blocks skips most of the voxels of thin shapes
+		constexpr int myBlockSize = myBrickSize / 2;
+		const float myBlockReach = nodes[root].lipschitz * (myBlockSize - 1) * 0.5f * 1.7320508f;
+
+		bool myHasVoxel = false;
+
+		for (int block = 0; block < 8; block++)
+		{
+			const glm::ivec3 myBlockMin = myBrickMin + glm::ivec3(block & 1, (block >> 1) & 1, block >> 2) * myBlockSize;
+
+			const float myBlockDistance = evaluateNode(root, glm::vec3(myBlockMin) + myBlockSize * 0.5f, myMaterial);
+			if (myBlockDistance > myBlockReach) continue;
+
+			const bool myIsFilled = myBlockDistance <= -myBlockReach && myUniformMaterial;
+
+			for (int z = 0; z < myBlockSize; z++)
+			{
+				for (int y = 0; y < myBlockSize; y++)
+				{
+					for (int x = 0; x < myBlockSize; x++)
+					{
+						const glm::ivec3 myVoxel = myBlockMin + glm::ivec3(x, y, z);
+						uint32_t& myValue = aVoxels[(myVoxel.x - myBrickMin.x) + (myVoxel.y - myBrickMin.y) * myBrickSize + (myVoxel.z - myBrickMin.z) * myBrickSize * myBrickSize];
+
+						if (myIsFilled)
+						{
+							myValue = myUniformMaterial;
+						}
+						else if (evaluateNode(root, glm::vec3(myVoxel) + 0.5f, myMaterial) <= 0.f)
+						{
+							myValue = myMaterial;
+						}
+						else
+						{
+							continue;
+						}
+
+						myHasVoxel = true;
+					}
+				}
+			}
+		}
+
+		return myHasVoxel;
+	}, aThreadCount);
+}
+
+AABB VoxelShape::getBounds() const
+{
+	assert(root != -1);
+	return nodes[root].bounds;
+}
+
+int VoxelShape::getNodeCount() const
+{
+	return static_cast<int>(nodes.size());
+}
+
+int VoxelShape::addNode(const ShapeNode& aNode)
+{
+	nodes.push_back(aNode);
+
+	// primitives are the only nodes with their own material
+	ShapeNode& myNode = nodes.back();
+	if (myNode.childA == -1)
+	{
+		myNode.uniformMaterial = myNode.material;
+	}
+
+	root = getNodeCount() - 1;
+	return root;
+}
+
+float VoxelShape::evaluateNode(int aNode, const glm::vec3& aPosition, uint32_t& aMaterial) const
+{
+	const ShapeNode& myNode = nodes[aNode];
+
+	switch (myNode.type)
+	{
+	case ShapeType::Box:
+	{
+		aMaterial = myNode.material;
+
+		const glm::vec3 myOffset = glm::abs(aPosition - myNode.positionA) - myNode.positionB;
+		return glm::length(glm::max(myOffset, 0.f)) + std::min(std::max(myOffset.x, std::max(myOffset.y, myOffset.z)), 0.f);
+	}
+	case ShapeType::Sphere:
+	{
+		aMaterial = myNode.material;
+		return glm::length(aPosition - myNode.positionA) - myNode.radius;
+	}
+	case ShapeType::Capsule:
+	{
+		aMaterial = myNode.material;
+
+		const glm::vec3 myOffset = aPosition - myNode.positionA;
+		const glm::vec3 myAxis = myNode.positionB - myNode.positionA;
+		const float myAxisLength = glm::dot(myAxis, myAxis);
+		const float myT = myAxisLength > 0.f ? glm::clamp(glm::dot(myOffset, myAxis) / myAxisLength, 0.f, 1.f) : 0.f;
+
+		return glm::length(myOffset - myAxis * myT) - myNode.radius;
+	}
+	case ShapeType::Cylinder:
+	{
+		aMaterial = myNode.material;
+
+		const glm::vec3 myOffset = aPosition - myNode.positionA;
+		const glm::vec2 myDistance = glm::abs(glm::vec2(glm::length(glm::vec2(myOffset.x, myOffset.z)), myOffset.y)) - glm::vec2(myNode.radius, myNode.radius2);
+
+		return std::min(std::max(myDistance.x, myDistance.y), 0.f) + glm::length(glm::max(myDistance, 0.f));
+	}
+	case ShapeType::Torus:
+	{
+		aMaterial = myNode.material;
+
+		const glm::vec3 myOffset = aPosition - myNode.positionA;
+		const glm::vec2 myRing = glm::vec2(glm::length(glm::vec2(myOffset.x, myOffset.z)) - myNode.radius, myOffset.y);
+
+		return glm::length(myRing) - myNode.radius2;
+	}
+	case ShapeType::Union:
+	{
+		const float myA = evaluateNode(myNode.childA, aPosition, aMaterial);
+
+		// outside of its bounds b is at least as far as the bounds, so it can't be closer than a when they aren't
+		const ShapeNode& myChildB = nodes[myNode.childB];
+		if (myChildB.isBoundedDistance)
+		{
+			const float myBoundsDistance = distanceToBounds(myChildB.bounds, aPosition);
+			if (myBoundsDistance > 0.f && myBoundsDistance >= myA) return myA;
+		}
+
+		uint32_t myMaterialB = 0;
+		const float myB = evaluateNode(myNode.childB, aPosition, myMaterialB);
+
+		if (myB < myA)
+		{
+			aMaterial = myMaterialB;
+			return myB;
+		}
+		return myA;
+	}
+	case ShapeType::Subtraction:
+	{
+		uint32_t myMaterialB = 0;
+		const float myA = evaluateNode(myNode.childA, aPosition, aMaterial);
+		const float myB = evaluateNode(myNode.childB, aPosition, myMaterialB);
+
+		return std::max(myA, -myB);
+	}
+	case ShapeType::Intersection:
+	{
+		uint32_t myMaterialB = 0;
+		const float myA = evaluateNode(myNode.childA, aPosition, aMaterial);
+		const float myB = evaluateNode(myNode.childB, aPosition, myMaterialB);
+
+		if (myB > myA)
+		{
+			aMaterial = myMaterialB;
+			return myB;
+		}
+		return myA;
+	}
+	case ShapeType::NoiseDisplacement:
+	{
+		const float myDistance = evaluateNode(myNode.childA, aPosition, aMaterial);
+		return myDistance + myNode.amplitude * valueNoise(aPosition * myNode.frequency, myNode.seed);
+	}
+	}
+
+	return 0.f;
+}
@@ -8,6 +8,8 @@
 #include "imgui-docking/imgui_impl_win32.h"
 #include "rendering\imgui-docking\implot.h"
 
+#include <string>
+
 using namespace Microsoft::WRL;
 
 Graphics::Graphics()
@@ -197,6 +199,22 @@ void Graphics::renderFrame()
             // voxel Atlas buffer
             CD3DX12_GPU_DESCRIPTOR_HANDLE voxelAtlasDescriptorHandle(cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart(), 11, cbvSrvUavDescriptorSize);
             commandList->SetComputeRootDescriptorTable(9, voxelAtlasDescriptorHandle);
+
+            // voxel grid layer 1 occupancy buffer
+            CD3DX12_GPU_DESCRIPTOR_HANDLE GridLayer1OccupancyDescriptorHandle(cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart(), 13, cbvSrvUavDescriptorSize);
+            commandList->SetComputeRootDescriptorTable(12, GridLayer1OccupancyDescriptorHandle);
+
+            // voxel grid layer 2 occupancy buffer
+            CD3DX12_GPU_DESCRIPTOR_HANDLE GridLayer2OccupancyDescriptorHandle(cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart(), 14, cbvSrvUavDescriptorSize);
+            commandList->SetComputeRootDescriptorTable(13, GridLayer2OccupancyDescriptorHandle);
+
+            // voxel grid palette offset buffer
+            CD3DX12_GPU_DESCRIPTOR_HANDLE GridPaletteOffsetDescriptorHandle(cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart(), 15, cbvSrvUavDescriptorSize);
+            commandList->SetComputeRootDescriptorTable(14, GridPaletteOffsetDescriptorHandle);
+
+            // voxel grid palette buffer
+            CD3DX12_GPU_DESCRIPTOR_HANDLE GridPaletteDescriptorHandle(cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart(), 16, cbvSrvUavDescriptorSize);
+            commandList->SetComputeRootDescriptorTable(15, GridPaletteDescriptorHandle);
         }
 
         //skydome
@@ -276,6 +294,14 @@ void Graphics::copyAccumulationBufferToBackbuffer()
     TransitionResource(commandList.Get(), accumulationOutputTexture.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 }
 
+void Graphics::clearBackbuffer()
+{
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(rtvHeap->GetCPUDescriptorHandleForHeapStart(), frameIndex, rtvDescriptorSize);
+
+    const float clearColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
+}
+
 int wangHash(int aSeed)
 {
     aSeed = (aSeed ^ 61) ^ (aSeed >> 16);
@@ -394,6 +420,7 @@ void Graphics::updateNoiseTexture(const Texture& aTexture)
 void Graphics::updateSkydomeTexture(const Texture& aTexture)
 {
     assert(aTexture.textureWidth == 4096 && aTexture.textureHeight == 2048);
+    assert(aTexture.format == TextureFormat::RGB9E5 && aTexture.mipCount == skydomeTexture->GetDesc().MipLevels);
 
     ThrowIfFailed(commandAllocators[frameIndex]->Reset());
     ThrowIfFailed(commandList->Reset(commandAllocators[frameIndex].Get(), nullptr));
@@ -405,7 +432,8 @@ void Graphics::updateSkydomeTexture(const Texture& aTexture)
     //copy over data
     ComPtr<ID3D12Resource> textureUploadHeap;
 
-    const UINT64 uploadBufferSize = GetRequiredIntermediateSize(skydomeTexture.Get(), 0, 1);
+    const UINT myMipCount = static_cast<UINT>(aTexture.mipCount);
+    const UINT64 uploadBufferSize = GetRequiredIntermediateSize(skydomeTexture.Get(), 0, myMipCount);
     auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
 
     auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
@@ -419,12 +447,25 @@ void Graphics::updateSkydomeTexture(const Texture& aTexture)
         nullptr,
         IID_PPV_ARGS(&textureUploadHeap)));
 
-    D3D12_SUBRESOURCE_DATA textureData = {};
-    textureData.pData = aTexture.textureData;
-    textureData.RowPitch = static_cast<long>(aTexture.textureWidth) * aTexture.bytesPerPixel;
-    textureData.SlicePitch = textureData.RowPitch * aTexture.textureHeight;
+    // the mips follow each other in the texture data
+    std::vector<D3D12_SUBRESOURCE_DATA> textureData(myMipCount);
+
+    const uint8_t* myLevelData = static_cast<const uint8_t*>(aTexture.textureData);
+    int myWidth = aTexture.textureWidth;
+    int myHeight = aTexture.textureHeight;
 
-    UpdateSubresources(commandList.Get(), skydomeTexture.Get(), textureUploadHeap.Get(), 0, 0, 1, &textureData);
+    for (UINT level = 0; level < myMipCount; level++)
+    {
+        textureData[level].pData = myLevelData;
+        textureData[level].RowPitch = static_cast<long>(myWidth) * aTexture.bytesPerPixel;
+        textureData[level].SlicePitch = textureData[level].RowPitch * myHeight;
+
+        myLevelData += textureData[level].SlicePitch;
+        myWidth = myWidth > 1 ? myWidth / 2 : 1;
+        myHeight = myHeight > 1 ? myHeight / 2 : 1;
+    }
+
+    UpdateSubresources(commandList.Get(), skydomeTexture.Get(), textureUploadHeap.Get(), 0, 0, myMipCount, textureData.data());
 
     //transition back
     auto myResourceBarrierAfter = CD3DX12_RESOURCE_BARRIER::Transition(skydomeTexture.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
@@ -439,6 +480,19 @@ void Graphics::updateSkydomeTexture(const Texture& aTexture)
     waitForGpu();
 }
 
+void Graphics::updateSkyIrradiance(const SHIrradiance& aIrradiance)
+{
+    for (int i = 0; i < 9; i++)
+    {
+        computeConstantBuffer->skyIrradiance[i] = glm::vec4(aIrradiance.coefficients[i], 0.f);
+    }
+}
+
+void Graphics::setSkyLighting(SkyLighting aSkyLighting)
+{
+    computeConstantBuffer->skyLighting = static_cast<int>(aSkyLighting);
+}
+
 void Graphics::updateOctreeVariables(const Octree& aOctree)
 {
     // Get a pointer to the mapped data
@@ -447,10 +501,8 @@ void Graphics::updateOctreeVariables(const Octree& aOctree)
     CD3DX12_RANGE readRange(0, 0);
     ThrowIfFailed(octreeBuffer->Map(0, &readRange, &mappedData));
 
-    size_t test = aOctree.getSize() * sizeof(OctreeElement[8]);
-
     // Update the data
-    memcpy(mappedData, aOctree.getData(), test);
+    aOctree.copyData(mappedData);
 
     // Unmap the buffer
     octreeBuffer->Unmap(0, &readRange);
@@ -462,7 +514,14 @@ void Graphics::updateOctreeVariables(const Octree& aOctree)
 
 void Graphics::updateVoxelGridVariables(const VoxelGrid& aGrid)
 {
+    reserveVoxelGridBuffers(aGrid);
+
     //update top level
+    if (aGrid.isSparseTopLevel())
+    {
+        updateVoxelGridTopLevelTable(aGrid);
+    }
+    else
     {
         void* mappedData;
 
@@ -485,10 +544,8 @@ void Graphics::updateVoxelGridVariables(const VoxelGrid& aGrid)
         CD3DX12_RANGE readRange(0, 0);
         ThrowIfFailed(voxelGridLayer1Buffer->Map(0, &readRange, &mappedData));
 
-        size_t test = aGrid.getLayer1ChunkDataSize() * sizeof(Layer1Chunk);
-
-        // Update the data
-        memcpy(mappedData, aGrid.getLayer1ChunkData(), test);
+        // Update the data, the grid copies its slabs back to back
+        aGrid.copyLevelData(0, mappedData);
 
         // Unmap the buffer
         voxelGridLayer1Buffer->Unmap(0, &readRange);
@@ -501,19 +558,257 @@ void Graphics::updateVoxelGridVariables(const VoxelGrid& aGrid)
         CD3DX12_RANGE readRange(0, 0);
         ThrowIfFailed(voxelGridLayer2Buffer->Map(0, &readRange, &mappedData));
 
-        size_t test = aGrid.getLayer2ChunkDataSize() * sizeof(Layer2Chunk);
-
         // Update the data
-        memcpy(mappedData, aGrid.getLayer2ChunkData(), test);
+        aGrid.copyLevelData(VoxelGrid::levelCount - 1, mappedData);
 
         // Unmap the buffer
         voxelGridLayer2Buffer->Unmap(0, &readRange);
     }
 
-    //update constant buffer
+    //update level 1 occupancy
+    {
+        void* mappedData;
+
+        CD3DX12_RANGE readRange(0, 0);
+        ThrowIfFailed(voxelGridLayer1OccupancyBuffer->Map(0, &readRange, &mappedData));
+
+        // Update the data
+        aGrid.copyLevelOccupancyData(0, mappedData);
+
+        // Unmap the buffer
+        voxelGridLayer1OccupancyBuffer->Unmap(0, &readRange);
+    }
+
+    //update level 2 occupancy
+    {
+        void* mappedData;
+
+        CD3DX12_RANGE readRange(0, 0);
+        ThrowIfFailed(voxelGridLayer2OccupancyBuffer->Map(0, &readRange, &mappedData));
+
+        // Update the data
+        aGrid.copyLevelOccupancyData(VoxelGrid::levelCount - 1, mappedData);
+
+        // Unmap the buffer
+        voxelGridLayer2OccupancyBuffer->Unmap(0, &readRange);
+    }
+
+    updateVoxelGridPalettes(aGrid);
+
+    updateVoxelGridBounds(aGrid);
+}
+
+void Graphics::updateVoxelGridBounds(const VoxelGrid& aGrid)
+{
     voxelGridConstantBuffer->voxelGridSize = glm::uvec4(aGrid.getSizeX(), aGrid.getSizeY(), aGrid.getSizeZ(), 0);
+    voxelGridConstantBuffer->voxelGridOrigin = glm::ivec4(aGrid.getOrigin(), 0);
+
+    // w tells the shader how many slots the sparse top level table has, 0 when the top level is dense
+    const UINT mySlotCount = aGrid.isSparseTopLevel() ? static_cast<UINT>(aGrid.getTopLevelTableSlotCount()) : 0;
+    voxelGridConstantBuffer->topLevelChunkSize = glm::uvec4(aGrid.getTopLevelCountX(), aGrid.getTopLevelCountY(), aGrid.getTopLevelCountZ(), mySlotCount);
+}
+
+void Graphics::updateVoxelGridTopLevelTable(const VoxelGrid& aGrid)
+{
+    std::vector<int> mySlots;
+    aGrid.getTopLevelTableData(mySlots);
+
+    void* mappedData;
+
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(voxelGridTopLevelBuffer->Map(0, &readRange, &mappedData));
+
+    memcpy(mappedData, mySlots.data(), mySlots.size() * sizeof(int));
+
+    voxelGridTopLevelBuffer->Unmap(0, &readRange);
+}
+
+void Graphics::updateVoxelGridChanges(const VoxelGrid& aGrid)
+{
+    const VoxelGridChanges& myChanges = aGrid.getChanges();
+
+    // buffers that had to grow are new and empty, so everything is uploaded again
+    if (myChanges.isFullUpdate || reserveVoxelGridBuffers(aGrid))
+    {
+        updateVoxelGridVariables(aGrid);
+        return;
+    }
+
+    //update changed top level cells
+    if (!myChanges.topLevelCells.empty())
+    {
+        void* mappedData;
+
+        CD3DX12_RANGE readRange(0, 0);
+        ThrowIfFailed(voxelGridTopLevelBuffer->Map(0, &readRange, &mappedData));
+
+        const int* myGridData = static_cast<const int*>(aGrid.getGridData());
+        for (const int index : myChanges.topLevelCells)
+        {
+            static_cast<int*>(mappedData)[index] = myGridData[index];
+        }
+
+        voxelGridTopLevelBuffer->Unmap(0, &readRange);
+    }
+
+    // the table is rebuilt when a top level chunk is added or removed, the grid may have grown too
+    if (myChanges.hasTopLevelTableChanges)
+    {
+        updateVoxelGridTopLevelTable(aGrid);
+        updateVoxelGridBounds(aGrid);
+    }
+
+    updateVoxelGridChunks(aGrid, 0, voxelGridLayer1Buffer.Get(), voxelGridLayer1OccupancyBuffer.Get());
+    updateVoxelGridChunks(aGrid, 1, voxelGridLayer2Buffer.Get(), voxelGridLayer2OccupancyBuffer.Get());
 
-    voxelGridConstantBuffer->topLevelChunkSize = voxelGridConstantBuffer->voxelGridSize / glm::uvec4(16);
+    if (myChanges.hasPaletteChanges)
+    {
+        updateVoxelGridPalettes(aGrid);
+    }
+}
+
+void Graphics::updateVoxelGridChunks(const VoxelGrid& aGrid, int aLevel, ID3D12Resource* aChunkBuffer, ID3D12Resource* aOccupancyBuffer)
+{
+    const std::vector<int>& myChunks = aGrid.getChanges().chunks[aLevel];
+
+    if (myChunks.empty()) return;
+
+    const size_t myChunkSize = VoxelGrid::Layout::getChunkIntCount(aLevel) * sizeof(int);
+    const size_t myMaskSize = VoxelGrid::Layout::getMaskWordCount(aLevel) * sizeof(uint64_t);
+
+    void* mappedChunks;
+    void* mappedMasks;
+
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(aChunkBuffer->Map(0, &readRange, &mappedChunks));
+    ThrowIfFailed(aOccupancyBuffer->Map(0, &readRange, &mappedMasks));
+
+    // copy only the chunks that changed
+    for (const int index : myChunks)
+    {
+        memcpy(static_cast<char*>(mappedChunks) + index * myChunkSize, aGrid.getChunkData(aLevel, index), myChunkSize);
+        memcpy(static_cast<char*>(mappedMasks) + index * myMaskSize, aGrid.getChunkOccupancyData(aLevel, index), myMaskSize);
+    }
+
+    aOccupancyBuffer->Unmap(0, &readRange);
+    aChunkBuffer->Unmap(0, &readRange);
+}
+
+void Graphics::updateVoxelGridPalettes(const VoxelGrid& aGrid)
+{
+    std::vector<int> myPaletteOffsets;
+    std::vector<int> myPaletteEntries;
+    aGrid.getPaletteData(myPaletteOffsets, myPaletteEntries);
+
+    void* mappedData;
+
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(voxelGridPaletteOffsetBuffer->Map(0, &readRange, &mappedData));
+
+    // Update the data
+    memcpy(mappedData, myPaletteOffsets.data(), myPaletteOffsets.size() * sizeof(int));
+
+    // Unmap the buffer
+    voxelGridPaletteOffsetBuffer->Unmap(0, &readRange);
+
+    ThrowIfFailed(voxelGridPaletteBuffer->Map(0, &readRange, &mappedData));
+
+    // Update the data
+    memcpy(mappedData, myPaletteEntries.data(), myPaletteEntries.size() * sizeof(int));
+
+    // Unmap the buffer
+    voxelGridPaletteBuffer->Unmap(0, &readRange);
+}
+
+bool Graphics::reserveVoxelGridBuffers(const VoxelGrid& aGrid)
+{
+    // grow to at least twice the old size, so a grid that is edited a lot doesn't recreate the buffers every frame
+    auto myGrow = [](UINT aCapacity, size_t aCount) -> UINT
+    {
+        if (aCount <= aCapacity) return aCapacity;
+
+        return static_cast<UINT>(aCount > static_cast<size_t>(aCapacity) * 2 ? aCount : static_cast<size_t>(aCapacity) * 2);
+    };
+
+    // the sparse top level is uploaded as a table of 4 ints per slot
+    const size_t myTopLevelCount = aGrid.isSparseTopLevel() ? aGrid.getTopLevelTableSlotCount() * 4 : aGrid.getGridSize();
+
+    const UINT myTopLevelCapacity = myGrow(voxelGridTopLevelCapacity, myTopLevelCount);
+    const UINT myLayer1Capacity = myGrow(voxelGridLayer1Capacity, aGrid.getLayer1ChunkDataSize());
+    const UINT myLayer2Capacity = myGrow(voxelGridLayer2Capacity, aGrid.getLayer2ChunkDataSize());
+    const UINT myPaletteCapacity = myGrow(voxelGridPaletteCapacity, aGrid.getPaletteEntryCount());
+
+    if (myTopLevelCapacity == voxelGridTopLevelCapacity && myLayer1Capacity == voxelGridLayer1Capacity &&
+        myLayer2Capacity == voxelGridLayer2Capacity && myPaletteCapacity == voxelGridPaletteCapacity)
+    {
+        return false;
+    }
+
+    // the old buffers and their views can still be used by a frame in flight
+    waitForGpu();
+
+    if (myTopLevelCapacity != voxelGridTopLevelCapacity)
+    {
+        createVoxelGridBuffer(voxelGridTopLevelBuffer, myTopLevelCapacity, sizeof(int), 8, L"gridTopLevelBuffer");
+    }
+
+    // the occupancy masks and palette offsets have one entry per chunk, they grow with the chunks
+    if (myLayer1Capacity != voxelGridLayer1Capacity)
+    {
+        createVoxelGridBuffer(voxelGridLayer1Buffer, myLayer1Capacity, sizeof(Layer1Chunk), 9, L"gridLayer1Buffer");
+        createVoxelGridBuffer(voxelGridLayer1OccupancyBuffer, myLayer1Capacity, sizeof(uint64_t), 13, L"gridLayer1OccupancyBuffer");
+        createVoxelGridBuffer(voxelGridPaletteOffsetBuffer, myLayer1Capacity, sizeof(int), 15, L"gridPaletteOffsetBuffer");
+    }
+
+    if (myLayer2Capacity != voxelGridLayer2Capacity)
+    {
+        createVoxelGridBuffer(voxelGridLayer2Buffer, myLayer2Capacity, sizeof(Layer2Chunk), 10, L"gridLayer2Buffer");
+        createVoxelGridBuffer(voxelGridLayer2OccupancyBuffer, myLayer2Capacity, sizeof(uint64_t), 14, L"gridLayer2OccupancyBuffer");
+    }
+
+    if (myPaletteCapacity != voxelGridPaletteCapacity)
+    {
+        createVoxelGridBuffer(voxelGridPaletteBuffer, myPaletteCapacity, sizeof(int), 16, L"gridPaletteBuffer");
+    }
+
+    voxelGridTopLevelCapacity = myTopLevelCapacity;
+    voxelGridLayer1Capacity = myLayer1Capacity;
+    voxelGridLayer2Capacity = myLayer2Capacity;
+    voxelGridPaletteCapacity = myPaletteCapacity;
+
+    return true;
+}
+
+void Graphics::createVoxelGridBuffer(Microsoft::WRL::ComPtr<ID3D12Resource>& aBuffer, UINT aElementCount, UINT aStride, int aHeapSlot, const wchar_t* aName)
+{
+    auto heapUpload = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+
+    D3D12_RESOURCE_ALLOCATION_INFO myAllocationInfo;
+    myAllocationInfo.SizeInBytes = static_cast<UINT64>(aElementCount) * aStride;
+    myAllocationInfo.Alignment = 0;
+
+    const D3D12_RESOURCE_DESC myBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(myAllocationInfo);
+
+    ThrowIfFailed(
+        device->CreateCommittedResource(
+            &heapUpload,
+            D3D12_HEAP_FLAG_NONE,
+            &myBufferDesc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(aBuffer.ReleaseAndGetAddressOf())));
+
+    aBuffer->SetName(aName);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC myOctreeDataDesc = {};
+    myOctreeDataDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    myOctreeDataDesc.Format = DXGI_FORMAT_UNKNOWN;
+    myOctreeDataDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    myOctreeDataDesc.Buffer.NumElements = aElementCount;
+    myOctreeDataDesc.Buffer.StructureByteStride = aStride;
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart(), aHeapSlot, cbvSrvUavDescriptorSize);
+    device->CreateShaderResourceView(aBuffer.Get(), &myOctreeDataDesc, srvHandle);
 }
 
 void Graphics::updateVoxelAtlasVariables(const VoxelAtlas& aAtlas)
@@ -647,7 +942,7 @@ bool Graphics::loadPipeline()
 
         // Describe and create a Unordered Access View (UAV) descriptor heap.
         D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-        srvHeapDesc.NumDescriptors = 13;
+        srvHeapDesc.NumDescriptors = 17;
         srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
         srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
         ThrowIfFailed(device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&cbvSrvUavHeap)));
@@ -884,105 +1179,23 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
             device->CreateConstantBufferView(&myBufferDesc, cbvHandle);
         }
 
-        // top level
-        {
-            auto heapUpload = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-
-            D3D12_RESOURCE_ALLOCATION_INFO myAllocationInfo;
-            // max chunks for 128x128x128 scene
-            myAllocationInfo.SizeInBytes = 512 * sizeof(int);
-            myAllocationInfo.Alignment = 0;
-
-            const D3D12_RESOURCE_DESC myBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(myAllocationInfo);
-
-            ThrowIfFailed(
-                device->CreateCommittedResource(
-                    &heapUpload,
-                    D3D12_HEAP_FLAG_NONE,
-                    &myBufferDesc,
-                    D3D12_RESOURCE_STATE_GENERIC_READ,
-                    nullptr,
-                    IID_PPV_ARGS(voxelGridTopLevelBuffer.ReleaseAndGetAddressOf())));
-
-            voxelGridTopLevelBuffer->SetName(L"gridTopLevelBuffer");
-
-            D3D12_SHADER_RESOURCE_VIEW_DESC myOctreeDataDesc = {};
-            myOctreeDataDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            myOctreeDataDesc.Format = DXGI_FORMAT_UNKNOWN;
-            myOctreeDataDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-            myOctreeDataDesc.Buffer.NumElements = 512;
-            myOctreeDataDesc.Buffer.StructureByteStride = sizeof(int);
-
-            CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart(), 8, cbvSrvUavDescriptorSize);
-            device->CreateShaderResourceView(voxelGridTopLevelBuffer.Get(), &myOctreeDataDesc, srvHandle);
-        }
-
-        // layer 1
-        {
-            auto heapUpload = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-
-            D3D12_RESOURCE_ALLOCATION_INFO myAllocationInfo;
-            // max chunks for 128x128x128 scene
-            myAllocationInfo.SizeInBytes = 512 * sizeof(Layer1Chunk);
-            myAllocationInfo.Alignment = 0;
-
-            const D3D12_RESOURCE_DESC myBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(myAllocationInfo);
-
-            ThrowIfFailed(
-                device->CreateCommittedResource(
-                    &heapUpload,
-                    D3D12_HEAP_FLAG_NONE,
-                    &myBufferDesc,
-                    D3D12_RESOURCE_STATE_GENERIC_READ,
-                    nullptr,
-                    IID_PPV_ARGS(voxelGridLayer1Buffer.ReleaseAndGetAddressOf())));
-
-            voxelGridLayer1Buffer->SetName(L"gridLayer1Buffer");
-
-            D3D12_SHADER_RESOURCE_VIEW_DESC myOctreeDataDesc = {};
-            myOctreeDataDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            myOctreeDataDesc.Format = DXGI_FORMAT_UNKNOWN;
-            myOctreeDataDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-            myOctreeDataDesc.Buffer.NumElements = 512;
-            myOctreeDataDesc.Buffer.StructureByteStride = sizeof(Layer1Chunk);
-
-            CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart(), 9, cbvSrvUavDescriptorSize);
-            device->CreateShaderResourceView(voxelGridLayer1Buffer.Get(), &myOctreeDataDesc, srvHandle);
-        }
+        // the data buffers start out sized for a 128x128x128 scene, they grow with the grid
+        createVoxelGridBuffer(voxelGridTopLevelBuffer, 512, sizeof(int), 8, L"gridTopLevelBuffer");
+        createVoxelGridBuffer(voxelGridLayer1Buffer, 512, sizeof(Layer1Chunk), 9, L"gridLayer1Buffer");
+        createVoxelGridBuffer(voxelGridLayer2Buffer, 32768, sizeof(Layer2Chunk), 10, L"gridLayer2Buffer");
 
-        // layer 2
-        {
-            auto heapUpload = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+        // one 64 bit mask per chunk and per brick
+        createVoxelGridBuffer(voxelGridLayer1OccupancyBuffer, 512, sizeof(uint64_t), 13, L"gridLayer1OccupancyBuffer");
+        createVoxelGridBuffer(voxelGridLayer2OccupancyBuffer, 32768, sizeof(uint64_t), 14, L"gridLayer2OccupancyBuffer");
 
-            D3D12_RESOURCE_ALLOCATION_INFO myAllocationInfo;
-            // max chunks for 128x128x128 scene
-            myAllocationInfo.SizeInBytes = 32768 * sizeof(Layer2Chunk);
-            myAllocationInfo.Alignment = 0;
-
-            const D3D12_RESOURCE_DESC myBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(myAllocationInfo);
-
-            ThrowIfFailed(
-                device->CreateCommittedResource(
-                    &heapUpload,
-                    D3D12_HEAP_FLAG_NONE,
-                    &myBufferDesc,
-                    D3D12_RESOURCE_STATE_GENERIC_READ,
-                    nullptr,
-                    IID_PPV_ARGS(voxelGridLayer2Buffer.ReleaseAndGetAddressOf())));
-
-            voxelGridLayer2Buffer->SetName(L"gridLayer2Buffer");
-
-            D3D12_SHADER_RESOURCE_VIEW_DESC myOctreeDataDesc = {};
-            myOctreeDataDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            myOctreeDataDesc.Format = DXGI_FORMAT_UNKNOWN;
-            myOctreeDataDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-            myOctreeDataDesc.Buffer.NumElements = 32768;
-            myOctreeDataDesc.Buffer.StructureByteStride = sizeof(Layer2Chunk);
-
-            CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart(), 10, cbvSrvUavDescriptorSize);
-            device->CreateShaderResourceView(voxelGridLayer2Buffer.Get(), &myOctreeDataDesc, srvHandle);
-        }
+        // first palette entry of every layer 1 chunk, and up to 256 atlas indices per layer 1 chunk
+        createVoxelGridBuffer(voxelGridPaletteOffsetBuffer, 512, sizeof(int), 15, L"gridPaletteOffsetBuffer");
+        createVoxelGridBuffer(voxelGridPaletteBuffer, 512 * 256, sizeof(int), 16, L"gridPaletteBuffer");
 
+        voxelGridTopLevelCapacity = 512;
+        voxelGridLayer1Capacity = 512;
+        voxelGridLayer2Capacity = 32768;
+        voxelGridPaletteCapacity = 512 * 256;
     }
 
     //voxel atlas buffer
@@ -990,8 +1203,7 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
         auto heapUpload = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
 
         D3D12_RESOURCE_ALLOCATION_INFO myAllocationInfo;
-        // max chunks for 128x128x128 scene
-        myAllocationInfo.SizeInBytes = 255 * sizeof(VoxelAtlasItem);
+        myAllocationInfo.SizeInBytes = VoxelAtlas::maxItemCount * sizeof(VoxelAtlasItem);
         myAllocationInfo.Alignment = 0;
 
         const D3D12_RESOURCE_DESC myBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(myAllocationInfo);
@@ -1011,7 +1223,7 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
         myOctreeDataDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
         myOctreeDataDesc.Format = DXGI_FORMAT_UNKNOWN;
         myOctreeDataDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-        myOctreeDataDesc.Buffer.NumElements = 255;
+        myOctreeDataDesc.Buffer.NumElements = VoxelAtlas::maxItemCount;
         myOctreeDataDesc.Buffer.StructureByteStride = sizeof(VoxelAtlasItem);
 
         CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart(), 11, cbvSrvUavDescriptorSize);
@@ -1021,11 +1233,12 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
     // create texture for sky dome
     {
         // Describe and create a Texture2D.
+        // the loader gives hdr textures as rgb9e5 with every mip level
         D3D12_RESOURCE_DESC textureDesc = {};
-        textureDesc.MipLevels = 1;
-        textureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
         textureDesc.Width = 4096;
         textureDesc.Height = 2048;
+        textureDesc.MipLevels = static_cast<UINT16>(getFullMipCount(4096, 2048));
+        textureDesc.Format = DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
         textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
         textureDesc.DepthOrArraySize = 1;
         textureDesc.SampleDesc.Count = 1;
@@ -1046,7 +1259,7 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
         mySceneDataDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
         mySceneDataDesc.Format = textureDesc.Format;
         mySceneDataDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-        mySceneDataDesc.Texture3D.MipLevels = 1;
+        mySceneDataDesc.Texture2D.MipLevels = textureDesc.MipLevels;
 
         CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart(), 12, cbvSrvUavDescriptorSize);
         device->CreateShaderResourceView(skydomeTexture.Get(), &mySceneDataDesc, srvHandle);
@@ -1079,8 +1292,20 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
     // use for profiling
     UINT compileFlags = NULL;
 
+    // the DDA shader packs the index of a level in 3 bits, so it only supports 2 levels of 4x4x4
+    static_assert(VoxelGrid::levelCount == 2 && VoxelGrid::topLevelScale == 16, "voxel grid layout not supported by the DDA shader");
+
+    const std::string myChunkSize1 = std::to_string(VoxelGrid::Layout::brickSizes[0]);
+    const std::string myChunkSize2 = std::to_string(VoxelGrid::Layout::brickSizes[1]);
+    const std::string myTopLevelScale = std::to_string(VoxelGrid::topLevelScale);
+
     //D3D_SHADER_MACRO macros[] = { "TEST", "1", NULL, NULL };
-    D3D_SHADER_MACRO macros[] = { "MAX_STACK_SIZE", "7", NULL, NULL};
+    D3D_SHADER_MACRO macros[] = { 
+        "MAX_STACK_SIZE", "7", 
+        "CHUNK_SIZE_1", myChunkSize1.c_str(),
+        "CHUNK_SIZE_2", myChunkSize2.c_str(),
+        "TOP_LEVEL_SCALE", myTopLevelScale.c_str(),
+        NULL, NULL};
 
     //ThrowIfFailed(D3DCompileFromFile(L"resources/shaders/raytraceComputeTest.hlsl", macros, nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, &globalErrorBlob));
     //ThrowIfFailed(D3DCompileFromFile(L"resources/shaders/raytraceComputeOctree.hlsl", macros, nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, &globalErrorBlob));
@@ -1100,7 +1325,7 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
     //ThrowIfFailed(D3DCompileFromFile(L"resources/shaders/raytraceCompute.hlsl", macros, nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, &globalErrorBlob));
     //ThrowIfFailed(D3DCompileFromFile(L"resources/shaders/rayDirToColor.hlsl", macros, nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, &globalErrorBlob));
 
-    CD3DX12_DESCRIPTOR_RANGE1 myRanges[12];
+    CD3DX12_DESCRIPTOR_RANGE1 myRanges[16];
     myRanges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
     myRanges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
     myRanges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
@@ -1117,7 +1342,13 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
     myRanges[10].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 6);
     myRanges[11].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 1, 0);
 
-    CD3DX12_ROOT_PARAMETER1 myRootParameters[12];
+    myRanges[12].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 7);
+    myRanges[13].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 8);
+
+    myRanges[14].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 9);
+    myRanges[15].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 10);
+
+    CD3DX12_ROOT_PARAMETER1 myRootParameters[16];
     myRootParameters[0].InitAsDescriptorTable(1, &myRanges[0], D3D12_SHADER_VISIBILITY_ALL); // camera const buffer
     myRootParameters[1].InitAsDescriptorTable(1, &myRanges[1], D3D12_SHADER_VISIBILITY_ALL); // output texture
     myRootParameters[2].InitAsDescriptorTable(1, &myRanges[2], D3D12_SHADER_VISIBILITY_ALL); // noise texture
@@ -1134,6 +1365,12 @@ void Graphics::loadComputeStage(const unsigned int aSizeX, const unsigned int aS
     myRootParameters[10].InitAsDescriptorTable(1, &myRanges[10], D3D12_SHADER_VISIBILITY_ALL); // skydome
     myRootParameters[11].InitAsDescriptorTable(1, &myRanges[11], D3D12_SHADER_VISIBILITY_ALL); // skydome sampler
 
+    myRootParameters[12].InitAsDescriptorTable(1, &myRanges[12], D3D12_SHADER_VISIBILITY_ALL); // voxel grid layer 1 occupancy buffer
+    myRootParameters[13].InitAsDescriptorTable(1, &myRanges[13], D3D12_SHADER_VISIBILITY_ALL); // voxel grid layer 2 occupancy buffer
+
+    myRootParameters[14].InitAsDescriptorTable(1, &myRanges[14], D3D12_SHADER_VISIBILITY_ALL); // voxel grid palette offset buffer
+    myRootParameters[15].InitAsDescriptorTable(1, &myRanges[15], D3D12_SHADER_VISIBILITY_ALL); // voxel grid palette buffer
+
     D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
 
     // This is the highest version the sample supports. If CheckFeatureSupport succeeds, the HighestVersion returned will not be greater than this.
@@ -2,6 +2,8 @@
 #include "rendering/imgui-docking/imgui.h"
 #include "rendering/imgui-docking/implot.h"
 #include "engine\logger.h"
+#include "engine\memoryArena.h"
+#include "engine\voxelModelLoader.h"
 
 using namespace ImGui;
 using namespace ImPlot;
@@ -12,14 +14,23 @@ ImguiWindowManager::ImguiWindowManager()
 	profiler = new Profiler();
 
 	benchmarkManager->setProfiler(profiler);
+
+	benchmarkTasks.start(1);
 }
 
 ImguiWindowManager::~ImguiWindowManager()
 {
+	stopBenchmarks();
+
 	delete benchmarkManager;
 	delete profiler;
 }
 
+SkyLighting ImguiWindowManager::getSkyLighting() const
+{
+	return useSkyIrradiance ? SkyLighting::Irradiance : SkyLighting::Texture;
+}
+
 void ImguiWindowManager::setWindowResolution(unsigned int aSizeX, unsigned int aSizeY)
 {
 	sizeX = aSizeX;
@@ -30,6 +41,8 @@ void ImguiWindowManager::updateAndRender(const Graphics& aGraphics, float aDelta
 {
 	update(aGraphics, aDeltaTime);
 
+	benchmarkTasks.runCompletions();
+
 	bool windowOpen = true;
 
 	Begin("settings", &windowOpen, ImGuiWindowFlags_None);
@@ -42,6 +55,16 @@ void ImguiWindowManager::updateAndRender(const Graphics& aGraphics, float aDelta
 		Text("%s: %f", item.name.c_str(), item.timeMS);
 	}
 
+	for (int i = 0; i < static_cast<int>(MemoryTag::Count); i++)
+	{
+		const MemoryTag myTag = static_cast<MemoryTag>(i);
+		Text("%s memory (KB): %.1f, peak %.1f", MemoryArena::getTagName(myTag), MemoryArena::getAllocatedBytes(myTag) / 1024.f, MemoryArena::getPeakBytes(myTag) / 1024.f);
+	}
+
+	Text("loaded resources (MB): %.1f of %.1f", VoxelModelLoader::getMemoryUsage() / (1024.f * 1024.f), VoxelModelLoader::getMemoryBudget() / (1024.f * 1024.f));
+
+	Checkbox("sky irradiance for bounces", &useSkyIrradiance);
+
 	if (Button("profiler"))
 	{
 		profilerOpen = true;
@@ -52,8 +75,135 @@ void ImguiWindowManager::updateAndRender(const Graphics& aGraphics, float aDelta
 		benchmarkToolOpen = true;
 	}
 
+	if (Button("grid layout benchmark"))
+	{
+		layoutBenchmarkOpen = true;
+	}
+
 	End();
 
+	if (loadingTaskName)
+	{
+		Begin("loading", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+		Text("loading: %s", loadingTaskName);
+		Text("tasks left: %i", loadingTaskCount);
+		End();
+	}
+
+	if (layoutBenchmarkOpen)
+	{
+		Begin("Grid layout benchmark", &layoutBenchmarkOpen, ImGuiWindowFlags_None);
+
+		const bool myIsRunning = !benchmarkTasks.isIdle();
+
+		BeginDisabled(myIsRunning);
+		if (Button("run") && benchmarkScene)
+		{
+			const VoxelModel* myScene = benchmarkScene;
+			benchmarkTasks.addTask("grid layout benchmark", [this, myScene]()
+				{
+					pendingBenchmarkResults = runVoxelGridLayoutBenchmark(myScene);
+				}, {}, [this]()
+				{
+					layoutBenchmarkResults = std::move(pendingBenchmarkResults);
+					scalingSkippedSize = 0;
+				});
+		}
+		EndDisabled();
+
+		auto myGetSceneName = [](void*, int aIndex, const char** aName)
+		{
+			*aName = getGeneratedSceneName(static_cast<GeneratedScene>(aIndex));
+			return true;
+		};
+
+		Combo("generated scene", &generatedScene, myGetSceneName, nullptr, static_cast<int>(GeneratedScene::Count));
+		SliderFloat("density", &generatedSceneSettings.density, 0.f, 1.f);
+
+		int mySeed = static_cast<int>(generatedSceneSettings.seed);
+		InputInt("seed", &mySeed);
+		generatedSceneSettings.seed = static_cast<uint32_t>(mySeed);
+
+		// sizes are powers of two from 64 to 4096
+		SliderInt("min size", &scalingMinSize, 64, 4096);
+		SliderInt("max size", &scalingMaxSize, 64, 4096);
+		for (int* size : { &scalingMinSize, &scalingMaxSize })
+		{
+			int myPowerOfTwo = 64;
+			while (myPowerOfTwo * 2 <= *size)
+			{
+				myPowerOfTwo *= 2;
+			}
+			*size = myPowerOfTwo;
+		}
+
+		BeginDisabled(myIsRunning);
+		if (Button("run scaling"))
+		{
+			// leaves some of the free memory to the rest of the system
+			MEMORYSTATUSEX myMemoryStatus{};
+			myMemoryStatus.dwLength = sizeof(myMemoryStatus);
+			const size_t myMemoryBudget = GlobalMemoryStatusEx(&myMemoryStatus) ? static_cast<size_t>(myMemoryStatus.ullAvailPhys / 4 * 3) : SIZE_MAX;
+
+			const GeneratedScene myScene = static_cast<GeneratedScene>(generatedScene);
+			const SceneGeneratorSettings mySettings = generatedSceneSettings;
+			const int myMinSize = scalingMinSize;
+			const int myMaxSize = scalingMaxSize;
+
+			benchmarkTasks.addTask("grid scaling benchmark", [this, myScene, mySettings, myMinSize, myMaxSize, myMemoryBudget]()
+				{
+					pendingBenchmarkResults = runVoxelGridScalingBenchmark(myScene, mySettings, myMinSize, myMaxSize, myMemoryBudget);
+				}, {}, [this, myMaxSize]()
+				{
+					layoutBenchmarkResults = std::move(pendingBenchmarkResults);
+
+					const int myLargestSize = layoutBenchmarkResults.empty() ? 0 : layoutBenchmarkResults.back().sceneSize;
+					scalingSkippedSize = myLargestSize < myMaxSize ? myMaxSize : 0;
+				});
+		}
+		EndDisabled();
+
+		if (myIsRunning)
+		{
+			const char* myTaskName = benchmarkTasks.getPendingTaskName();
+			Text("running: %s", myTaskName ? myTaskName : "");
+		}
+		else if (scalingSkippedSize > 0)
+		{
+			Text("skipped the sizes up to %i, they don't fit in the free memory", scalingSkippedSize);
+		}
+
+		if (BeginTable("layoutResults", 8))
+		{
+			TableSetupColumn("scene");
+			TableSetupColumn("size");
+			TableSetupColumn("layout");
+			TableSetupColumn("memory (KB)");
+			TableSetupColumn("build (MS)");
+			TableSetupColumn("MRays/s");
+			TableSetupColumn("steps per ray");
+			TableSetupColumn("neighbour brick distance (KB)");
+			TableHeadersRow();
+
+			for (const auto& result : layoutBenchmarkResults)
+			{
+				TableNextRow();
+				TableNextColumn(); Text("%s", result.sceneName.c_str());
+				TableNextColumn(); Text("%i", result.sceneSize);
+				TableNextColumn(); Text("%s", result.layoutName.c_str());
+				TableNextColumn(); Text("%.1f", result.memoryUsage / 1024.f);
+				TableNextColumn(); Text("%.2f", result.buildTimeMS);
+				TableNextColumn(); Text("%.3f", result.megaRaysPerSecond);
+				TableNextColumn(); Text("%.2f", result.averageLoopCount);
+				TableNextColumn(); Text("%.1f", result.neighbourBrickDistance / 1024.f);
+			}
+
+			EndTable();
+		}
+
+		End();
+	}
+
 	if (profilerOpen)
 	{
 		Begin("Profiler", &profilerOpen, ImGuiWindowFlags_None);
@@ -263,6 +413,23 @@ void ImguiWindowManager::setGpuProfiler(GPUProfiler* aGpuProfiler)
 	gpuProfiler = aGpuProfiler;
 }
 
+void ImguiWindowManager::setBenchmarkScene(VoxelModel* aScene)
+{
+	benchmarkScene = aScene;
+}
+
+void ImguiWindowManager::stopBenchmarks()
+{
+	// the running benchmark writes into this and reads the benchmark scene
+	benchmarkTasks.stop();
+}
+
+void ImguiWindowManager::setLoadingStatus(const char* aTaskName, int aPendingTaskCount)
+{
+	loadingTaskName = aTaskName;
+	loadingTaskCount = aPendingTaskCount;
+}
+
 void ImguiWindowManager::update(const Graphics& aGraphics, float aDeltaTime)
 {
 	//fps counter
@@ -2,30 +2,22 @@
 #include <glm\glm.hpp>
 #include "engine\logger.h"
 
-void Octree::init(VoxelModel* aModel)
+void Octree::init(const VoxelModel* aModel)
 {
 	init(aModel->sizeX, aModel->sizeY, aModel->sizeZ);
 
 	int count = 0;
-	for (int i = 0; i < aModel->sizeX * aModel->sizeY * aModel->sizeZ; i++)
+	for (const Voxel& voxel : *aModel)
 	{
-		uint32_t myPointData = aModel->data[i];
+		count++;
 
-		if (myPointData)
-		{
-			count++;
-
-			int myX = i % aModel->sizeX;
-			int myY = (i / aModel->sizeX) % aModel->sizeY;
-			int myZ = i / (aModel->sizeX * aModel->sizeY);
-
-			assert(myX < aModel->sizeX && myY < aModel->sizeY && myZ < aModel->sizeZ);
+		assert(voxel.x < aModel->sizeX && voxel.y < aModel->sizeY && voxel.z < aModel->sizeZ);
+		assert(voxel.value <= maxItemIndex && "voxel value doesn't fit in an octree item");
 
-			OctreeItem myItem;
-			myItem.data = myPointData << 3;
+		OctreeItem myItem;
+		myItem.data = voxel.value << 3;
 
-			insertItem(myX, myY, myZ, myItem);
-		}
+		insertItem(voxel.x, voxel.y, voxel.z, myItem);
 	}
 	LOG_INFO("voxels in octree: %i", count);
 }
@@ -44,6 +36,8 @@ void Octree::init(int aSizeX, int aSizeY, int aSizeZ)
 	}
 
 	size = myNextMultiple;
+
+	flatTree.clear();
 }
 
 void Octree::insertItem(int aX, int aY, int aZ, OctreeItem aItem)
@@ -120,11 +114,11 @@ void Octree::insertItem(int aX, int aY, int aZ, OctreeItem aItem)
 	}
 }
 
-const void* Octree::getData() const
+void Octree::copyData(void* aDestination) const
 {
 	assert(flatTree.size() > 0); //can't use empty octree
 
-	return &flatTree[0];
+	flatTree.copyTo(aDestination);
 }
 
 size_t Octree::getSize() const
@@ -9,6 +9,13 @@
 #include "engine\timer.h"
 #include "engine\logger.h"
 
+constexpr const char* noiseTexturePath = "resources/textures/blueNoise.png";
+
+//constexpr const char* skydomeTexturePath = "resources/textures/skydomes/studio.hdr";
+constexpr const char* skydomeTexturePath = "resources/textures/skydomes/midday.hdr";
+//constexpr const char* skydomeTexturePath = "resources/textures/skydomes/sunset.hdr";
+//constexpr const char* skydomeTexturePath = "resources/textures/skydomes/alps.hdr";
+
 Renderer::Renderer()
 {
 	graphics = new Graphics();
@@ -18,9 +25,16 @@ Renderer::Renderer()
 
 Renderer::~Renderer()
 {
+	// the load tasks and the grid benchmarks use the scene, so they have to be done before it is deleted
+	loadTasks.stop();
+	imguiWindow.stopBenchmarks();
+
 	delete graphics;
 	delete cameraController;
 	delete voxelAtlas;
+	delete scene;
+	delete octree;
+	delete voxelGrid;
 }
 
 void Renderer::init(const unsigned int aSizeX, const unsigned int aSizeY)
@@ -32,51 +46,7 @@ void Renderer::init(const unsigned int aSizeX, const unsigned int aSizeY)
 	camera = cameraController->getCamera();
 	imguiWindow.setController(cameraController);
 	imguiWindow.setGpuProfiler(graphics->getProfiler());
-
-	octree = new Octree();
 	
-	//top level scene
-	VoxelModel myMainScene = VoxelModel(128, 128, 128);
-
-	//place floor
-	VoxelModel myFloor = VoxelModel(128, 1, 128);
-	initFilled(&myFloor, 2);
-
-	myMainScene.combineModel(0, 109, 0, &myFloor);
-
-
-	//scene = VoxelModelLoader::getModel("resources/models/teapot/teapot.obj", 16);
-	//scene = VoxelModelLoader::getModel("resources/models/monkey/monkey.obj", 128);
-	scene = VoxelModelLoader::getModel("resources/models/dragon/dragon.obj", 128, 1);
-
-	myMainScene.combineModel(0, 20, 0, scene);
-
-	//scene->combineModel(0, 89, 0, &myFloor);
-
-	//scene = new VoxelModel(128, 128, 128);
-	//initFilled(scene);
-
-	//initRandomVoxels(scene, 100);
-	//initRandomVoxels(scene, 1, 2000);
-
-	placeFilledSphere(&myMainScene, 30, 50, 100, 14, 3);
-	placeFilledSphere(&myMainScene, 100, 20, 30, 14, 4);
-
-	Texture* myTexture = VoxelModelLoader::getTexture("resources/textures/blueNoise.png");
-	graphics->updateNoiseTexture(*myTexture);
-
-	//Texture* mySkyDomeTexture = VoxelModelLoader::getHdrTexture("resources/textures/skydomes/studio.hdr");
-	Texture* mySkyDomeTexture = VoxelModelLoader::getHdrTexture("resources/textures/skydomes/midday.hdr");
-	//Texture* mySkyDomeTexture = VoxelModelLoader::getHdrTexture("resources/textures/skydomes/sunset.hdr");
-	//Texture* mySkyDomeTexture = VoxelModelLoader::getHdrTexture("resources/textures/skydomes/alps.hdr");
-	graphics->updateSkydomeTexture(*mySkyDomeTexture);
-
-	octree = new Octree();
-	voxelGrid = new VoxelGrid();
-
-	octree->init(&myMainScene);
-	voxelGrid->init(&myMainScene);
-
 	{
 		VoxelAtlasItem myItem;
 
@@ -108,14 +78,103 @@ void Renderer::init(const unsigned int aSizeX, const unsigned int aSizeY)
 
 	graphics->updateVoxelAtlasVariables(*voxelAtlas);
 
-	graphics->updateOctreeVariables(*octree);
-	graphics->updateVoxelGridVariables(*voxelGrid);
+	scene = new VoxelModel(128, 128, 128);
+	octree = new Octree();
+	voxelGrid = new VoxelGrid();
+
+	// the window is up, the assets load on worker threads while the first frames only show the ui
+	// the callbacks upload to the gpu, they run from update between frames
+	loadTimer.reset();
+	loadTasks.start();
+
+	// the handles are let go after the upload, so the loader can free the textures when it needs the memory
+	const TaskId myNoiseTask = loadTasks.addTask("blue noise", [this]()
+		{
+			noiseTexture = VoxelModelLoader::getTexture(noiseTexturePath);
+		}, {}, [this]()
+		{
+			// without the file the noise texture keeps what it was created with
+			if (noiseTexture) graphics->updateNoiseTexture(*noiseTexture);
+			noiseTexture.reset();
+		});
+
+	const TaskId mySkydomeTask = loadTasks.addTask("skydome", [this]()
+		{
+			skydomeTexture = VoxelModelLoader::getHdrTexture(skydomeTexturePath);
+			if (skydomeTexture) skyIrradiance = projectSkydomeIrradiance(*skydomeTexture);
+		}, {}, [this]()
+		{
+			if (skydomeTexture)
+			{
+				graphics->updateSkydomeTexture(*skydomeTexture);
+				graphics->updateSkyIrradiance(skyIrradiance);
+			}
+			skydomeTexture.reset();
+		});
+
+	const TaskId mySceneTask = loadTasks.addTask("scene", [this]()
+		{
+			//top level scene
+			VoxelModel& myMainScene = *scene;
+
+			//place floor
+			VoxelModel myFloor = VoxelModel(128, 1, 128);
+			initFilled(&myFloor, 2);
+
+			myMainScene.combineModel(0, 109, 0, &myFloor);
+
+			//scene = VoxelModelLoader::getModel("resources/models/teapot/teapot.obj", 16);
+			//scene = VoxelModelLoader::getModel("resources/models/monkey/monkey.obj", 128);
+			// the dragon is only needed to build the scene, so it isn't kept in the loader
+			myMainScene.combineModel(0, 20, 0, VoxelModelLoader::takeModel("resources/models/dragon/dragon.obj", 128, 1));
+
+			//scene->combineModel(0, 89, 0, &myFloor);
+
+			//initRandomVoxels(scene, 100);
+			//initRandomVoxels(scene, 1, 2000);
+
+			placeFilledSphere(&myMainScene, 30, 50, 100, 14, 3);
+			placeFilledSphere(&myMainScene, 100, 20, 30, 14, 4);
+		});
+
+	// both only read the scene, so they are built at the same time
+	const TaskId myOctreeTask = loadTasks.addTask("octree", [this]()
+		{
+			octree->init(scene);
+		}, { mySceneTask }, [this]()
+		{
+			graphics->updateOctreeVariables(*octree);
+		});
+
+	const TaskId myVoxelGridTask = loadTasks.addTask("voxel grid", [this]()
+		{
+			// the floor and the sphere interiors are mostly identical solid bricks
+			voxelGrid->setBrickDeduplication(true);
+			voxelGrid->setMortonOrder(true);
+			voxelGrid->init(scene);
+		}, { mySceneTask }, [this]()
+		{
+			graphics->updateVoxelGridVariables(*voxelGrid);
+			voxelGrid->clearChanges();
+		});
+
+	// the callbacks of the dependencies ran before this one, so everything is on the gpu when the scene starts rendering
+	loadTasks.addTask("finish", nullptr, { myNoiseTask, mySkydomeTask, myOctreeTask, myVoxelGridTask }, [this]()
+		{
+			sceneLoaded = true;
+			imguiWindow.setBenchmarkScene(scene);
+
+			LOG_INFO("scene loaded in %.1f MS", loadTimer.getTotalTime() * 1000.0);
+		});
 }
 
 void Renderer::update(float aDeltaTime)
 {
 	Window::processMessages();
 
+	// uploads the assets that finished loading, no frame is being recorded here
+	loadTasks.runCompletions();
+
 	// controller updates
 	if (InputManager::getKey(Keys::f)->pressed)
 	{
@@ -139,19 +198,43 @@ void Renderer::update(float aDeltaTime)
 		cameraController->update(aDeltaTime);
 	}
 
-	graphics->updateCameraVariables(*camera, windowFocused, static_cast<int>(octree->getSize()));
-	graphics->updateAccumulationVariables(windowFocused || !cameraController->getInputsEnabled());
+	if (sceneLoaded)
+	{
+		graphics->updateCameraVariables(*camera, windowFocused, static_cast<int>(octree->getSize()));
+
+		// the accumulated frames were lit the other way
+		const SkyLighting mySkyLighting = imguiWindow.getSkyLighting();
+		const bool mySkyLightingChanged = mySkyLighting != skyLighting;
+		if (mySkyLightingChanged)
+		{
+			skyLighting = mySkyLighting;
+			graphics->setSkyLighting(skyLighting);
+		}
+
+		graphics->updateAccumulationVariables(windowFocused || !cameraController->getInputsEnabled() || mySkyLightingChanged);
+
+		// upload the voxel grid edits of this frame
+		graphics->updateVoxelGridChanges(*voxelGrid);
+		voxelGrid->clearChanges();
+	}
 
 	//rendering
 	graphics->beginFrame(); 
 
+	if (sceneLoaded)
+	{
+		graphics->renderFrame();
 
-	graphics->renderFrame();
-
-	graphics->copyAccumulationBufferToBackbuffer();
+		graphics->copyAccumulationBufferToBackbuffer();
+	}
+	else
+	{
+		graphics->clearBackbuffer();
+	}
 
 	//imgui
 	imguiWindow.setWindowResolution(Window::getWidth(), Window::getHeight());
+	imguiWindow.setLoadingStatus(sceneLoaded ? nullptr : loadTasks.getPendingTaskName(), loadTasks.getPendingTaskCount());
 
 	imguiWindow.updateAndRender(*graphics, aDeltaTime); 
 	graphics->renderImGui();							
@@ -161,5 +244,8 @@ void Renderer::update(float aDeltaTime)
 
 void Renderer::shutdown()
 {
+	loadTasks.stop();
+	imguiWindow.stopBenchmarks();
+
 	graphics->shutdown();
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "rendering/spatialHashMap.h"
+
+#include <assert.h>
+
+SpatialHashMap::SpatialHashMap(SpatialHashMap&& aMap) noexcept :
+	keys(std::move(aMap.keys)), values(std::move(aMap.values)), count(aMap.count)
+{
+	aMap.clear();
+}
+
+SpatialHashMap& SpatialHashMap::operator=(SpatialHashMap&& aMap) noexcept
+{
+	keys = std::move(aMap.keys);
+	values = std::move(aMap.values);
+	count = aMap.count;
+
+	aMap.clear();
+
+	return *this;
+}
+
+const int* SpatialHashMap::find(const glm::ivec3& aPosition) const
+{
+	if (count == 0) return nullptr;
+
+	const size_t mySlot = findSlot(packKey(aPosition));
+
+	return keys[mySlot] == emptyKey ? nullptr : &values[mySlot];
+}
+
+int* SpatialHashMap::find(const glm::ivec3& aPosition)
+{
+	return const_cast<int*>(static_cast<const SpatialHashMap*>(this)->find(aPosition));
+}
+
+int& SpatialHashMap::findOrInsert(const glm::ivec3& aPosition, int aDefault)
+{
+	// keep the map at most half full so probe sequences stay short
+	if ((count + 1) * 2 > keys.size())
+	{
+		grow();
+	}
+
+	const uint64_t myKey = packKey(aPosition);
+	const size_t mySlot = findSlot(myKey);
+
+	if (keys[mySlot] == emptyKey)
+	{
+		keys[mySlot] = myKey;
+		values[mySlot] = aDefault;
+		count++;
+	}
+
+	return values[mySlot];
+}
+
+void SpatialHashMap::erase(const glm::ivec3& aPosition)
+{
+	if (count == 0) return;
+
+	const size_t myMask = keys.size() - 1;
+	size_t mySlot = findSlot(packKey(aPosition));
+
+	if (keys[mySlot] == emptyKey) return;
+
+	// shift the following entries back so no probe sequence is broken, no tombstones needed
+	size_t myNext = mySlot;
+	while (true)
+	{
+		myNext = (myNext + 1) & myMask;
+
+		if (keys[myNext] == emptyKey) break;
+
+		const size_t myHome = hashKey(keys[myNext]) & myMask;
+
+		// only move the entry when its home slot isn't between the hole and itself
+		const bool myCanMove = mySlot <= myNext ? (myHome <= mySlot || myHome > myNext) : (myHome <= mySlot && myHome > myNext);
+		if (myCanMove)
+		{
+			keys[mySlot] = keys[myNext];
+			values[mySlot] = values[myNext];
+			mySlot = myNext;
+		}
+	}
+
+	keys[mySlot] = emptyKey;
+	count--;
+}
+
+void SpatialHashMap::clear()
+{
+	keys.clear();
+	values.clear();
+	count = 0;
+}
+
+size_t SpatialHashMap::getCount() const
+{
+	return count;
+}
+
+size_t SpatialHashMap::getMemoryUsage() const
+{
+	return keys.size() * (sizeof(uint64_t) + sizeof(int));
+}
+
+uint64_t SpatialHashMap::packKey(const glm::ivec3& aPosition)
+{
+	assert(aPosition.x >= -(1 << 20) && aPosition.x < (1 << 20));
+	assert(aPosition.y >= -(1 << 20) && aPosition.y < (1 << 20));
+	assert(aPosition.z >= -(1 << 20) && aPosition.z < (1 << 20));
+
+	return (static_cast<uint64_t>(aPosition.x) & 0x1FFFFF) |
+		((static_cast<uint64_t>(aPosition.y) & 0x1FFFFF) << 21) |
+		((static_cast<uint64_t>(aPosition.z) & 0x1FFFFF) << 42);
+}
+
+glm::ivec3 SpatialHashMap::unpackKey(uint64_t aKey)
+{
+	// sign extend the 21 bit values
+	auto myUnpack = [](uint64_t aValue) { return static_cast<int>(static_cast<int32_t>(static_cast<uint32_t>(aValue << 11)) >> 11); };
+
+	return glm::ivec3(myUnpack(aKey & 0x1FFFFF), myUnpack((aKey >> 21) & 0x1FFFFF), myUnpack((aKey >> 42) & 0x1FFFFF));
+}
+
+size_t SpatialHashMap::hashKey(uint64_t aKey)
+{
+	// splitmix64 finalizer, neighbouring cells end up far apart
+	aKey ^= aKey >> 30;
+	aKey *= 0xBF58476D1CE4E5B9ull;
+	aKey ^= aKey >> 27;
+	aKey *= 0x94D049BB133111EBull;
+	aKey ^= aKey >> 31;
+	return static_cast<size_t>(aKey);
+}
+
+size_t SpatialHashMap::findSlot(uint64_t aKey) const
+{
+	const size_t myMask = keys.size() - 1;
+
+	size_t mySlot = hashKey(aKey) & myMask;
+	while (keys[mySlot] != emptyKey && keys[mySlot] != aKey)
+	{
+		mySlot = (mySlot + 1) & myMask;
+	}
+
+	return mySlot;
+}
+
+void SpatialHashMap::grow()
+{
+	std::vector<uint64_t> myOldKeys = std::move(keys);
+	std::vector<int> myOldValues = std::move(values);
+
+	const size_t myCapacity = myOldKeys.empty() ? 64 : myOldKeys.size() * 2;
+	keys.assign(myCapacity, emptyKey);
+	values.assign(myCapacity, 0);
+
+	for (size_t i = 0; i < myOldKeys.size(); i++)
+	{
+		if (myOldKeys[i] == emptyKey) continue;
+
+		const size_t mySlot = findSlot(myOldKeys[i]);
+		keys[mySlot] = myOldKeys[i];
+		values[mySlot] = myOldValues[i];
+	}
+}
@@ -1,7 +1,11 @@
 #include "rendering/voxelAtlas.h"
 
+#include <assert.h>
+
 void VoxelAtlas::addItem(const VoxelAtlasItem& aItem)
 {
+	assert(items.size() < maxItemCount);
+
 	items.push_back(aItem);
 }
 
@@ -1,196 +1,1901 @@
 #include "rendering/voxelGrid.h"
 #include "engine/logger.h"
 
-void VoxelGrid::init(const unsigned int aSizeX, const unsigned int aSizeY, const unsigned int aSizeZ)
+#include <assert.h>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <thread>
+#include <tuple>
+#include <glm/glm.hpp>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, aValue can't be 0
+static inline int findLowestBit(uint64_t aValue)
+{
+#ifdef _MSC_VER
+	unsigned long myIndex;
+	_BitScanForward64(&myIndex, aValue);
+	return static_cast<int>(myIndex);
+#else
+	return __builtin_ctzll(aValue);
+#endif
+}
+
+// index of the highest set bit, aValue can't be 0
+static inline int findHighestBit(uint64_t aValue)
+{
+#ifdef _MSC_VER
+	unsigned long myIndex;
+	_BitScanReverse64(&myIndex, aValue);
+	return static_cast<int>(myIndex);
+#else
+	return 63 - __builtin_clzll(aValue);
+#endif
+}
+
+// interleaves the lowest 21 bits of every axis, x in the lowest bit
+static inline uint64_t encodeMorton(const glm::ivec3& aPosition)
+{
+	auto mySpreadBits = [](uint64_t aValue)
+	{
+		aValue &= 0x1FFFFF;
+		aValue = (aValue | aValue << 32) & 0x1F00000000FFFFull;
+		aValue = (aValue | aValue << 16) & 0x1F0000FF0000FFull;
+		aValue = (aValue | aValue << 8) & 0x100F00F00F00F00Full;
+		aValue = (aValue | aValue << 4) & 0x10C30C30C30C30C3ull;
+		aValue = (aValue | aValue << 2) & 0x1249249249249249ull;
+		return aValue;
+	};
+
+	return mySpreadBits(static_cast<uint32_t>(aPosition.x)) | (mySpreadBits(static_cast<uint32_t>(aPosition.y)) << 1) | (mySpreadBits(static_cast<uint32_t>(aPosition.z)) << 2);
+}
+
+// the shader hashes the top level positions the same way to find them in the sparse top level table
+static inline uint32_t hashTopLevelPosition(const glm::ivec3& aPosition)
+{
+	return (static_cast<uint32_t>(aPosition.x) * 73856093u) ^ (static_cast<uint32_t>(aPosition.y) * 19349663u) ^ (static_cast<uint32_t>(aPosition.z) * 83492791u);
+}
+
+// rounds towards negative infinity, so negative positions end up in the cell below them
+static inline glm::ivec3 floorDivide(const glm::ivec3& aPosition, int aDivisor)
+{
+	auto myDivide = [aDivisor](int aValue) { return aValue >= 0 ? aValue / aDivisor : (aValue + 1) / aDivisor - 1; };
+
+	return glm::ivec3(myDivide(aPosition.x), myDivide(aPosition.y), myDivide(aPosition.z));
+}
+
+static inline bool isBitSet(const uint64_t* aMask, int aBit)
+{
+	return (aMask[aBit >> 6] >> (aBit & 63)) & 1;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::init(const unsigned int aSizeX, const unsigned int aSizeY, const unsigned int aSizeZ)
 {
 	sizeX = aSizeX;
 	sizeY = aSizeY;
 	sizeZ = aSizeZ;
 
-	layer1CountX = sizeX / (layer1Size * layer2Size);
-	layer1CountY = sizeY / (layer1Size * layer2Size);
-	layer1CountZ = sizeZ / (layer1Size * layer2Size);
+	originX = 0;
+	originY = 0;
+	originZ = 0;
+
+	// round up so voxels in a partially filled top level chunk still fit
+	layer1CountX = (sizeX + topLevelScale - 1) / topLevelScale;
+	layer1CountY = (sizeY + topLevelScale - 1) / topLevelScale;
+	layer1CountZ = (sizeZ + topLevelScale - 1) / topLevelScale;
+
+	// the sparse top level only stores the filled chunks
+	gridLayer1Data.assign(sparseTopLevel ? 0 : static_cast<size_t>(layer1CountX) * layer1CountY * layer1CountZ, -1);
+
+	clear();
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::init(const VoxelModel* aModel, int aThreadCount)
+{
+	init(aModel->sizeX, aModel->sizeY, aModel->sizeZ);
+
+	if (aThreadCount <= 0)
+	{
+		aThreadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	// every thread takes the next free slab of top level chunks along z and runs the given function for it
+	auto myRunOverSlabs = [&](auto aFunction)
+	{
+		std::atomic<unsigned int> myNextSlab{ 0 };
+
+		auto myWorker = [&]()
+		{
+			for (unsigned int slab = myNextSlab++; slab < layer1CountZ; slab = myNextSlab++)
+			{
+				aFunction(slab);
+			}
+		};
+
+		std::vector<std::thread> myThreads;
+		for (int i = 1; i < std::min(aThreadCount, static_cast<int>(layer1CountZ)); i++)
+		{
+			myThreads.emplace_back(myWorker);
+		}
+
+		myWorker();
+
+		for (auto& thread : myThreads)
+		{
+			thread.join();
+		}
+	};
+
+	// count the chunks every slab needs per level, without building anything yet
+	std::vector<std::array<int, levelCount>> mySlabOffsets(layer1CountZ + 1);
+
+	myRunOverSlabs([&](unsigned int aSlab)
+	{
+		// a chunk of level L is one cell of level L - 1, every cell remembers the last top level chunk that counted it
+		std::array<std::vector<uint32_t>, levelCount> myCountedCells;
+		for (int level = 1; level < levelCount; level++)
+		{
+			const size_t myCellsPerAxis = topLevelScale / Layout::getCellScale(level - 1);
+			myCountedCells[level].assign(myCellsPerAxis * myCellsPerAxis * myCellsPerAxis, 0);
+		}
+
+		std::array<int, levelCount>& myCounts = mySlabOffsets[aSlab + 1];
+		myCounts.fill(0);
+
+		std::vector<int> myPalette;
+		uint32_t myStamp = 0;
+
+		for (unsigned int y = 0; y < layer1CountY; y++)
+		{
+			for (unsigned int x = 0; x < layer1CountX; x++)
+			{
+				myStamp++;
+				myPalette.assign(1, 0);
+
+				int myRejectedCount = 0;
+				const int myCount = visitTopLevelChunk(aModel, x, y, aSlab, myPalette, myRejectedCount, [&](unsigned int aX, unsigned int aY, unsigned int aZ, int)
+				{
+					for (int level = 1; level < levelCount; level++)
+					{
+						const unsigned int myCellScale = Layout::getCellScale(level - 1);
+						const unsigned int myCellsPerAxis = topLevelScale / myCellScale;
+
+						const size_t myCell = ((aX % topLevelScale) / myCellScale) + ((aY % topLevelScale) / myCellScale) * myCellsPerAxis + ((aZ % topLevelScale) / myCellScale) * myCellsPerAxis * myCellsPerAxis;
+
+						if (myCountedCells[level][myCell] == myStamp) continue;
+
+						myCountedCells[level][myCell] = myStamp;
+						myCounts[level]++;
+					}
+				});
+
+				if (myCount > 0)
+				{
+					myCounts[0]++;
+				}
+			}
+		}
+	});
+
+	// prefix sum the counts so every slab knows where its chunks go
+	mySlabOffsets[0].fill(0);
+	for (size_t i = 1; i < mySlabOffsets.size(); i++)
+	{
+		for (int level = 0; level < levelCount; level++)
+		{
+			mySlabOffsets[i][level] += mySlabOffsets[i - 1][level];
+		}
+	}
+
+	const std::array<int, levelCount>& myTotals = mySlabOffsets[layer1CountZ];
+
+	// empty chunks point to nothing, empty bricks hold item 0
+	for (int level = 0; level < levelCount; level++)
+	{
+		levels[level].assign(static_cast<size_t>(myTotals[level]) * Layout::getChunkIntCount(level), level == brickLevel ? 0 : -1);
+		occupancy[level].assign(static_cast<size_t>(myTotals[level]) * Layout::getMaskWordCount(level), 0);
+	}
+
+	palettes.resize(myTotals[0]);
+
+	// every brick is used once, by the layer 1 chunk of its own top level chunk
+	brickReferenceCounts.assign(myTotals[brickLevel], 1);
+	brickPalettes.resize(myTotals[brickLevel]);
+
+	// top level position of every layer 1 chunk, the top level is filled afterwards
+	std::vector<glm::ivec3> myTopPositions(myTotals[0]);
+	std::atomic<int> myVoxelCount{ 0 };
+
+	// build every slab straight into the levels, starting at its own offsets
+	// the chunks are taken in the same order as they were counted, so the layout doesn't depend on the thread count
+	myRunOverSlabs([&](unsigned int aSlab)
+	{
+		std::array<int, levelCount> myNextChunks = mySlabOffsets[aSlab];
+		std::vector<int> myPalette;
+
+		for (unsigned int y = 0; y < layer1CountY; y++)
+		{
+			for (unsigned int x = 0; x < layer1CountX; x++)
+			{
+				const int myTopChunk = myNextChunks[0];
+				const int myFirstBrick = myNextChunks[brickLevel];
+
+				myPalette.assign(1, 0);
+
+				int myRejectedCount = 0;
+				const int myCount = visitTopLevelChunk(aModel, x, y, aSlab, myPalette, myRejectedCount, [&](unsigned int aX, unsigned int aY, unsigned int aZ, int aPaletteIndex)
+				{
+					if (myNextChunks[0] == myTopChunk)
+					{
+						myNextChunks[0]++;
+					}
+
+					insertIntoLevel<0>(levels, occupancy, myNextChunks, myTopChunk, aX, aY, aZ, aPaletteIndex);
+				});
+
+				if (myRejectedCount)
+				{
+					LOG_ERROR("voxel grid top level chunk %u %u %u uses more than %i materials, %i voxels are left out", x, y, aSlab, maxPaletteSize - 1, myRejectedCount);
+				}
+
+				if (myCount == 0) continue;
+
+				myVoxelCount += myCount;
+
+				palettes[myTopChunk] = myPalette;
+				std::fill(brickPalettes.begin() + myFirstBrick, brickPalettes.begin() + myNextChunks[brickLevel], myTopChunk);
+				myTopPositions[myTopChunk] = glm::ivec3(x, y, aSlab);
+			}
+		}
+
+		assert(myNextChunks == mySlabOffsets[aSlab + 1] && "voxel grid slab used a different amount of chunks than it counted");
+	});
+
+	// the sparse top level can't be written from several threads
+	for (int i = 0; i < myTotals[0]; i++)
+	{
+		setTopLevelChunk(myTopPositions[i], i);
+	}
+
+	LOG_INFO("chunks in voxel grid: %i", myTotals[brickLevel]);
+	LOG_INFO("voxels in voxel grid: %i", myVoxelCount.load());
+
+	if (deduplicateOnInsert)
+	{
+		deduplicateBricks();
+	}
+
+	if (mortonOrderOnInit)
+	{
+		sortChunksMorton();
+	}
+}
+
+template<typename Layout>
+template<typename Function>
+int BasicVoxelGrid<Layout>::visitTopLevelChunk(const VoxelModel* aModel, const unsigned int aTopX, const unsigned int aTopY, const unsigned int aTopZ, std::vector<int>& aPalette, int& aRejectedCount, Function aFunction) const
+{
+	const unsigned int myMinX = aTopX * topLevelScale;
+	const unsigned int myMinY = aTopY * topLevelScale;
+	const unsigned int myMinZ = aTopZ * topLevelScale;
+
+	const unsigned int myMaxX = std::min(myMinX + topLevelScale, sizeX);
+	const unsigned int myMaxY = std::min(myMinY + topLevelScale, sizeY);
+	const unsigned int myMaxZ = std::min(myMinZ + topLevelScale, sizeZ);
+
+	// neighbouring voxels mostly share their material, remember the last palette lookup
+	int myLastItem = -1;
+	int myLastPaletteIndex = 0;
+
+	// only the model bricks overlapping the top level chunk are visited, empty space is skipped with their masks
+	const glm::ivec3 myBrickMin = glm::ivec3(myMinX, myMinY, myMinZ) / VoxelModel::brickSize;
+	const glm::ivec3 myBrickMax = (glm::ivec3(myMaxX, myMaxY, myMaxZ) + (VoxelModel::brickSize - 1)) / VoxelModel::brickSize;
+
+	int myCount = 0;
+	for (int brickZ = myBrickMin.z; brickZ < myBrickMax.z; brickZ++)
+	{
+		for (int brickY = myBrickMin.y; brickY < myBrickMax.y; brickY++)
+		{
+			for (int brickX = myBrickMin.x; brickX < myBrickMax.x; brickX++)
+			{
+				const int myModelBrick = aModel->findBrick(glm::ivec3(brickX, brickY, brickZ));
+				if (myModelBrick == -1) continue;
+
+				const uint32_t* myVoxels = aModel->getBrickVoxels(myModelBrick);
+				const uint64_t* myMask = aModel->getBrickOccupancy(myModelBrick);
+
+				for (int word = 0; word < VoxelModel::brickMaskWordCount; word++)
+				{
+					for (uint64_t myBits = myMask[word]; myBits; myBits &= myBits - 1)
+					{
+						const int myVoxelIndex = word * 64 + findLowestBit(myBits);
+
+						const unsigned int x = brickX * VoxelModel::brickSize + myVoxelIndex % VoxelModel::brickSize;
+						const unsigned int y = brickY * VoxelModel::brickSize + (myVoxelIndex / VoxelModel::brickSize) % VoxelModel::brickSize;
+						const unsigned int z = brickZ * VoxelModel::brickSize + myVoxelIndex / (VoxelModel::brickSize * VoxelModel::brickSize);
+
+						// model bricks can reach into the neighbouring top level chunks
+						if (x < myMinX || y < myMinY || z < myMinZ || x >= myMaxX || y >= myMaxY || z >= myMaxZ) continue;
+
+						const uint32_t myPointData = myVoxels[myVoxelIndex];
+						if (static_cast<int>(myPointData) != myLastItem)
+						{
+							myLastItem = static_cast<int>(myPointData);
+							myLastPaletteIndex = findPaletteEntry(aPalette, myLastItem);
+						}
+
+						// every entry of a palette built from the model is used, the voxel is left out rather than given another material
+						if (myLastPaletteIndex == -1)
+						{
+							aRejectedCount++;
+							continue;
+						}
+
+						myCount++;
+
+						aFunction(x, y, z, myLastPaletteIndex);
+					}
+				}
+			}
+		}
+	}
+
+	return myCount;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::clear()
+{
+	std::fill(gridLayer1Data.begin(), gridLayer1Data.end(), -1);
+
+	topLevelTable.clear();
+	coarseTopLevel.clear();
+
+	for (auto& level : levels)
+	{
+		level.clear();
+	}
+
+	for (auto& mask : occupancy)
+	{
+		mask.clear();
+	}
+
+	palettes.clear();
+
+	brickReferenceCounts.clear();
+	brickPalettes.clear();
+	brickTable.clear();
+
+	for (auto& list : freeChunks)
+	{
+		list.clear();
+	}
+
+	changes = VoxelGridChanges();
+	changes.chunks.resize(levelCount);
+
+	dirtyTopLevelFlags.clear();
+	for (auto& flags : dirtyChunkFlags)
+	{
+		flags.clear();
+	}
+}
+
+template<typename Layout>
+bool BasicVoxelGrid<Layout>::insertItem(const int aX, const int aY, const int aZ, int aItemIndex)
+{
+	const glm::ivec3 myPosition = glm::ivec3(aX, aY, aZ);
+
+	// get layer 1 xyz, the levels below it only see the position inside of it so they never deal with negative coordinates
+	const glm::ivec3 myTopPosition = floorDivide(myPosition, topLevelScale);
+	const glm::ivec3 myLocal = myPosition - myTopPosition * topLevelScale;
+
+	if (!sparseTopLevel)
+	{
+		assert(isInside(myPosition));
+	}
+
+	// add chunk if it doesn't exist yet, clearing a voxel in an empty chunk changes nothing
+	int myPaletteChunk = getTopLevelChunk(myTopPosition);
+	if (myPaletteChunk == -1)
+	{
+		if (!aItemIndex) return true;
+
+		// the sparse grid grows to fit the voxel, in every direction
+		if (sparseTopLevel && !isInside(myPosition))
+		{
+			growToContain(myPosition);
+		}
+
+		myPaletteChunk = createChunk(0);
+		setTopLevelChunk(myTopPosition, myPaletteChunk);
+	}
+
+	// looked up before walking down, making room in a full palette rewrites the bricks of the chunk
+	int myPaletteIndex = 0;
+	if (aItemIndex)
+	{
+		const size_t myPaletteSize = palettes[myPaletteChunk].size();
+		myPaletteIndex = findPaletteEntry(palettes[myPaletteChunk], aItemIndex);
+
+		if (myPaletteIndex == -1 && compactPalette(myPaletteChunk))
+		{
+			myPaletteIndex = findPaletteEntry(palettes[myPaletteChunk], aItemIndex);
+		}
+
+		if (myPaletteIndex == -1) return false;
+
+		if (palettes[myPaletteChunk].size() != myPaletteSize)
+		{
+			changes.hasPaletteChanges = true;
+		}
+	}
+
+	// walk down to the chunk pointing to the brick, the path is kept to free chunks that become empty
+	std::array<int, levelCount> myPathChunks{};
+	std::array<int, levelCount> myPathCells{};
+
+	int myChunkIndex = myPaletteChunk;
+	for (int level = 0; level < brickLevel; level++)
+	{
+		const int mySize = Layout::brickSizes[level];
+		const int myCellScale = Layout::getCellScale(level);
+
+		const int myCellIndex = ((myLocal.x / myCellScale) % mySize) + (((myLocal.y / myCellScale) % mySize) * mySize) + (((myLocal.z / myCellScale) % mySize) * mySize * mySize);
+
+		myPathChunks[level] = myChunkIndex;
+		myPathCells[level] = myCellIndex;
+
+		if (level == brickLevel - 1) break;
+
+		const size_t myCell = static_cast<size_t>(myChunkIndex) * Layout::getChunkIntCount(level) + myCellIndex;
+		if (levels[level][myCell] == -1)
+		{
+			if (!aItemIndex) return true;
+
+			const int myNewChunk = createChunk(level + 1);
+			levels[level][myCell] = myNewChunk;
+			occupancy[level][static_cast<size_t>(myChunkIndex) * Layout::getMaskWordCount(level) + (myCellIndex >> 6)] |= uint64_t(1) << (myCellIndex & 63);
+			markChunkDirty(level, myChunkIndex);
+		}
+
+		myChunkIndex = levels[level][myCell];
+	}
+
+	constexpr int myParentLevel = brickLevel - 1;
+	const int myCellIndex = myPathCells[myParentLevel];
+	const size_t myBrickCell = static_cast<size_t>(myChunkIndex) * Layout::getChunkIntCount(myParentLevel) + myCellIndex;
+	const size_t myMaskWord = static_cast<size_t>(myChunkIndex) * Layout::getMaskWordCount(myParentLevel) + (myCellIndex >> 6);
+	const int myOldBrick = levels[myParentLevel][myBrickCell];
+
+	if (myOldBrick == -1 && !aItemIndex) return true;
+
+	// edit a copy, the brick itself may be used by other chunks
+	std::array<int, brickIntCount> myBrick{};
+	std::array<uint64_t, brickMaskWordCount> myMask{};
+
+	if (myOldBrick != -1)
+	{
+		std::copy_n(&levels[brickLevel][static_cast<size_t>(myOldBrick) * brickIntCount], brickIntCount, myBrick.begin());
+		std::copy_n(&occupancy[brickLevel][static_cast<size_t>(myOldBrick) * brickMaskWordCount], brickMaskWordCount, myMask.begin());
+	}
+
+	setBrickItem(myBrick.data(), myMask.data(), myLocal.x, myLocal.y, myLocal.z, myPaletteIndex);
+
+	const bool myIsEmpty = std::all_of(myMask.begin(), myMask.end(), [](uint64_t aWord) { return aWord == 0; });
+
+	if (myOldBrick != -1)
+	{
+		if (std::equal(myBrick.begin(), myBrick.end(), &levels[brickLevel][static_cast<size_t>(myOldBrick) * brickIntCount])) return true;
+
+		// a brick only this chunk uses can be changed in place, unless it has to stay findable in the brick table
+		if (!myIsEmpty && brickReferenceCounts[myOldBrick] == 1 && !deduplicateOnInsert)
+		{
+			std::copy(myBrick.begin(), myBrick.end(), &levels[brickLevel][static_cast<size_t>(myOldBrick) * brickIntCount]);
+			std::copy(myMask.begin(), myMask.end(), &occupancy[brickLevel][static_cast<size_t>(myOldBrick) * brickMaskWordCount]);
+			markChunkDirty(brickLevel, myOldBrick);
+			return true;
+		}
+
+		releaseBrick(myOldBrick, myPaletteChunk);
+	}
+
+	markChunkDirty(myParentLevel, myChunkIndex);
+
+	if (!myIsEmpty)
+	{
+		levels[myParentLevel][myBrickCell] = acquireBrick(myBrick.data(), myMask.data(), myPaletteChunk);
+		occupancy[myParentLevel][myMaskWord] |= uint64_t(1) << (myCellIndex & 63);
+		return true;
+	}
+
+	// the brick is empty now, remove it and every chunk above it that has nothing left
+	levels[myParentLevel][myBrickCell] = -1;
+	occupancy[myParentLevel][myMaskWord] &= ~(uint64_t(1) << (myCellIndex & 63));
+
+	for (int level = myParentLevel; level >= 0; level--)
+	{
+		if (!isChunkEmpty(level, myPathChunks[level])) break;
+
+		freeChunk(level, myPathChunks[level]);
+
+		if (level == 0)
+		{
+			setTopLevelChunk(myTopPosition, -1);
+		}
+		else
+		{
+			const int myParentChunk = myPathChunks[level - 1];
+			const int myParentCell = myPathCells[level - 1];
+
+			levels[level - 1][static_cast<size_t>(myParentChunk) * Layout::getChunkIntCount(level - 1) + myParentCell] = -1;
+			occupancy[level - 1][static_cast<size_t>(myParentChunk) * Layout::getMaskWordCount(level - 1) + (myParentCell >> 6)] &= ~(uint64_t(1) << (myParentCell & 63));
+			markChunkDirty(level - 1, myParentChunk);
+		}
+	}
+
+	return true;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::removeItem(const int aX, const int aY, const int aZ)
+{
+	insertItem(aX, aY, aZ, 0);
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::applyEdits(const std::vector<VoxelGridEdit>& aEdits)
+{
+	// apply the edits per top level chunk so the chunks stay in cache, the stable sort keeps the order of edits to one voxel
+	std::vector<uint32_t> myOrder(aEdits.size());
+	for (uint32_t i = 0; i < myOrder.size(); i++)
+	{
+		myOrder[i] = i;
+	}
+
+	// same order as the dense top level, but doesn't depend on the grid size so edits outside a sparse grid sort too
+	auto myGetTopPosition = [](const VoxelGridEdit& aEdit)
+	{
+		const glm::ivec3 myTopPosition = floorDivide(glm::ivec3(aEdit.x, aEdit.y, aEdit.z), topLevelScale);
+		return std::make_tuple(myTopPosition.z, myTopPosition.y, myTopPosition.x);
+	};
+
+	std::stable_sort(myOrder.begin(), myOrder.end(), [&](uint32_t aLeft, uint32_t aRight)
+	{
+		return myGetTopPosition(aEdits[aLeft]) < myGetTopPosition(aEdits[aRight]);
+	});
+
+	int myRejectedCount = 0;
+	for (const uint32_t index : myOrder)
+	{
+		const VoxelGridEdit& myEdit = aEdits[index];
+		if (!insertItem(myEdit.x, myEdit.y, myEdit.z, myEdit.itemIndex))
+		{
+			myRejectedCount++;
+		}
+	}
+
+	if (myRejectedCount)
+	{
+		LOG_ERROR("%i voxel grid edits were rejected, their layer 1 chunks already use %i materials", myRejectedCount, maxPaletteSize - 1);
+	}
+
+	return myRejectedCount;
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::createChunk(int aLevel)
+{
+	int myIndex;
+	if (!freeChunks[aLevel].empty())
+	{
+		myIndex = freeChunks[aLevel].back();
+		freeChunks[aLevel].pop_back();
+
+		// empty chunks point to nothing, empty bricks hold item 0
+		const int myChunkIntCount = Layout::getChunkIntCount(aLevel);
+		const int myMaskWordCount = Layout::getMaskWordCount(aLevel);
+		std::fill_n(&levels[aLevel][static_cast<size_t>(myIndex) * myChunkIntCount], myChunkIntCount, aLevel == brickLevel ? 0 : -1);
+		std::fill_n(&occupancy[aLevel][static_cast<size_t>(myIndex) * myMaskWordCount], myMaskWordCount, 0);
+	}
+	else
+	{
+		myIndex = allocateChunk(levels, occupancy, aLevel);
+
+		if (aLevel == 0)
+		{
+			palettes.emplace_back();
+		}
+
+		if (aLevel == brickLevel)
+		{
+			brickReferenceCounts.push_back(0);
+			brickPalettes.push_back(-1);
+		}
+	}
+
+	if (aLevel == 0)
+	{
+		palettes[myIndex].assign(1, 0);
+		changes.hasPaletteChanges = true;
+	}
+
+	markChunkDirty(aLevel, myIndex);
+
+	return myIndex;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::freeChunk(int aLevel, int aChunkIndex)
+{
+	if (aLevel == 0)
+	{
+		std::vector<int>(1, 0).swap(palettes[aChunkIndex]);
+		changes.hasPaletteChanges = true;
+	}
+
+	freeChunks[aLevel].push_back(aChunkIndex);
+}
+
+template<typename Layout>
+bool BasicVoxelGrid<Layout>::isChunkEmpty(int aLevel, int aChunkIndex) const
+{
+	const int myMaskWordCount = Layout::getMaskWordCount(aLevel);
+	const uint64_t* myMask = &occupancy[aLevel][static_cast<size_t>(aChunkIndex) * myMaskWordCount];
+
+	return std::all_of(myMask, myMask + myMaskWordCount, [](uint64_t aWord) { return aWord == 0; });
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::markChunkDirty(int aLevel, int aChunkIndex)
+{
+	// everything is uploaded anyway
+	if (changes.isFullUpdate) return;
+
+	std::vector<uint8_t>& myFlags = dirtyChunkFlags[aLevel];
+	if (myFlags.size() <= static_cast<size_t>(aChunkIndex))
+	{
+		myFlags.resize(getLevelChunkCount(aLevel), 0);
+	}
+
+	if (myFlags[aChunkIndex]) return;
+
+	myFlags[aChunkIndex] = 1;
+	changes.chunks[aLevel].push_back(aChunkIndex);
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::markTopLevelDirty(const glm::ivec3& aTopPosition)
+{
+	if (changes.isFullUpdate) return;
+
+	// the sparse top level is uploaded as a whole table
+	if (sparseTopLevel)
+	{
+		changes.hasTopLevelTableChanges = true;
+		return;
+	}
+
+	const int myIndex = aTopPosition.x + (aTopPosition.y * layer1CountX) + (aTopPosition.z * layer1CountX * layer1CountY);
+
+	if (dirtyTopLevelFlags.size() < gridLayer1Data.size())
+	{
+		dirtyTopLevelFlags.resize(gridLayer1Data.size(), 0);
+	}
+
+	if (dirtyTopLevelFlags[myIndex]) return;
+
+	dirtyTopLevelFlags[myIndex] = 1;
+	changes.topLevelCells.push_back(myIndex);
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getTopLevelChunk(const glm::ivec3& aTopPosition) const
+{
+	if (sparseTopLevel)
+	{
+		const int* myChunkIndex = topLevelTable.find(aTopPosition);
+		return myChunkIndex ? *myChunkIndex : -1;
+	}
+
+	return gridLayer1Data[aTopPosition.x + (aTopPosition.y * layer1CountX) + (aTopPosition.z * layer1CountX * layer1CountY)];
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::setTopLevelChunk(const glm::ivec3& aTopPosition, int aChunkIndex)
+{
+	const int myOldChunkIndex = getTopLevelChunk(aTopPosition);
+	if (myOldChunkIndex == aChunkIndex) return;
+
+	if (sparseTopLevel)
+	{
+		if (aChunkIndex == -1)
+		{
+			topLevelTable.erase(aTopPosition);
+		}
+		else
+		{
+			topLevelTable.findOrInsert(aTopPosition, aChunkIndex) = aChunkIndex;
+		}
+	}
+	else
+	{
+		gridLayer1Data[aTopPosition.x + (aTopPosition.y * layer1CountX) + (aTopPosition.z * layer1CountX * layer1CountY)] = aChunkIndex;
+	}
+
+	// count the filled top level chunks of the coarse cell, it is removed when the last one is cleared
+	if ((myOldChunkIndex == -1) != (aChunkIndex == -1))
+	{
+		const glm::ivec3 myCoarsePosition = aTopPosition >> coarseTopLevelShift;
+		int& myCount = coarseTopLevel.findOrInsert(myCoarsePosition, 0);
+
+		myCount += aChunkIndex == -1 ? -1 : 1;
+		if (myCount == 0)
+		{
+			coarseTopLevel.erase(myCoarsePosition);
+		}
+	}
+
+	markTopLevelDirty(aTopPosition);
+}
+
+template<typename Layout>
+const VoxelGridChanges& BasicVoxelGrid<Layout>::getChanges() const
+{
+	return changes;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::clearChanges()
+{
+	for (const int index : changes.topLevelCells)
+	{
+		dirtyTopLevelFlags[index] = 0;
+	}
+	changes.topLevelCells.clear();
+
+	changes.chunks.resize(levelCount);
+	for (int level = 0; level < levelCount; level++)
+	{
+		for (const int index : changes.chunks[level])
+		{
+			dirtyChunkFlags[level][index] = 0;
+		}
+		changes.chunks[level].clear();
+	}
+
+	changes.isFullUpdate = false;
+	changes.hasPaletteChanges = false;
+	changes.hasTopLevelTableChanges = false;
+}
+
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getFreeChunkCount(int aLevel) const
+{
+	return freeChunks[aLevel].size();
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::compact()
+{
+	// edits only add palette entries, the bricks that get renumbered are compacted with the rest below
+	std::vector<uint8_t> myIsFree(getLevelChunkCount(0), 0);
+	for (const int index : freeChunks[0])
+	{
+		myIsFree[index] = 1;
+	}
+
+	for (size_t i = 0; i < myIsFree.size(); i++)
+	{
+		if (!myIsFree[i]) compactPalette(static_cast<int>(i));
+	}
+
+	for (int level = 0; level < levelCount; level++)
+	{
+		if (freeChunks[level].empty()) continue;
+
+		std::vector<int> myRemap(getLevelChunkCount(level), 0);
+		for (const int index : freeChunks[level])
+		{
+			myRemap[index] = -1;
+		}
+
+		// the chunks that are left keep their order
+		int myNewCount = 0;
+		for (int& index : myRemap)
+		{
+			if (index != -1) index = myNewCount++;
+		}
+
+		remapChunks(level, myRemap, myNewCount);
+		freeChunks[level].clear();
+	}
+
+	rebuildBrickTable();
+
+	changes.isFullUpdate = true;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::sortChunksMorton()
+{
+	// free chunks have no position to sort by
+	compact();
+
+	// position of every chunk of the current level, in units of the size of that chunk
+	std::vector<glm::ivec3> myPositions(getLevelChunkCount(0));
+
+	for (size_t i = 0; i < gridLayer1Data.size(); i++)
+	{
+		if (gridLayer1Data[i] == -1) continue;
+
+		myPositions[gridLayer1Data[i]] = glm::ivec3(i % layer1CountX, (i / layer1CountX) % layer1CountY, i / (static_cast<size_t>(layer1CountX) * layer1CountY));
+	}
+
+	// the sparse top level can reach below 0, the morton code only takes positive positions
+	const glm::ivec3 myTopMin = floorDivide(glm::ivec3(originX, originY, originZ), topLevelScale);
+	topLevelTable.forEach([&](const glm::ivec3& aTopPosition, int& aChunkIndex) { myPositions[aChunkIndex] = aTopPosition - myTopMin; });
+
+	for (int level = 0; level < levelCount; level++)
+	{
+		const int myChunkCount = static_cast<int>(getLevelChunkCount(level));
+
+		std::vector<uint64_t> myKeys(myChunkCount);
+		for (int i = 0; i < myChunkCount; i++)
+		{
+			myKeys[i] = encodeMorton(myPositions[i]);
+		}
+
+		// ties are broken by the old index, so the order is the same for every build
+		std::vector<int> myOrder(myChunkCount);
+		std::iota(myOrder.begin(), myOrder.end(), 0);
+		std::sort(myOrder.begin(), myOrder.end(), [&](int aLeft, int aRight)
+		{
+			return myKeys[aLeft] != myKeys[aRight] ? myKeys[aLeft] < myKeys[aRight] : aLeft < aRight;
+		});
+
+		std::vector<int> myRemap(myChunkCount);
+		for (int i = 0; i < myChunkCount; i++)
+		{
+			myRemap[myOrder[i]] = i;
+		}
+
+		remapChunks(level, myRemap, myChunkCount);
+
+		if (level == brickLevel) break;
+
+		// every child gets the position of its cell, a shared brick keeps the position of the first chunk using it
+		const int mySize = Layout::brickSizes[level];
+		const int myCellCount = Layout::getChunkIntCount(level);
+
+		std::vector<glm::ivec3> myChildPositions(getLevelChunkCount(level + 1));
+		std::vector<uint8_t> myHasPosition(myChildPositions.size(), 0);
+
+		for (int chunk = 0; chunk < myChunkCount; chunk++)
+		{
+			const glm::ivec3 myChunkPosition = myPositions[myOrder[chunk]] * mySize;
+			const int* myCells = &levels[level][static_cast<size_t>(chunk) * myCellCount];
+
+			for (int cell = 0; cell < myCellCount; cell++)
+			{
+				const int myChild = myCells[cell];
+				if (myChild == -1 || myHasPosition[myChild]) continue;
+
+				myHasPosition[myChild] = 1;
+				myChildPositions[myChild] = myChunkPosition + glm::ivec3(cell % mySize, (cell / mySize) % mySize, cell / (mySize * mySize));
+			}
+		}
+
+		myPositions.swap(myChildPositions);
+	}
+
+	rebuildBrickTable();
+
+	changes.isFullUpdate = true;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::setMortonOrder(bool aEnabled)
+{
+	mortonOrderOnInit = aEnabled;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::remapChunks(int aLevel, const std::vector<int>& aRemap, int aNewCount)
+{
+	const int myChunkIntCount = Layout::getChunkIntCount(aLevel);
+	const int myMaskWordCount = Layout::getMaskWordCount(aLevel);
+
+	ChunkData myLevel(static_cast<size_t>(aNewCount) * myChunkIntCount);
+	MaskData myOccupancy(static_cast<size_t>(aNewCount) * myMaskWordCount);
+
+	for (size_t i = 0; i < aRemap.size(); i++)
+	{
+		if (aRemap[i] == -1) continue;
+
+		std::copy_n(&levels[aLevel][i * myChunkIntCount], myChunkIntCount, &myLevel[static_cast<size_t>(aRemap[i]) * myChunkIntCount]);
+		std::copy_n(&occupancy[aLevel][i * myMaskWordCount], myMaskWordCount, &myOccupancy[static_cast<size_t>(aRemap[i]) * myMaskWordCount]);
+	}
+
+	levels[aLevel].swap(myLevel);
+	occupancy[aLevel].swap(myOccupancy);
+
+	if (aLevel == 0)
+	{
+		std::vector<std::vector<int>> myPalettes(aNewCount);
+		for (size_t i = 0; i < aRemap.size(); i++)
+		{
+			if (aRemap[i] != -1) myPalettes[aRemap[i]] = std::move(palettes[i]);
+		}
+		palettes.swap(myPalettes);
+
+		for (int& palette : brickPalettes)
+		{
+			if (palette != -1) palette = aRemap[palette];
+		}
+	}
+
+	if (aLevel == brickLevel)
+	{
+		std::vector<uint32_t> myReferenceCounts(aNewCount);
+		std::vector<int> myBrickPalettes(aNewCount);
+		for (size_t i = 0; i < aRemap.size(); i++)
+		{
+			if (aRemap[i] == -1) continue;
+
+			myReferenceCounts[aRemap[i]] = brickReferenceCounts[i];
+			myBrickPalettes[aRemap[i]] = brickPalettes[i];
+		}
+		brickReferenceCounts.swap(myReferenceCounts);
+		brickPalettes.swap(myBrickPalettes);
+	}
+
+	// point the level above to the new indices
+	if (aLevel == 0)
+	{
+		for (int& index : gridLayer1Data)
+		{
+			if (index != -1) index = aRemap[index];
+		}
+
+		topLevelTable.forEach([&](const glm::ivec3&, int& aChunkIndex) { aChunkIndex = aRemap[aChunkIndex]; });
+	}
+	else
+	{
+		ChunkData& myParents = levels[aLevel - 1];
+		for (size_t i = 0; i < myParents.size(); i++)
+		{
+			if (myParents[i] != -1) myParents[i] = aRemap[myParents[i]];
+		}
+	}
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::rebuildBrickTable()
+{
+	// brick indices changed, so the table has to be filled again
+	if (!deduplicateOnInsert) return;
+
+	brickTable.clear();
+	for (size_t i = 0; i < brickPalettes.size(); i++)
+	{
+		if (brickPalettes[i] == -1) continue;
+
+		brickTable.emplace(hashBrick(&levels[brickLevel][i * brickIntCount], palettes[brickPalettes[i]]), static_cast<int>(i));
+	}
+}
+
+template<typename Layout>
+template<int Level>
+void BasicVoxelGrid<Layout>::insertIntoLevel(LevelData& aLevels, OccupancyData& aOccupancy, std::array<int, levelCount>& aNextChunks, int aChunkIndex, const unsigned int aX, const unsigned int aY, const unsigned int aZ, int aItemIndex)
+{
+	constexpr int mySize = Layout::brickSizes[Level];
+	constexpr int myCellScale = Layout::getCellScale(Level);
+	constexpr int myChunkIntCount = Layout::getChunkIntCount(Level);
+
+	// local xyz of the cell inside this chunk
+	const uint32_t myX = (aX / myCellScale) % mySize;
+	const uint32_t myY = (aY / myCellScale) % mySize;
+	const uint32_t myZ = (aZ / myCellScale) % mySize;
+
+	int* myChunk = &aLevels[Level][static_cast<size_t>(aChunkIndex) * myChunkIntCount];
+	uint64_t* myMask = &aOccupancy[Level][static_cast<size_t>(aChunkIndex) * Layout::getMaskWordCount(Level)];
+
+	const uint32_t myCellIndex = myX + (myY * mySize) + (myZ * mySize * mySize);
+
+	if constexpr (Level == levelCount - 1)
+	{
+		setBrickItem(myChunk, myMask, aX, aY, aZ, aItemIndex);
+	}
+	else
+	{
+		// add chunk to the next level if it doesn't exist yet
+		if (myChunk[myCellIndex] == -1)
+		{
+			myChunk[myCellIndex] = aNextChunks[Level + 1]++;
+			myMask[myCellIndex >> 6] |= uint64_t(1) << (myCellIndex & 63);
+		}
+
+		insertIntoLevel<Level + 1>(aLevels, aOccupancy, aNextChunks, myChunk[myCellIndex], aX, aY, aZ, aItemIndex);
+	}
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::setBrickItem(int* aBrick, uint64_t* aMask, const unsigned int aX, const unsigned int aY, const unsigned int aZ, int aItemIndex)
+{
+	constexpr int mySize = Layout::brickSizes[brickLevel];
+
+	const uint32_t myX = aX % mySize;
+	const uint32_t myY = aY % mySize;
+	const uint32_t myZ = aZ % mySize;
+
+	// add item to brick
+	const uint32_t myItemIndex = (myX / 4) + (myY * (mySize / 4)) + (myZ * mySize * (mySize / 4));
+
+	assert(myItemIndex < brickIntCount);
+
+	int myBitsFlag = (0xFF << ((myX % 4) * 8));
+
+	int myOffsetItemIndex = (aItemIndex & 0xFF) << ((myX % 4) * 8);
+
+	aBrick[myItemIndex] = ((~myBitsFlag) & aBrick[myItemIndex]) + myOffsetItemIndex;
+
+	// keep the occupancy mask in sync with the item
+	const uint32_t myCellIndex = myX + (myY * mySize) + (myZ * mySize * mySize);
+	const uint64_t myBit = uint64_t(1) << (myCellIndex & 63);
+	if (aItemIndex & 0xFF)
+	{
+		aMask[myCellIndex >> 6] |= myBit;
+	}
+	else
+	{
+		aMask[myCellIndex >> 6] &= ~myBit;
+	}
+}
+
+template<typename Layout>
+uint64_t BasicVoxelGrid<Layout>::hashBrick(const int* aBrick, const std::vector<int>& aPalette)
+{
+	// FNV-1a over the atlas index of every voxel, the occupancy mask follows from them
+	uint64_t myHash = 14695981039346656037ull;
+	for (int i = 0; i < brickIntCount; i++)
+	{
+		for (int item = 0; item < 4; item++)
+		{
+			const int myPaletteIndex = (aBrick[i] >> (item * 8)) & 0xFF;
+			myHash = (myHash ^ static_cast<uint32_t>(aPalette[myPaletteIndex])) * 1099511628211ull;
+		}
+	}
+	return myHash;
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::findPaletteEntry(std::vector<int>& aPalette, int aItemIndex)
+{
+	for (size_t i = 1; i < aPalette.size(); i++)
+	{
+		if (aPalette[i] == aItemIndex) return static_cast<int>(i);
+	}
+
+	if (aPalette.size() == maxPaletteSize) return -1;
+
+	aPalette.push_back(aItemIndex);
+	return static_cast<int>(aPalette.size() - 1);
+}
+
+template<typename Layout>
+bool BasicVoxelGrid<Layout>::compactPalette(int aChunkIndex)
+{
+	constexpr int myParentLevel = brickLevel - 1;
+	constexpr int myParentIntCount = Layout::getChunkIntCount(myParentLevel);
+
+	// find the cells pointing to the bricks below the layer 1 chunk
+	std::vector<size_t> myBrickCells;
+	std::vector<int> myChunks(1, aChunkIndex);
+
+	for (int level = 0; level < brickLevel; level++)
+	{
+		std::vector<int> myChildren;
+		for (const int index : myChunks)
+		{
+			const size_t myFirstCell = static_cast<size_t>(index) * Layout::getChunkIntCount(level);
+			for (int i = 0; i < Layout::getChunkIntCount(level); i++)
+			{
+				const int myChild = levels[level][myFirstCell + i];
+				if (myChild == -1) continue;
+
+				if (level == myParentLevel)
+				{
+					myBrickCells.push_back(myFirstCell + i);
+				}
+				else
+				{
+					myChildren.push_back(myChild);
+				}
+			}
+		}
+		myChunks = std::move(myChildren);
+	}
+
+	std::vector<int>& myPalette = palettes[aChunkIndex];
+
+	std::vector<uint8_t> myIsUsed(myPalette.size(), 0);
+	myIsUsed[0] = 1;
+
+	for (const size_t cell : myBrickCells)
+	{
+		const int* myBrick = &levels[brickLevel][static_cast<size_t>(levels[myParentLevel][cell]) * brickIntCount];
+		for (int i = 0; i < brickIntCount; i++)
+		{
+			for (int item = 0; item < 4; item++)
+			{
+				myIsUsed[(myBrick[i] >> (item * 8)) & 0xFF] = 1;
+			}
+		}
+	}
+
+	// the entries that are left keep their order
+	std::vector<int> myRemap(myPalette.size(), -1);
+	int myNewSize = 0;
+	for (size_t i = 0; i < myPalette.size(); i++)
+	{
+		if (myIsUsed[i]) myRemap[i] = myNewSize++;
+	}
 
-	gridLayer1DataSize = layer1CountX * layer1CountY * layer1CountZ;
-	gridLayer1Data = new int[gridLayer1DataSize];
+	if (static_cast<size_t>(myNewSize) == myPalette.size()) return false;
 
-	clear();
+	// bricks are released while the old palette is still there, the brick table is keyed by what it maps them to
+	struct RenumberedBrick
+	{
+		size_t cell;
+		std::array<int, brickIntCount> items;
+		std::array<uint64_t, brickMaskWordCount> mask;
+	};
+	std::vector<RenumberedBrick> myReleasedBricks;
+
+	for (const size_t cell : myBrickCells)
+	{
+		const int myOldBrick = levels[myParentLevel][cell];
+		int* myBrick = &levels[brickLevel][static_cast<size_t>(myOldBrick) * brickIntCount];
+
+		RenumberedBrick myRenumbered;
+		myRenumbered.cell = cell;
+
+		for (int i = 0; i < brickIntCount; i++)
+		{
+			uint32_t myItems = 0;
+			for (int item = 0; item < 4; item++)
+			{
+				myItems |= static_cast<uint32_t>(myRemap[(myBrick[i] >> (item * 8)) & 0xFF]) << (item * 8);
+			}
+			myRenumbered.items[i] = static_cast<int>(myItems);
+		}
+
+		if (std::equal(myRenumbered.items.begin(), myRenumbered.items.end(), myBrick)) continue;
+
+		// same rules as insertItem, a brick only this chunk uses is changed in place unless it has to stay findable in the brick table
+		if (brickReferenceCounts[myOldBrick] == 1 && !deduplicateOnInsert)
+		{
+			std::copy(myRenumbered.items.begin(), myRenumbered.items.end(), myBrick);
+			markChunkDirty(brickLevel, myOldBrick);
+			continue;
+		}
+
+		// renumbering keeps the voxels where they are
+		std::copy_n(&occupancy[brickLevel][static_cast<size_t>(myOldBrick) * brickMaskWordCount], brickMaskWordCount, myRenumbered.mask.begin());
+
+		releaseBrick(myOldBrick, aChunkIndex);
+		myReleasedBricks.push_back(myRenumbered);
+	}
+
+	std::vector<int> myNewPalette(myNewSize);
+	for (size_t i = 0; i < myPalette.size(); i++)
+	{
+		if (myRemap[i] != -1) myNewPalette[myRemap[i]] = myPalette[i];
+	}
+	myPalette.swap(myNewPalette);
+	changes.hasPaletteChanges = true;
+
+	for (const RenumberedBrick& brick : myReleasedBricks)
+	{
+		levels[myParentLevel][brick.cell] = acquireBrick(brick.items.data(), brick.mask.data(), aChunkIndex);
+		markChunkDirty(myParentLevel, static_cast<int>(brick.cell / myParentIntCount));
+	}
+
+	return true;
 }
 
-void VoxelGrid::init(VoxelModel* aModel)
+template<typename Layout>
+int BasicVoxelGrid<Layout>::acquireBrick(const int* aBrick, const uint64_t* aMask, int aPaletteIndex)
 {
-	init(aModel->sizeX, aModel->sizeY, aModel->sizeZ);
+	const uint64_t myHash = hashBrick(aBrick, palettes[aPaletteIndex]);
+
+	if (deduplicateOnInsert)
+	{
+		const int myExisting = findBrick(aBrick, myHash, palettes[aPaletteIndex]);
+		if (myExisting != -1)
+		{
+			brickReferenceCounts[myExisting]++;
+			return myExisting;
+		}
+	}
 
-	int count = 0;
-	for (int i = 0; i < aModel->sizeX * aModel->sizeY * aModel->sizeZ; i++)
+	const int myIndex = createChunk(brickLevel);
+
+	std::copy_n(aBrick, brickIntCount, &levels[brickLevel][static_cast<size_t>(myIndex) * brickIntCount]);
+	std::copy_n(aMask, brickMaskWordCount, &occupancy[brickLevel][static_cast<size_t>(myIndex) * brickMaskWordCount]);
+	brickReferenceCounts[myIndex] = 1;
+	brickPalettes[myIndex] = aPaletteIndex;
+
+	if (deduplicateOnInsert)
 	{
-		uint32_t myPointData = aModel->data[i];
+		brickTable.emplace(myHash, myIndex);
+	}
+
+	return myIndex;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::releaseBrick(int aBrickIndex, int aPaletteIndex)
+{
+	assert(brickReferenceCounts[aBrickIndex] > 0);
 
-		if (myPointData)
+	if (--brickReferenceCounts[aBrickIndex] > 0)
+	{
+		// the palette of this chunk may change or go away, the other chunks keep the brick but it can't be shared anymore
+		if (brickPalettes[aBrickIndex] == aPaletteIndex)
 		{
-			count++;
+			removeFromBrickTable(aBrickIndex);
+			brickPalettes[aBrickIndex] = -1;
+		}
+		return;
+	}
+
+	removeFromBrickTable(aBrickIndex);
+	brickPalettes[aBrickIndex] = -1;
+
+	freeChunk(brickLevel, aBrickIndex);
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::removeFromBrickTable(int aBrickIndex)
+{
+	if (!deduplicateOnInsert || brickPalettes[aBrickIndex] == -1) return;
 
-			int myX = i % aModel->sizeX;
-			int myY = (i / aModel->sizeX) % aModel->sizeY;
-			int myZ = i / (aModel->sizeX * aModel->sizeY);
+	auto myRange = brickTable.equal_range(hashBrick(&levels[brickLevel][static_cast<size_t>(aBrickIndex) * brickIntCount], palettes[brickPalettes[aBrickIndex]]));
+	for (auto it = myRange.first; it != myRange.second; it++)
+	{
+		if (it->second == aBrickIndex)
+		{
+			brickTable.erase(it);
+			break;
+		}
+	}
+}
 
-			assert(myX < aModel->sizeX&& myY < aModel->sizeY&& myZ < aModel->sizeZ);
+template<typename Layout>
+int BasicVoxelGrid<Layout>::findBrick(const int* aBrick, uint64_t aHash, const std::vector<int>& aPalette) const
+{
+	auto myRange = brickTable.equal_range(aHash);
+	for (auto it = myRange.first; it != myRange.second; it++)
+	{
+		if (!std::equal(aBrick, aBrick + brickIntCount, &levels[brickLevel][static_cast<size_t>(it->second) * brickIntCount])) continue;
 
-			insertItem(myX, myY, myZ, myPointData);
+		const std::vector<int>& myPalette = palettes[brickPalettes[it->second]];
 
-			/*if (myPointData == 1)
+		bool myIsSame = true;
+		for (int i = 0; i < brickIntCount && myIsSame; i++)
+		{
+			for (int item = 0; item < 4; item++)
 			{
-				int myIndex = 8;
-				insertItem(myX, myY, myZ, myIndex);
+				const int myPaletteIndex = (aBrick[i] >> (item * 8)) & 0xFF;
+				if (myPalette[myPaletteIndex] != aPalette[myPaletteIndex])
+				{
+					myIsSame = false;
+					break;
+				}
 			}
-			else
+		}
+
+		if (myIsSame) return it->second;
+	}
+
+	return -1;
+}
+
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::deduplicateBricks()
+{
+	const size_t myBrickCount = getLevelChunkCount(brickLevel);
+
+	if (myBrickCount == 0) return 0;
+
+	// count the chunks using every brick, bricks nobody uses are dropped
+	std::vector<uint32_t> myReferences(myBrickCount, 0);
+	ChunkData& myParents = levels[brickLevel - 1];
+	for (size_t i = 0; i < myParents.size(); i++)
+	{
+		if (myParents[i] != -1) myReferences[myParents[i]]++;
+	}
+
+	// find the layer 1 chunk above every brick, its palette tells what the brick holds
+	std::vector<int> myOwners(myBrickCount, -1);
+	for (size_t chunk = 0; chunk < getLevelChunkCount(0); chunk++)
+	{
+		std::vector<int> myChunks(1, static_cast<int>(chunk));
+		for (int level = 0; level < brickLevel; level++)
+		{
+			std::vector<int> myChildren;
+			for (const int index : myChunks)
 			{
-				int myIndex = (rand() % 7) + 1;
-				insertItem(myX, myY, myZ, myIndex);
-			}*/
+				const int* myChunk = &levels[level][static_cast<size_t>(index) * Layout::getChunkIntCount(level)];
+				for (int i = 0; i < Layout::getChunkIntCount(level); i++)
+				{
+					if (myChunk[i] != -1) myChildren.push_back(myChunk[i]);
+				}
+			}
+			myChunks = std::move(myChildren);
+		}
+
+		for (const int brick : myChunks)
+		{
+			myOwners[brick] = static_cast<int>(chunk);
+		}
+	}
+
+	// compact the bricks in place, a brick only moves to a lower index so nothing is overwritten before it is read
+	std::vector<int> myRemap(myBrickCount, -1);
+	std::vector<uint32_t> myNewReferences;
+	brickTable.clear();
+	brickPalettes.clear();
+
+	int myNewCount = 0;
+	for (size_t i = 0; i < myBrickCount; i++)
+	{
+		if (!myReferences[i]) continue;
+
+		const int* myBrick = &levels[brickLevel][i * brickIntCount];
+		const std::vector<int>& myPalette = palettes[myOwners[i]];
+		const uint64_t myHash = hashBrick(myBrick, myPalette);
+
+		const int myExisting = findBrick(myBrick, myHash, myPalette);
+		if (myExisting != -1)
+		{
+			myRemap[i] = myExisting;
+			myNewReferences[myExisting] += myReferences[i];
+			continue;
+		}
+
+		if (static_cast<size_t>(myNewCount) != i)
+		{
+			std::copy_n(myBrick, brickIntCount, &levels[brickLevel][static_cast<size_t>(myNewCount) * brickIntCount]);
+			std::copy_n(&occupancy[brickLevel][i * brickMaskWordCount], brickMaskWordCount, &occupancy[brickLevel][static_cast<size_t>(myNewCount) * brickMaskWordCount]);
 		}
+
+		brickTable.emplace(myHash, myNewCount);
+		myRemap[i] = myNewCount;
+		myNewReferences.push_back(myReferences[i]);
+		brickPalettes.push_back(myOwners[i]);
+		myNewCount++;
+	}
+
+	levels[brickLevel].resize(static_cast<size_t>(myNewCount) * brickIntCount);
+	occupancy[brickLevel].resize(static_cast<size_t>(myNewCount) * brickMaskWordCount);
+
+	for (size_t i = 0; i < myParents.size(); i++)
+	{
+		if (myParents[i] != -1) myParents[i] = myRemap[myParents[i]];
+	}
+
+	brickReferenceCounts = std::move(myNewReferences);
+	freeChunks[brickLevel].clear();
+
+	// bricks moved, so everything has to be uploaded again
+	changes.isFullUpdate = true;
+
+	if (!deduplicateOnInsert)
+	{
+		brickTable.clear();
 	}
 
-	LOG_INFO("chunks in voxel grid: %i", layer2Chunks.size());
-	LOG_INFO("voxels in voxel grid: %i", count);
+	LOG_INFO("deduplicated voxel grid bricks: %i -> %i", static_cast<int>(myBrickCount), myNewCount);
+
+	return myBrickCount - myNewCount;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::setBrickDeduplication(bool aEnabled)
+{
+	if (deduplicateOnInsert == aEnabled) return;
+
+	deduplicateOnInsert = aEnabled;
+
+	if (aEnabled)
+	{
+		// every brick has to be unique and in the brick table before inserts can look them up
+		deduplicateBricks();
+	}
+	else
+	{
+		brickTable.clear();
+	}
 }
 
-void VoxelGrid::clear()
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getItem(const int aX, const int aY, const int aZ) const
 {
-	for (int i = 0; i < gridLayer1DataSize; i++)
+	if (!isInside(glm::ivec3(aX, aY, aZ)))
 	{
-		gridLayer1Data[i] = -1;
+		// a sparse grid is empty outside of its size
+		assert(sparseTopLevel);
+		return 0;
 	}
 
-	layer1Chunks.clear();
-	layer2Chunks.clear();
+	const int myItem = sampleLevel<-1>(0, glm::ivec3(aX, aY, aZ));
+
+	return myItem > 0 ? myItem : 0;
 }
 
-void VoxelGrid::insertItem(const unsigned int aX, const unsigned int aY, const unsigned int aZ, int aItemIndex)
+template<typename Layout>
+template<int Level>
+int BasicVoxelGrid<Layout>::sampleLevel(int aChunkIndex, const glm::ivec3& aPosition, int* aBrickIndex) const
 {
-	// get layer 1 xyz and index
-	const uint32_t myLayer1ChunkX = aX / (layer1Size * layer2Size);
-	const uint32_t myLayer1ChunkY = aY / (layer1Size * layer2Size);
-	const uint32_t myLayer1ChunkZ = aZ / (layer1Size * layer2Size);
-	
-	const uint32_t myLayer1ChunkIndex = myLayer1ChunkX + (myLayer1ChunkY * layer1CountX) + (myLayer1ChunkZ * layer1CountX * layer1CountY);
-	assert(myLayer1ChunkIndex < gridLayer1DataSize);
+	constexpr int myCellScale = Layout::getCellScale(Level);
+
+	if constexpr (Level == -1)
+	{
+		const glm::ivec3 myTopPosition = floorDivide(aPosition, topLevelScale);
+		const int myChunkIndex = getTopLevelChunk(myTopPosition);
+
+		if (myChunkIndex == -1)
+		{
+			// skip the whole coarse cell when none of its top level chunks are filled
+			if (!coarseTopLevel.find(myTopPosition >> coarseTopLevelShift)) return -(myCellScale << coarseTopLevelShift);
+
+			return -myCellScale;
+		}
+
+		// the levels below work on the position inside the top level chunk
+		const int myItem = sampleLevel<0>(myChunkIndex, aPosition - myTopPosition * topLevelScale, aBrickIndex);
 
-	// add chunk to the vector if it doesn't exist yet
-	if (gridLayer1Data[myLayer1ChunkIndex] == -1)
+		return myItem > 0 ? palettes[myChunkIndex][myItem] : myItem;
+	}
+	else
 	{
-		gridLayer1Data[myLayer1ChunkIndex] = layer1Chunks.size();
-		layer1Chunks.push_back({});
+		constexpr int mySize = Layout::brickSizes[Level];
+		constexpr int myChunkIntCount = Layout::getChunkIntCount(Level);
+
+		const int myX = (aPosition.x / myCellScale) % mySize;
+		const int myY = (aPosition.y / myCellScale) % mySize;
+		const int myZ = (aPosition.z / myCellScale) % mySize;
+
+		const uint64_t* myMask = &occupancy[Level][static_cast<size_t>(aChunkIndex) * Layout::getMaskWordCount(Level)];
+		const int myCellIndex = myX + (myY * mySize) + (myZ * mySize * mySize);
+
+		if (!isBitSet(myMask, myCellIndex)) 
+		{
+			if constexpr (Level == levelCount - 1)
+			{
+				if (aBrickIndex) *aBrickIndex = aChunkIndex;
+			}
+
+			return -myCellScale;
+		}
+
+		const int* myChunk = &levels[Level][static_cast<size_t>(aChunkIndex) * myChunkIntCount];
+
+		if constexpr (Level == levelCount - 1)
+		{
+			const int myCombinedItems = myChunk[(myX / 4) + (myY * (mySize / 4)) + (myZ * mySize * (mySize / 4))];
+
+			return (myCombinedItems >> ((myX % 4) * 8)) & 0xFF;
+		}
+		else
+		{
+			return sampleLevel<Level + 1>(myChunk[myCellIndex], aPosition, aBrickIndex);
+		}
 	}
+}
+
+template<typename Layout>
+bool BasicVoxelGrid<Layout>::isInside(const glm::ivec3& aPosition) const
+{
+	return aPosition.x >= originX && aPosition.y >= originY && aPosition.z >= originZ &&
+		aPosition.x - originX < static_cast<int>(sizeX) && aPosition.y - originY < static_cast<int>(sizeY) && aPosition.z - originZ < static_cast<int>(sizeZ);
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::growToContain(const glm::ivec3& aPosition)
+{
+	const glm::ivec3 myOrigin = glm::ivec3(originX, originY, originZ);
+
+	// an empty grid has nothing to keep, it starts at the voxel
+	const bool myIsEmpty = sizeX == 0 || sizeY == 0 || sizeZ == 0;
+	const glm::ivec3 myMin = myIsEmpty ? aPosition : glm::min(myOrigin, aPosition);
+	const glm::ivec3 myMax = myIsEmpty ? aPosition : glm::max(myOrigin + glm::ivec3(sizeX, sizeY, sizeZ) - 1, aPosition);
+
+	originX = myMin.x;
+	originY = myMin.y;
+	originZ = myMin.z;
+
+	sizeX = myMax.x - myMin.x + 1;
+	sizeY = myMax.y - myMin.y + 1;
+	sizeZ = myMax.z - myMin.z + 1;
+
+	// top level chunks the grid touches, counted from the one holding the origin
+	const glm::ivec3 myTopCount = floorDivide(myMax, topLevelScale) - floorDivide(myMin, topLevelScale) + 1;
+
+	layer1CountX = myTopCount.x;
+	layer1CountY = myTopCount.y;
+	layer1CountZ = myTopCount.z;
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::setSparseTopLevel(bool aEnabled)
+{
+	assert(levels[0].empty()); //has to be set before init
+
+	sparseTopLevel = aEnabled;
+}
+
+template<typename Layout>
+bool BasicVoxelGrid<Layout>::isSparseTopLevel() const
+{
+	return sparseTopLevel;
+}
+
+template<typename Layout>
+VoxelGridHit BasicVoxelGrid<Layout>::traverseRay(const glm::vec3& aOrigin, const glm::vec3& aDirection) const
+{
+	VoxelGridHit myResult;
+
+	const glm::ivec3 myMinPosition = glm::ivec3(originX, originY, originZ);
+	const glm::ivec3 myMaxPosition = myMinPosition + glm::ivec3(sizeX, sizeY, sizeZ) - 1;
+	const glm::vec3 myDelta = 1.f / aDirection;
+
+	// intersect grid bounds
+	const glm::vec3 myTMin = (glm::vec3(myMinPosition) - aOrigin) * myDelta;
+	const glm::vec3 myTMax = (glm::vec3(myMaxPosition + 1) - aOrigin) * myDelta;
+
+	const glm::vec3 myT1 = glm::min(myTMin, myTMax);
+	const glm::vec3 myT2 = glm::max(myTMin, myTMax);
+
+	const float myNear = std::max(std::max(myT1.x, myT1.y), myT1.z);
+	const float myFar = std::min(std::min(myT2.x, myT2.y), myT2.z);
+
+	if (myNear >= myFar || myFar <= 0.f) return myResult;
+
+	float myDistance = std::max(myNear, 0.f);
+
+	const glm::ivec3 myStep = glm::ivec3(glm::sign(aDirection));
 
-	// get chunk
-	Layer1Chunk& myLayer1chunk = layer1Chunks[gridLayer1Data[myLayer1ChunkIndex]];
-	
-	// get layer 2 xyz
-	const uint32_t myLayer2ChunkX = (aX - myLayer1ChunkX * (layer1Size * layer2Size)) / layer1Size;
-	const uint32_t myLayer2ChunkY = (aY - myLayer1ChunkY * (layer1Size * layer2Size)) / layer1Size;
-	const uint32_t myLayer2ChunkZ = (aZ - myLayer1ChunkZ * (layer1Size * layer2Size)) / layer1Size;
-	
-	const uint32_t myLayer2ChunkIndex = myLayer2ChunkX + (myLayer2ChunkY * layer1Size) + (myLayer2ChunkZ * layer1Size * layer1Size);
-	
-	// add chunk to the vector if it doesn't exist yet
-	if (myLayer1chunk.itemIndices[myLayer2ChunkIndex] == -1)
+	glm::ivec3 myPosition = glm::clamp(glm::ivec3(glm::floor(aOrigin + aDirection * myDistance)), myMinPosition, myMaxPosition);
+
+	// normal of the face the ray entered the grid through
+	glm::vec3 myNormal{ 0.f, 0.f, 0.f };
+	if (myNear > 0.f)
 	{
-		myLayer1chunk.itemIndices[myLayer2ChunkIndex] = layer2Chunks.size();
-		layer2Chunks.push_back({});
+		const int myAxis = myNear == myT1.x ? 0 : (myNear == myT1.y ? 1 : 2);
+		myNormal[myAxis] = static_cast<float>(-myStep[myAxis]);
 	}
 
-	// get chunk
-	Layer2Chunk& mychunk = layer2Chunks[myLayer1chunk.itemIndices[myLayer2ChunkIndex]];
-	
-	// add item to chunk
-	const uint32_t myX = (aX % (layer1Size * layer2Size)) % layer1Size;
-	const uint32_t myY = (aY % (layer1Size * layer2Size)) % layer1Size;
-	const uint32_t myZ = (aZ % (layer1Size * layer2Size)) % layer1Size;
+	// axis aligned rays can jump straight to the next filled voxel of a brick using the occupancy mask
+	const bool myIsAxisAligned = (myStep.x != 0) + (myStep.y != 0) + (myStep.z != 0) == 1;
+	const int myAlignedAxis = myStep.x != 0 ? 0 : (myStep.y != 0 ? 1 : 2);
+
+	while (true)
+	{
+		myResult.loopCount++;
+
+		int myBrickIndex = -1;
+		const int mySample = sampleLevel<-1>(0, myPosition, &myBrickIndex);
+
+		if (mySample > 0)
+		{
+			myResult.distance = myDistance;
+			myResult.normal = myNormal;
+			myResult.itemIndex = mySample;
+			return myResult;
+		}
+
+		if (myIsAxisAligned && myBrickIndex != -1)
+		{
+			const int myStepCount = findNextOccupiedCell(myBrickIndex, myPosition, myAlignedAxis, myStep[myAlignedAxis]);
+
+			myPosition[myAlignedAxis] += myStepCount * myStep[myAlignedAxis];
+
+			const int myPlane = myStep[myAlignedAxis] > 0 ? myPosition[myAlignedAxis] : myPosition[myAlignedAxis] + 1;
+			myDistance = (static_cast<float>(myPlane) - aOrigin[myAlignedAxis]) * myDelta[myAlignedAxis];
+
+			if (myDistance >= myFar || myPosition[myAlignedAxis] < myMinPosition[myAlignedAxis] || myPosition[myAlignedAxis] > myMaxPosition[myAlignedAxis]) return myResult;
+
+			myNormal = glm::vec3(0.f);
+			myNormal[myAlignedAxis] = static_cast<float>(-myStep[myAlignedAxis]);
+			continue;
+		}
+
+		// skip the whole empty cell
+		const int myScale = -mySample;
+		const glm::ivec3 myCellMin = floorDivide(myPosition, myScale) * myScale;
+		const glm::ivec3 myCellMax = myCellMin + (myScale - 1);
+
+		glm::vec3 myExit{ FLT_MAX, FLT_MAX, FLT_MAX };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (myStep[axis] > 0) myExit[axis] = (static_cast<float>(myCellMax[axis] + 1) - aOrigin[axis]) * myDelta[axis];
+			if (myStep[axis] < 0) myExit[axis] = (static_cast<float>(myCellMin[axis]) - aOrigin[axis]) * myDelta[axis];
+		}
+
+		const int myAxis = (myExit.x <= myExit.y && myExit.x <= myExit.z) ? 0 : (myExit.y <= myExit.z ? 1 : 2);
+		myDistance = myExit[myAxis];
+
+		if (myDistance >= myFar) return myResult;
+
+		// the exit axis steps out of the cell, the other axes stay inside of it
+		const glm::ivec3 myNextPosition = glm::ivec3(glm::floor(aOrigin + aDirection * myDistance));
+		myPosition = glm::clamp(myNextPosition, myCellMin, myCellMax);
+		myPosition[myAxis] = myStep[myAxis] > 0 ? myCellMax[myAxis] + 1 : myCellMin[myAxis] - 1;
+
+		if (glm::any(glm::lessThan(myPosition, myMinPosition)) || glm::any(glm::greaterThan(myPosition, myMaxPosition))) return myResult;
+
+		myNormal = glm::vec3(0.f);
+		myNormal[myAxis] = static_cast<float>(-myStep[myAxis]);
+	}
+}
 
-	const uint32_t myItemIndex = myY + (myZ * layer2Size);
+template<typename Layout>
+int BasicVoxelGrid<Layout>::findNextOccupiedCell(int aBrickIndex, const glm::ivec3& aPosition, int aAxis, int aStep) const
+{
+	constexpr int mySize = Layout::brickSizes[levelCount - 1];
+	const uint64_t* myMask = &occupancy[levelCount - 1][static_cast<size_t>(aBrickIndex) * Layout::getMaskWordCount(levelCount - 1)];
 
-	assert(myItemIndex < layer2Size * layer2Size * layer2Size);
+	const glm::ivec3 myLocal = aPosition - floorDivide(aPosition, mySize) * mySize;
+	const int myAxisStride = aAxis == 0 ? 1 : (aAxis == 1 ? mySize : mySize * mySize);
 
-	int myBitsFlag = (0xFF << (myX * 8));
+	// gather the line of cells along the axis into the low bits
+	int myLineStart = myLocal.x + myLocal.y * mySize + myLocal.z * mySize * mySize - myLocal[aAxis] * myAxisStride;
 
-	int myOffsetItemIndex = (aItemIndex & 0xFF) << (myX * 8);
+	uint64_t myLine = 0;
+	if (aAxis == 0 && mySize <= 64 && (myLineStart & 63) + mySize <= 64)
+	{
+		// x lines are contiguous in the mask
+		myLine = (myMask[myLineStart >> 6] >> (myLineStart & 63)) & ((mySize == 64) ? ~uint64_t(0) : ((uint64_t(1) << mySize) - 1));
+	}
+	else
+	{
+		for (int i = 0; i < mySize; i++)
+		{
+			myLine |= uint64_t(isBitSet(myMask, myLineStart + i * myAxisStride)) << i;
+		}
+	}
 
-	mychunk.items[myItemIndex] = ((~myBitsFlag) & mychunk.items[myItemIndex]) + myOffsetItemIndex;
+	const int myCurrent = myLocal[aAxis];
 
-	/*const uint32_t myChunkIndex = myChunkX + (myChunkY * layer1CountX) + (myChunkZ * layer1CountX * layer1CountY);
+	if (aStep > 0)
+	{
+		const uint64_t myAhead = myCurrent + 1 < 64 ? myLine >> (myCurrent + 1) : 0;
 
-	assert(myChunkIndex < gridDataSize);
+		// step out of the brick when nothing is left
+		if (!myAhead) return mySize - myCurrent;
 
-	if (gridLayer1Data[myChunkIndex] == -1)
+		return findLowestBit(myAhead) + 1;
+	}
+	else
 	{
-		gridLayer1Data[myChunkIndex] = layer2Chunks.size();
-		layer2Chunks.push_back({});
+		const uint64_t myBehind = myLine & ((uint64_t(1) << myCurrent) - 1);
+
+		if (!myBehind) return myCurrent + 1;
+
+		return myCurrent - findHighestBit(myBehind);
 	}
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::allocateChunk(LevelData& aLevels, OccupancyData& aOccupancy, int aLevel)
+{
+	ChunkData& myLevel = aLevels[aLevel];
+	const int myChunkIntCount = Layout::getChunkIntCount(aLevel);
+
+	const int myIndex = static_cast<int>(myLevel.size() / myChunkIntCount);
+
+	// empty chunks point to nothing, empty bricks hold item 0
+	myLevel.resize(myLevel.size() + myChunkIntCount, aLevel == levelCount - 1 ? 0 : -1);
+	aOccupancy[aLevel].resize(aOccupancy[aLevel].size() + Layout::getMaskWordCount(aLevel), 0);
+
+	return myIndex;
+}
+
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getGridSize() const
+{
+	return gridLayer1Data.size();
+}
+
+template<typename Layout>
+const void* BasicVoxelGrid<Layout>::getGridData() const
+{
+	return gridLayer1Data.data();
+}
+
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getLayer1ChunkDataSize() const
+{
+	return getLevelChunkCount(0);
+}
+
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getLayer2ChunkDataSize() const
+{
+	return getLevelChunkCount(levelCount - 1);
+}
+
+template<typename Layout>
+void BasicVoxelGrid<Layout>::getPaletteData(std::vector<int>& aOffsets, std::vector<int>& aEntries) const
+{
+	aOffsets.resize(palettes.size());
+	aEntries.clear();
+	aEntries.reserve(getPaletteEntryCount());
 
-	VoxelChunk& mychunk = layer2Chunks[gridData[myChunkIndex]];
+	for (size_t i = 0; i < palettes.size(); i++)
+	{
+		aOffsets[i] = static_cast<int>(aEntries.size());
+		aEntries.insert(aEntries.end(), palettes[i].begin(), palettes[i].end());
+	}
+}
 
-	const uint32_t myX = aX % layer1Size;
-	const uint32_t myY = aY % layer1Size;
-	const uint32_t myZ = aZ % layer1Size;
+template<typename Layout>
+void BasicVoxelGrid<Layout>::getTopLevelTableData(std::vector<int>& aSlots) const
+{
+	const size_t mySlotCount = getTopLevelTableSlotCount();
+	const size_t mySlotMask = mySlotCount - 1;
 
-	const uint32_t myItemIndex = myX + (myY * layer1Size) + (myZ * layer1Size * layer1Size);
+	aSlots.assign(mySlotCount * 4, -1);
 
-	assert(myItemIndex < layer1Size * layer1Size * layer1Size);
+	topLevelTable.forEach([&](const glm::ivec3& aTopPosition, const int& aChunkIndex)
+	{
+		size_t mySlot = hashTopLevelPosition(aTopPosition) & mySlotMask;
+		while (aSlots[mySlot * 4 + 3] != -1)
+		{
+			mySlot = (mySlot + 1) & mySlotMask;
+		}
 
-	aItem.filled = 1.f;
-	mychunk.items[myItemIndex] = aItem;*/
+		aSlots[mySlot * 4 + 0] = aTopPosition.x;
+		aSlots[mySlot * 4 + 1] = aTopPosition.y;
+		aSlots[mySlot * 4 + 2] = aTopPosition.z;
+		aSlots[mySlot * 4 + 3] = aChunkIndex;
+	});
 }
 
-size_t VoxelGrid::getGridSize() const
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getTopLevelTableSlotCount() const
 {
-	return gridLayer1DataSize;
+	// at most half full, so the shader always reaches an empty slot after a few steps
+	size_t mySlotCount = 1;
+	while (mySlotCount < topLevelTable.getCount() * 2)
+	{
+		mySlotCount *= 2;
+	}
+
+	return mySlotCount;
 }
 
-const void* VoxelGrid::getGridData() const
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getPaletteEntryCount() const
 {
-	return gridLayer1Data;
+	size_t myCount = 0;
+	for (const auto& palette : palettes)
+	{
+		myCount += palette.size();
+	}
+	return myCount;
 }
 
-const void* VoxelGrid::getLayer1ChunkData() const
+template<typename Layout>
+void BasicVoxelGrid<Layout>::copyLevelData(int aLevel, void* aDestination) const
 {
-	assert(layer1Chunks.size() > 0); //can't use empty voxel grid
+	levels[aLevel].copyTo(aDestination);
+}
 
-	return &layer1Chunks[0];
+template<typename Layout>
+void BasicVoxelGrid<Layout>::copyLevelOccupancyData(int aLevel, void* aDestination) const
+{
+	occupancy[aLevel].copyTo(aDestination);
 }
 
-size_t VoxelGrid::getLayer1ChunkDataSize() const
+template<typename Layout>
+const int* BasicVoxelGrid<Layout>::getChunkData(int aLevel, size_t aChunkIndex) const
 {
-	return layer1Chunks.size();
+	assert(aChunkIndex < getLevelChunkCount(aLevel));
+
+	return &levels[aLevel][aChunkIndex * Layout::getChunkIntCount(aLevel)];
 }
 
-const void* VoxelGrid::getLayer2ChunkData() const
+template<typename Layout>
+const uint64_t* BasicVoxelGrid<Layout>::getChunkOccupancyData(int aLevel, size_t aChunkIndex) const
 {
-	assert(layer2Chunks.size() > 0); //can't use empty voxel grid
+	assert(aChunkIndex < getLevelChunkCount(aLevel));
 
-	return &layer2Chunks[0];
+	return &occupancy[aLevel][aChunkIndex * Layout::getMaskWordCount(aLevel)];
 }
 
-size_t VoxelGrid::getLayer2ChunkDataSize() const
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getLevelChunkCount(int aLevel) const
 {
-	return layer2Chunks.size();
+	return levels[aLevel].size() / Layout::getChunkIntCount(aLevel);
+}
+
+template<typename Layout>
+size_t BasicVoxelGrid<Layout>::getMemoryUsage() const
+{
+	size_t myBytes = gridLayer1Data.size() * sizeof(int);
+	myBytes += topLevelTable.getMemoryUsage() + coarseTopLevel.getMemoryUsage();
+
+	for (const auto& level : levels)
+	{
+		myBytes += level.size() * sizeof(int);
+	}
+
+	for (const auto& mask : occupancy)
+	{
+		myBytes += mask.size() * sizeof(uint64_t);
+	}
+
+	myBytes += getPaletteEntryCount() * sizeof(int);
+	myBytes += brickReferenceCounts.size() * sizeof(uint32_t);
+	myBytes += brickPalettes.size() * sizeof(int);
+
+	return myBytes;
 }
 
-int VoxelGrid::getSizeX() const
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getSizeX() const
 {
 	return sizeX;
 }
 
-int VoxelGrid::getSizeY() const
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getSizeY() const
 {
 	return sizeY;
 }
 
-int VoxelGrid::getSizeZ() const
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getSizeZ() const
 {
 	return sizeZ;
 }
 
+template<typename Layout>
+glm::ivec3 BasicVoxelGrid<Layout>::getOrigin() const
+{
+	return glm::ivec3(originX, originY, originZ);
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getTopLevelCountX() const
+{
+	return layer1CountX;
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getTopLevelCountY() const
+{
+	return layer1CountY;
+}
+
+template<typename Layout>
+int BasicVoxelGrid<Layout>::getTopLevelCountZ() const
+{
+	return layer1CountZ;
+}
+
 Layer1Chunk::Layer1Chunk()
 {
 	for (auto& index : itemIndices)
@@ -198,3 +1903,9 @@ Layer1Chunk::Layer1Chunk()
 		index = -1;
 	}
 }
+
+// supported configurations, add new layouts here to benchmark them
+template class BasicVoxelGrid<VoxelGridLayout<4, 4>>;
+template class BasicVoxelGrid<VoxelGridLayout<8, 4>>;
+template class BasicVoxelGrid<VoxelGridLayout<4, 4, 4>>;
+template class BasicVoxelGrid<VoxelGridLayout<8, 8>>;
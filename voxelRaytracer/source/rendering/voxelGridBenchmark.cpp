@@ -0,0 +1,235 @@
+#include "rendering/voxelGridBenchmark.h"
+#include "rendering/voxelGrid.h"
+#include "engine/timer.h"
+#include "engine/logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdlib.h>
+#include <assert.h>
+#include <glm/glm.hpp>
+
+struct BenchmarkRay
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+static std::vector<BenchmarkRay> generateBenchmarkRays(const VoxelModel* aModel, int aRayCount)
+{
+	// fixed seed so every layout traces the exact same rays
+	std::mt19937 myGenerator(1337);
+	std::uniform_real_distribution<float> myDistribution(0.f, 1.f);
+
+	const glm::vec3 mySize = glm::vec3(aModel->sizeX, aModel->sizeY, aModel->sizeZ);
+
+	std::vector<BenchmarkRay> myRays(aRayCount);
+	for (auto& ray : myRays)
+	{
+		ray.origin = glm::vec3(myDistribution(myGenerator), myDistribution(myGenerator), myDistribution(myGenerator)) * mySize;
+
+		glm::vec3 myDirection;
+		do
+		{
+			myDirection = glm::vec3(myDistribution(myGenerator), myDistribution(myGenerator), myDistribution(myGenerator)) * 2.f - 1.f;
+		} while (glm::dot(myDirection, myDirection) < 0.0001f);
+
+		ray.direction = glm::normalize(myDirection);
+	}
+
+	return myRays;
+}
+
+// average distance in memory between bricks that are neighbours along y or z in the same parent chunk
+// neighbours along x are mostly allocated one after the other in every order
+template<typename Grid>
+static float measureBrickLocality(const Grid& aGrid)
+{
+	constexpr int myParentLevel = Grid::levelCount - 2;
+	constexpr int mySize = Grid::Layout::brickSizes[myParentLevel];
+	constexpr int myCellCount = Grid::Layout::getChunkIntCount(myParentLevel);
+	constexpr size_t myBrickBytes = Grid::Layout::getChunkIntCount(Grid::levelCount - 1) * sizeof(int);
+
+	const size_t myChunkCount = aGrid.getLevelChunkCount(myParentLevel);
+	if (myChunkCount == 0) return 0.f;
+
+	double myDistance = 0.0;
+	size_t myPairCount = 0;
+
+	for (size_t chunk = 0; chunk < myChunkCount; chunk++)
+	{
+		const int* myChunk = aGrid.getChunkData(myParentLevel, chunk);
+
+		for (int cell = 0; cell < myCellCount; cell++)
+		{
+			if (myChunk[cell] == -1) continue;
+
+			const int myY = (cell / mySize) % mySize;
+			const int myZ = cell / (mySize * mySize);
+
+			if (myY + 1 < mySize && myChunk[cell + mySize] != -1)
+			{
+				myDistance += std::abs(myChunk[cell + mySize] - myChunk[cell]);
+				myPairCount++;
+			}
+
+			if (myZ + 1 < mySize && myChunk[cell + mySize * mySize] != -1)
+			{
+				myDistance += std::abs(myChunk[cell + mySize * mySize] - myChunk[cell]);
+				myPairCount++;
+			}
+		}
+	}
+
+	return myPairCount ? static_cast<float>(myDistance / myPairCount * myBrickBytes) : 0.f;
+}
+
+// aSetup configures the grid before it is built
+template<typename Grid, typename Setup>
+static VoxelGridBenchmarkResult benchmarkLayout(const char* aName, const VoxelModel* aModel, const std::vector<BenchmarkRay>& aRays, Setup aSetup)
+{
+	VoxelGridBenchmarkResult myResult;
+	myResult.layoutName = aName;
+	myResult.sceneName = "scene";
+	myResult.sceneSize = aModel->sizeX;
+
+	Grid* myGrid = new Grid();
+
+	aSetup(*myGrid);
+
+	Timer myTimer;
+	myGrid->init(aModel);
+	myResult.buildTimeMS = static_cast<float>(myTimer.getTotalTime() * 1000.0);
+
+	myResult.memoryUsage = myGrid->getMemoryUsage();
+	myResult.brickCount = myGrid->getLevelChunkCount(Grid::levelCount - 1);
+	myResult.neighbourBrickDistance = measureBrickLocality(*myGrid);
+
+	size_t myLoopCount = 0;
+
+	myTimer.reset();
+	for (const auto& ray : aRays)
+	{
+		VoxelGridHit myHit = myGrid->traverseRay(ray.origin, ray.direction);
+		myLoopCount += myHit.loopCount;
+	}
+	const double myTraceTime = myTimer.getTotalTime();
+
+	myResult.megaRaysPerSecond = static_cast<float>(aRays.size() / myTraceTime / 1000000.0);
+	myResult.averageLoopCount = static_cast<float>(myLoopCount) / aRays.size();
+
+	LOG_INFO("voxel grid %s: %zu bytes, %zu bricks, build %.2f MS, %.2f MRays/s, %.2f steps per ray, %.0f bytes between neighbouring bricks", aName,
+		myResult.memoryUsage, myResult.brickCount, myResult.buildTimeMS, myResult.megaRaysPerSecond, myResult.averageLoopCount, myResult.neighbourBrickDistance);
+
+	delete myGrid;
+
+	return myResult;
+}
+
+template<typename Grid>
+static VoxelGridBenchmarkResult benchmarkLayout(const char* aName, const VoxelModel* aModel, const std::vector<BenchmarkRay>& aRays)
+{
+	return benchmarkLayout<Grid>(aName, aModel, aRays, [](Grid&) {});
+}
+
+std::vector<VoxelGridBenchmarkResult> runVoxelGridLayoutBenchmark(const VoxelModel* aModel, int aRayCount)
+{
+	const std::vector<BenchmarkRay> myRays = generateBenchmarkRays(aModel, aRayCount);
+
+	std::vector<VoxelGridBenchmarkResult> myResults;
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<4, 4>>>("4-4", aModel, myRays));
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<4, 4>>>("4-4 dedup", aModel, myRays, [](auto& aGrid) { aGrid.setBrickDeduplication(true); }));
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<4, 4>>>("4-4 sparse", aModel, myRays, [](auto& aGrid) { aGrid.setSparseTopLevel(true); }));
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<4, 4>>>("4-4 morton", aModel, myRays, [](auto& aGrid) { aGrid.setMortonOrder(true); }));
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<8, 4>>>("8-4", aModel, myRays));
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<4, 4, 4>>>("4-4-4", aModel, myRays));
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<4, 4, 4>>>("4-4-4 morton", aModel, myRays, [](auto& aGrid) { aGrid.setMortonOrder(true); }));
+	myResults.push_back(benchmarkLayout<BasicVoxelGrid<VoxelGridLayout<8, 8>>>("8-8", aModel, myRays));
+
+	return myResults;
+}
+
+// how the occupied bricks grow when the size doubles, about 2 for surfaces and 3 for filled volumes
+static double getBrickGrowthExponent(int aBrickCount, int aDoubledBrickCount)
+{
+	// an empty scene tells nothing about its growth, so it is treated as filled
+	if (aBrickCount <= 0 || aDoubledBrickCount <= 0) return 3.0;
+
+	// none of the generated scenes is thinner than a surface
+	// it can be above 3, the menger sponge grows in steps of three and fills more than twice the size after some doublings
+	return std::max(2.0, std::log2(static_cast<double>(aDoubledBrickCount) / aBrickCount));
+}
+
+size_t estimateScalingBenchmarkMemory(GeneratedScene aScene, SceneGeneratorSettings aSettings, int aSize)
+{
+	// small enough to generate while estimating
+	constexpr int myProbeSize = 128;
+
+	aSettings.size = std::min(aSize, myProbeSize);
+	const VoxelModel myProbe = generateScene(aScene, aSettings);
+
+	// the grids are smaller than the model they are built from and only one is alive at a time
+	const size_t myProbeBytes = myProbe.getMemoryUsage() * 2;
+	if (aSettings.size == aSize) return myProbeBytes;
+
+	// the memory follows the occupied bricks, the probe at half its size tells how fast they grow
+	aSettings.size /= 2;
+	const int myCoarseBrickCount = generateScene(aScene, aSettings).getBrickCount();
+
+	return scaleBenchmarkMemory(myProbeBytes, myProbeSize, aSize, getBrickGrowthExponent(myCoarseBrickCount, myProbe.getBrickCount()));
+}
+
+size_t scaleBenchmarkMemory(size_t aBytes, int aFromSize, int aToSize, double aExponent)
+{
+	return static_cast<size_t>(static_cast<double>(aBytes) * std::pow(static_cast<double>(aToSize) / aFromSize, aExponent));
+}
+
+std::vector<VoxelGridBenchmarkResult> runVoxelGridScalingBenchmark(GeneratedScene aScene, SceneGeneratorSettings aSettings, int aMinSize, int aMaxSize, size_t aMemoryBudget, int aRayCount)
+{
+	assert(aMinSize > 0);
+
+	std::vector<VoxelGridBenchmarkResult> myResults;
+
+	// the model and largest grid of the last size, measured instead of estimated once two sizes have run
+	size_t myPeakBytes = 0;
+
+	// fastest growth of the occupied bricks between two sizes so far, 0 until two sizes ran
+	// the largest is kept, the menger sponge doesn't grow at every size and would be underestimated after a size it didn't grow at
+	int myLastBrickCount = 0;
+	double myGrowthExponent = 0.0;
+
+	for (int size = aMinSize; size <= aMaxSize; size *= 2)
+	{
+		const size_t myEstimate = myGrowthExponent > 0.0 ? scaleBenchmarkMemory(myPeakBytes, size / 2, size, myGrowthExponent) : estimateScalingBenchmarkMemory(aScene, aSettings, size);
+		if (myEstimate > aMemoryBudget)
+		{
+			LOG_WARNING("stopped the scaling benchmark before %s %i, it needs about %.1f GB and %.1f GB is free", getGeneratedSceneName(aScene), size,
+				myEstimate / (1024.0 * 1024.0 * 1024.0), aMemoryBudget / (1024.0 * 1024.0 * 1024.0));
+			break;
+		}
+
+		aSettings.size = size;
+
+		Timer myTimer;
+		const VoxelModel myModel = generateScene(aScene, aSettings);
+
+		LOG_INFO("generated %s %i: %zu voxels in %zu bytes, %.2f MS", getGeneratedSceneName(aScene), size, myModel.getVoxelCount(), myModel.getMemoryUsage(), myTimer.getTotalTime() * 1000.0);
+
+		size_t myGridBytes = 0;
+		for (VoxelGridBenchmarkResult& result : runVoxelGridLayoutBenchmark(&myModel, aRayCount))
+		{
+			myGridBytes = std::max(myGridBytes, result.memoryUsage);
+
+			result.sceneName = getGeneratedSceneName(aScene);
+			myResults.push_back(std::move(result));
+		}
+
+		myPeakBytes = myModel.getMemoryUsage() + myGridBytes;
+
+		if (myLastBrickCount > 0) myGrowthExponent = std::max(myGrowthExponent, getBrickGrowthExponent(myLastBrickCount, myModel.getBrickCount()));
+		myLastBrickCount = myModel.getBrickCount();
+	}
+
+	return myResults;
+}
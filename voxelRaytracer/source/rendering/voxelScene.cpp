@@ -0,0 +1,246 @@
+#include "rendering/voxelScene.h"
+
+#include <assert.h>
+#include <algorithm>
+
+int VoxelScene::addInstance(const VoxelGrid* aGrid, const glm::mat4& aTransform)
+{
+	assert(aGrid);
+
+	VoxelInstance myInstance;
+	myInstance.grid = aGrid;
+
+	instances.push_back(myInstance);
+	setTransform(static_cast<int>(instances.size()) - 1, aTransform);
+
+	return static_cast<int>(instances.size()) - 1;
+}
+
+void VoxelScene::setTransform(int aInstanceIndex, const glm::mat4& aTransform)
+{
+	VoxelInstance& myInstance = instances[aInstanceIndex];
+
+	myInstance.transform = aTransform;
+	myInstance.inverseTransform = glm::inverse(aTransform);
+
+	updateBounds(myInstance);
+}
+
+void VoxelScene::clear()
+{
+	instances.clear();
+	instanceOrder.clear();
+	nodes.clear();
+}
+
+void VoxelScene::build()
+{
+	instanceOrder.resize(instances.size());
+	for (int i = 0; i < static_cast<int>(instanceOrder.size()); i++)
+	{
+		instanceOrder[i] = i;
+	}
+
+	nodes.clear();
+	if (instances.empty()) return;
+
+	// a binary tree with at most maxLeafSize instances per leaf never needs more nodes than this
+	nodes.reserve(instances.size() * 2);
+	nodes.emplace_back();
+
+	buildNode(0, 0, static_cast<int>(instances.size()), 0);
+}
+
+void VoxelScene::buildNode(int aNodeIndex, int aFirst, int aCount, int aDepth)
+{
+	AABB myBounds;
+	myBounds.initInvertedInfinity();
+
+	AABB myCenterBounds;
+	myCenterBounds.initInvertedInfinity();
+
+	for (int i = aFirst; i < aFirst + aCount; i++)
+	{
+		const AABB& myInstanceBounds = instances[instanceOrder[i]].bounds;
+
+		myBounds.growToContain(myInstanceBounds.min);
+		myBounds.growToContain(myInstanceBounds.max);
+		myCenterBounds.growToContain(myInstanceBounds.getCenter());
+	}
+
+	nodes[aNodeIndex].bounds = myBounds;
+
+	if (aCount <= maxLeafSize || aDepth == maxDepth)
+	{
+		nodes[aNodeIndex].firstIndex = aFirst;
+		nodes[aNodeIndex].count = aCount;
+		return;
+	}
+
+	// split at the median along the axis the centers are spread the most, scenes have few instances so this is good enough
+	const glm::vec3 mySpread = myCenterBounds.getDimensions();
+	const int myAxis = (mySpread.x >= mySpread.y && mySpread.x >= mySpread.z) ? 0 : (mySpread.y >= mySpread.z ? 1 : 2);
+
+	const int myHalf = aCount / 2;
+	std::nth_element(instanceOrder.begin() + aFirst, instanceOrder.begin() + aFirst + myHalf, instanceOrder.begin() + aFirst + aCount, [&](int aLeft, int aRight)
+	{
+		return instances[aLeft].bounds.getCenter()[myAxis] < instances[aRight].bounds.getCenter()[myAxis];
+	});
+
+	const int myChildIndex = static_cast<int>(nodes.size());
+	nodes.emplace_back();
+	nodes.emplace_back();
+
+	nodes[aNodeIndex].firstIndex = myChildIndex;
+	nodes[aNodeIndex].count = 0;
+
+	buildNode(myChildIndex, aFirst, myHalf, aDepth + 1);
+	buildNode(myChildIndex + 1, aFirst + myHalf, aCount - myHalf, aDepth + 1);
+}
+
+void VoxelScene::refit()
+{
+	assert(instanceOrder.size() == instances.size()); //build() has to be called after adding instances
+
+	// children always come after their parent, so going backwards updates the children first
+	for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--)
+	{
+		BvhNode& myNode = nodes[i];
+		myNode.bounds.initInvertedInfinity();
+
+		if (myNode.count > 0)
+		{
+			for (int j = myNode.firstIndex; j < myNode.firstIndex + myNode.count; j++)
+			{
+				myNode.bounds.growToContain(instances[instanceOrder[j]].bounds.min);
+				myNode.bounds.growToContain(instances[instanceOrder[j]].bounds.max);
+			}
+		}
+		else
+		{
+			for (int j = myNode.firstIndex; j < myNode.firstIndex + 2; j++)
+			{
+				myNode.bounds.growToContain(nodes[j].bounds.min);
+				myNode.bounds.growToContain(nodes[j].bounds.max);
+			}
+		}
+	}
+}
+
+VoxelSceneHit VoxelScene::traverseRay(const glm::vec3& aOrigin, const glm::vec3& aDirection) const
+{
+	VoxelSceneHit myResult;
+
+	if (nodes.empty()) return myResult;
+
+	const glm::vec3 myInverseDirection = 1.f / aDirection;
+
+	// a node at depth d leaves at most d + 1 nodes on the stack, build() caps the depth
+	int myStack[maxDepth + 1];
+	int myStackSize = 0;
+
+	if (intersectBounds(nodes[0].bounds, aOrigin, myInverseDirection, myResult.distance) == FLT_MAX) return myResult;
+	myStack[myStackSize++] = 0;
+
+	while (myStackSize > 0)
+	{
+		const BvhNode& myNode = nodes[myStack[--myStackSize]];
+
+		if (myNode.count > 0)
+		{
+			for (int i = myNode.firstIndex; i < myNode.firstIndex + myNode.count; i++)
+			{
+				const int myInstanceIndex = instanceOrder[i];
+				const VoxelInstance& myInstance = instances[myInstanceIndex];
+
+				if (intersectBounds(myInstance.bounds, aOrigin, myInverseDirection, myResult.distance) == FLT_MAX) continue;
+
+				// the direction isn't normalized in voxel space, so distances along it are the same as in world space
+				const glm::vec3 myOrigin = glm::vec3(myInstance.inverseTransform * glm::vec4(aOrigin, 1.f));
+				const glm::vec3 myDirection = glm::vec3(myInstance.inverseTransform * glm::vec4(aDirection, 0.f));
+
+				const VoxelGridHit myHit = myInstance.grid->traverseRay(myOrigin, myDirection);
+
+				if (myHit.itemIndex && myHit.distance < myResult.distance)
+				{
+					myResult.distance = myHit.distance;
+					myResult.itemIndex = myHit.itemIndex;
+					myResult.instanceIndex = myInstanceIndex;
+
+					// normals go back to world space with the inverse transpose
+					const glm::vec3 myNormal = glm::vec3(glm::transpose(myInstance.inverseTransform) * glm::vec4(myHit.normal, 0.f));
+					myResult.normal = glm::dot(myNormal, myNormal) > 0.f ? glm::normalize(myNormal) : myNormal;
+				}
+			}
+
+			continue;
+		}
+
+		// visit the closer child first, the other one is skipped when it is further away than the hit found
+		const int myLeft = myNode.firstIndex;
+		const int myRight = myNode.firstIndex + 1;
+
+		float myLeftDistance = intersectBounds(nodes[myLeft].bounds, aOrigin, myInverseDirection, myResult.distance);
+		float myRightDistance = intersectBounds(nodes[myRight].bounds, aOrigin, myInverseDirection, myResult.distance);
+
+		int myNear = myLeft;
+		int myFar = myRight;
+		if (myRightDistance < myLeftDistance)
+		{
+			std::swap(myNear, myFar);
+			std::swap(myLeftDistance, myRightDistance);
+		}
+
+		assert(myStackSize + 2 <= maxDepth + 1);
+
+		if (myRightDistance != FLT_MAX) myStack[myStackSize++] = myFar;
+		if (myLeftDistance != FLT_MAX) myStack[myStackSize++] = myNear;
+	}
+
+	return myResult;
+}
+
+const VoxelInstance& VoxelScene::getInstance(int aInstanceIndex) const
+{
+	return instances[aInstanceIndex];
+}
+
+size_t VoxelScene::getInstanceCount() const
+{
+	return instances.size();
+}
+
+size_t VoxelScene::getNodeCount() const
+{
+	return nodes.size();
+}
+
+void VoxelScene::updateBounds(VoxelInstance& aInstance)
+{
+	const glm::vec3 myMin = glm::vec3(aInstance.grid->getOrigin());
+	const glm::vec3 myMax = myMin + glm::vec3(aInstance.grid->getSizeX(), aInstance.grid->getSizeY(), aInstance.grid->getSizeZ());
+
+	aInstance.bounds.initInvertedInfinity();
+
+	// bounds of the 8 transformed corners of the grid
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec3 myCorner = glm::vec3(i & 1 ? myMax.x : myMin.x, i & 2 ? myMax.y : myMin.y, i & 4 ? myMax.z : myMin.z);
+
+		aInstance.bounds.growToContain(glm::vec3(aInstance.transform * glm::vec4(myCorner, 1.f)));
+	}
+}
+
+float VoxelScene::intersectBounds(const AABB& aBounds, const glm::vec3& aOrigin, const glm::vec3& aInverseDirection, float aMaxDistance)
+{
+	const glm::vec3 myTMin = (aBounds.min - aOrigin) * aInverseDirection;
+	const glm::vec3 myTMax = (aBounds.max - aOrigin) * aInverseDirection;
+
+	const glm::vec3 myT1 = glm::min(myTMin, myTMax);
+	const glm::vec3 myT2 = glm::max(myTMin, myTMax);
+
+	const float myNear = std::max(std::max(myT1.x, myT1.y), std::max(myT1.z, 0.f));
+	const float myFar = std::min(std::min(myT2.x, myT2.y), myT2.z);
+
+	return myNear <= myFar && myNear < aMaxDistance ? myNear : FLT_MAX;
+}